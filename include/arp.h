@@ -2,6 +2,7 @@
 #define ARP_H
 
 #include "net.h"
+#include "ethernet.h"
 
 #define ARP_HW_ETHER 0x1 // 以太网
 #define ARP_REQUEST 0x1  // ARP请求包
@@ -23,10 +24,13 @@ typedef struct arp_pkt
 
 #pragma pack()
 
-void arp_init();
-void arp_print();
-void arp_in(buf_t *buf, uint8_t *src_mac);
-void arp_out(buf_t *buf, uint8_t *ip);
-void arp_req(uint8_t *target_ip);
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac);
+#define ARP_HEADROOM ETHERNET_HEADROOM //ARP发送路径需预留的头部空间
+
+void arp_init(net_stack_t *stack);
+void arp_stack_init(net_stack_t *stack);
+void arp_print(net_stack_t *stack);
+void arp_in(net_stack_t *stack, buf_t *buf, uint8_t *src_mac);
+void arp_out(net_stack_t *stack, net_if_t *net_if, buf_t *buf, uint8_t *ip);
+void arp_req(net_stack_t *stack, net_if_t *net_if, uint8_t *target_ip);
+void arp_resp(net_stack_t *stack, net_if_t *net_if, uint8_t *target_ip, uint8_t *target_mac);
 #endif
\ No newline at end of file
@@ -5,18 +5,54 @@
 #include <stdint.h>
 #include "config.h"
 
+typedef struct buf_seg //buffer的后续分段，引用其他mempool缓冲区中的一段数据
+{
+    uint8_t *data;        // 分段数据起始地址
+    size_t len;           // 分段长度
+    uint8_t *owner;       // 分段数据所在的mempool缓冲区，分段持有其一个引用
+    struct buf_seg *next; // 下一个分段
+} buf_seg_t;
+
 typedef struct buf //协议栈的通用数据包buffer, 可以在头部装卸数据，以供协议头的添加和去除
 {
-    size_t len;                   // 包中有效数据大小
-    uint8_t *data;                // 包的数据起始地址
-    uint8_t payload[BUF_MAX_LEN]; // 最大负载数据量
+    size_t len;       // 包中有效数据大小，含后续分段
+    uint8_t *data;    // 包的数据起始地址（首段）
+    uint8_t *payload; // 首段缓冲区起始地址，来自mempool，为NULL表示尚未分配
+    size_t size;      // 首段缓冲区大小
+    buf_seg_t *segs;  // 首段之后的分段链表，为NULL表示数据连续
+    size_t seg_len;   // 后续分段的总长度
+    uint8_t if_id;    // 收到该数据包的网卡编号，由驱动填写，buf_init时置0
+    uint8_t borrowed; // 为1表示首段借用驱动接收缓冲区中的帧，不属于mempool，只在驱动下次接收前有效
 } buf_t;
 
+/**
+ * @brief 获取首段（buf->data处连续数据）的长度
+ *
+ * @param buf 要获取的buffer
+ * @return size_t 首段长度
+ */
+static inline size_t buf_head_len(const buf_t *buf)
+{
+    return buf->len - buf->seg_len;
+}
+
+buf_t *buf_alloc(size_t len);
+void buf_free(buf_t *buf);
+void buf_release(buf_t *buf);
 int buf_init(buf_t *buf, size_t len);
+int buf_borrow(buf_t *buf, uint8_t *frame, size_t len);
+int buf_reserve(buf_t *buf, size_t headroom);
 int buf_add_header(buf_t *buf, size_t len);
 int buf_remove_header(buf_t *buf, size_t len);
 int buf_add_padding(buf_t *buf, size_t len);
 int buf_remove_padding(buf_t *buf, size_t len);
-void buf_copy(void *pdst, const void *psrc, size_t len);
+int buf_copy(buf_t *dst, const buf_t *src);
+void buf_clone(void *pdst, const void *psrc, size_t len);
+int buf_shared(const buf_t *buf);
+int buf_unshare(buf_t *buf);
+int buf_append_ref(buf_t *buf, const buf_t *src, size_t offset, size_t len);
+int buf_linearize(buf_t *buf);
+size_t buf_gather(const buf_t *buf, uint8_t *dst);
+uint16_t buf_checksum16(const buf_t *buf, size_t len, uint32_t sum);
 
-#endif
\ No newline at end of file
+#endif
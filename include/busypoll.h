@@ -0,0 +1,25 @@
+#ifndef BUSYPOLL_H
+#define BUSYPOLL_H
+
+#include <stdint.h>
+#include "net.h"
+
+typedef void (*net_app_poll_t)(); // 每次协议栈轮询之后调用的应用层处理程序
+
+typedef struct net_busypoll_stats //忙轮询统计，用于调整空转预算
+{
+    uint64_t spin_polls; // 没有收到数据包的轮询次数
+    uint64_t work_polls; // 收到数据包的轮询次数
+    uint64_t packets;    // 收到的数据包个数
+    uint64_t spin_ns;    // 空转轮询花费的时间，纳秒
+    uint64_t work_ns;    // 处理数据包花费的时间，纳秒
+    uint64_t blocks;     // 空转超出预算后退回阻塞等待的次数
+} net_busypoll_stats_t;
+
+extern net_busypoll_stats_t net_busypoll_stats;
+
+int net_busypoll_pin(int cpu);
+void net_busypoll_report();
+void net_run_busypoll(net_stack_t *stack, net_app_poll_t app);
+
+#endif
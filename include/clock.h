@@ -0,0 +1,49 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+extern _Thread_local uint64_t net_clock_now; // 缓存的单调时钟，纳秒，每个线程各有一份
+extern int64_t net_clock_wall_offset;        // 日历时间与单调时钟之差，纳秒
+
+void net_clock_init();
+void net_clock_update();
+void net_clock_observe(uint64_t wall_ns);
+void net_clock_set_observe(int enable);
+void net_clock_set_virtual(int enable);
+void net_clock_advance(uint64_t ns);
+
+/**
+ * @brief 获取缓存的单调时钟，每次协议栈轮询刷新一次，尚未初始化时先读取一次
+ *
+ * @return uint64_t 纳秒
+ */
+static inline uint64_t net_clock_ns()
+{
+    if (net_clock_now == 0)
+        net_clock_init();
+    return net_clock_now;
+}
+
+/**
+ * @brief 获取缓存的单调时钟
+ *
+ * @return uint64_t 毫秒
+ */
+static inline uint64_t net_clock_ms()
+{
+    return net_clock_ns() / 1000000;
+}
+
+/**
+ * @brief 获取缓存的日历时间，用于表项的更新时间等需要打印的时刻
+ *
+ * @return time_t 秒
+ */
+static inline time_t net_clock_time()
+{
+    return (time_t)(((int64_t)net_clock_ns() + net_clock_wall_offset) / 1000000000);
+}
+
+#endif
@@ -36,7 +36,42 @@
         0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF  \
     } // 广播 mac 地址
 
+#define NET_IF_PREFIX_LEN 24             //网卡所在网段的前缀长度，据此添加直连路由
+// #define NET_IF_GATEWAY {192, 168, 96, 1} //默认网关，未定义时默认路由直接从网卡0发出，目的地址都视为直接可达
+#define NET_DRIVER_DEFAULT "pcap"        //默认的驱动后端，可用环境变量NET_DRIVER或命令行参数在启动时另选
+#define NET_AF_PACKET_BLOCK_SIZE (1 << 20) //af_packet后端接收环每块的字节数，须为页大小的整数倍
+#define NET_AF_PACKET_BLOCK_NUM 32       //af_packet后端接收环的块数
+#define NET_AF_PACKET_BLOCK_TIMEOUT_MS 1 //af_packet后端接收块未满时最长等待多久交给用户态（毫秒）
+#define NET_AF_PACKET_TX_FRAME_NUM 1024  //af_packet后端发送环的帧数
+#define NET_SHM_NAME_DEFAULT "net_shm"   //shm后端控制套接字的默认名字，可用环境变量NET_SHM_NAME另选，两个进程名字相同即连在一起
+#define NET_SHM_RING_SIZE 1024           //shm后端每个方向描述符环的长度，须为2的幂
+#define NET_SHM_FRAME_SIZE 2048          //shm后端每个帧槽的字节数
+#define NET_SHM_CONNECT_TIMEOUT_MS 5000  //shm后端从端等待主端交付共享内存的最长时间（毫秒）
+#define NET_VLINK_LIMIT 1000             //虚拟链路每个方向默认最多排队的帧数，超出时尾部丢弃
+#define NET_IF_MAX 4                     //协议栈最多同时打开的网卡数
+#define NET_ROUTE_TBL8_GROUPS 4096       //路由表tbl8组数，每个含长于24位前缀的/24网段占用一组
+
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500 //以太网最大传输单元
+#define NET_VECTOR_SIZE 32               //每次轮询最多批量接收并逐层处理的数据包数
+#define NET_POLL_BUDGET 256              //每次轮询最多处理的数据包数，积压的数据包一次唤醒处理完，又不饿死定时器与应用
+#define NET_TX_BATCH 32                  //每个网卡的发送队列长度，攒满或每次轮询结束时整批交给驱动发送
+#define NET_WAIT_MAX_MS 1000             //空闲时事件循环最长等待时间，保证map过期条目仍能被定期清理
+// #define NET_RX_ZERO_COPY               //接收时不拷贝，buffer直接借用驱动接收缓冲区中的帧，就地处理
+
+// #define NET_BUSYPOLL                   //主循环改用忙轮询模式，以CPU换取最低的收包延迟
+#define NET_BUSYPOLL_CPU -1              //忙轮询线程绑定的CPU核，为-1表示不绑定
+#define NET_BUSYPOLL_SPIN_US 50          //连续空转超过该时长（微秒）后退回阻塞等待
+#define NET_BUSYPOLL_REPORT_SEC 10       //打印忙轮询统计的间隔（秒），为0表示不打印
+
+// #define NET_PIPELINE                   //主循环改用多线程流水线：接收线程、协议线程与应用线程
+#define NET_PIPELINE_RING_SIZE 256       //接收队列容量与帧缓冲区个数，须为2的幂
+#define NET_PIPELINE_SEND_SIZE 64        //应用线程发送队列容量与请求个数，须为2的幂
+#define NET_PIPELINE_SEND_MAX_LEN 2048   //一个发送请求最多携带的数据长度
+
+// #define NET_SHARD                      //主循环改用按流哈希分片的多个工作线程，各自独占一份协议栈状态
+#define NET_SHARD_NUM 4                  //工作线程（分片）个数
+#define NET_SHARD_RING_SIZE 256          //每个分片的接收队列容量与帧缓冲区个数，须为2的幂
+#define NET_SHARD_CONTROL 0              //处理ARP请求等非IP流量的分片，ARP响应复制给所有分片
 
 #define ARP_TIMEOUT_SEC (60 * 5) //arp表过期时间
 #define ARP_MIN_INTERVAL 1       //向相同地址发送arp请求的最小间隔
@@ -45,5 +80,17 @@
 
 #define BUF_MAX_LEN (2 * UINT16_MAX + UINT8_MAX) //buf最大长度
 
-#define MAP_MAX_LEN (16 * BUF_MAX_LEN) //map最大长度
+#define MEMPOOL_ALIGN 64                  //mempool缓冲区对齐（cache line）
+#define MEMPOOL_SMALL_SIZE 2048           //小缓冲区大小，用于ARP、ACK等短包
+#define MEMPOOL_MEDIUM_SIZE 9216          //中缓冲区大小，可容纳一个以太网帧
+#define MEMPOOL_LARGE_SIZE BUF_MAX_LEN    //大缓冲区大小，用于大包与tcp收发缓存
+#define MEMPOOL_SMALL_NUM 64              //小缓冲区每次预分配个数
+#define MEMPOOL_MEDIUM_NUM 16             //中缓冲区每次预分配个数
+#define MEMPOOL_LARGE_NUM 2               //大缓冲区每次预分配个数
+#define BUF_DESC_NUM 64                   //buf描述符每次预分配个数
+#define BUF_DEFAULT_HEADROOM 64           //buf_init默认预留的头部空间，不小于任一发送路径的协议头总长
+
+#define MAP_MAX_SIZE (1 << 20) //map默认的最大键值对数，存储空间按需增长到该值为止
+#define MAP_CHUNK_SIZE 64      //map条目数组每块的条目数，按块分配以保证条目地址不变
+#define MAP_SWEEP_BUDGET 64    //每次轮询对每个有超时时间的map最多检查的条目数
 #endif
\ No newline at end of file
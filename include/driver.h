@@ -6,8 +6,63 @@
 #ifndef PCAP_BUF_SIZE
 #define PCAP_BUF_SIZE 1024
 #endif
-int driver_open();
-int driver_recv(buf_t *buf);
-int driver_send(buf_t *buf);
-void driver_close();
-#endif
\ No newline at end of file
+
+#ifdef _WIN32
+typedef void *driver_fd_t; // 可等待的事件句柄
+#define DRIVER_FD_NONE NULL
+#else
+typedef int driver_fd_t; // 可选择的描述符
+#define DRIVER_FD_NONE -1
+#endif
+
+typedef struct driver_stats //驱动的收发统计
+{
+    uint64_t rx_packets; // 收到的数据包数
+    uint64_t rx_bytes;   // 收到的字节数
+    uint64_t rx_dropped; // 因缓冲区满等原因被丢弃的数据包数（内核或驱动统计）
+    uint64_t tx_packets; // 发送的数据包数
+    uint64_t tx_bytes;   // 发送的字节数
+    uint64_t tx_errors;  // 发送失败的数据包数
+} driver_stats_t;
+
+/**
+ * @brief 驱动后端的线程约定：每个网卡同一时刻只由一个线程接收（单线程主循环、流水线的接收线程或分片的分发线程），
+ *        send_burst可能由多个线程同时调用（流水线的协议线程与接收线程并行，分片模式下各分片都会发送），
+ *        后端须自行保证发送与接收、发送与发送之间互不干扰。
+ *        pcap、af_packet与shm用发送锁串行化发送，vlink的整条链路由一把锁保护，四者都可用于流水线与分片模式
+ * 
+ */
+typedef struct driver_ops //驱动后端，各后端的私有状态保存在net_if->driver
+{
+    const char *name;                                                  // 后端名，启动时据此选择
+    int (*open)(net_if_t *net_if);                                     // 打开网卡，成功为0，失败为-1
+    int (*recv)(net_if_t *net_if, buf_t *buf);                         // 接收一个数据包，返回长度，未收到为0，错误为-1
+    int (*recv_burst)(net_if_t *net_if, buf_t **bufs, int max);        // 批量接收，返回收到的个数，错误为-1
+    int (*send_burst)(net_if_t *net_if, buf_t **bufs, int n);          // 批量发送，返回发出的个数，错误为-1
+    void (*close)(net_if_t *net_if);                                   // 关闭网卡
+    driver_fd_t (*get_fd)(net_if_t *net_if);                           // 可等待的描述符，没有时为DRIVER_FD_NONE
+    void (*stats)(net_if_t *net_if, driver_stats_t *stats);            // 读取统计，可为NULL
+} driver_ops_t;
+
+extern const driver_ops_t driver_pcap_ops;
+extern const driver_ops_t driver_vlink_ops;
+#ifdef __linux__
+extern const driver_ops_t driver_af_packet_ops;
+extern const driver_ops_t driver_shm_ops;
+#endif
+
+int driver_find(uint8_t *ip, char *if_name, uint8_t *mask);
+void driver_filter_exp(net_if_t *net_if, char *filter_exp);
+
+int driver_select(const char *name);
+int driver_open(net_if_t *net_if);
+int driver_recv(net_if_t *net_if, buf_t *buf);
+int driver_recv_burst(net_if_t *net_if, buf_t **bufs, int max);
+int driver_send(net_if_t *net_if, buf_t *buf);
+int driver_send_burst(net_if_t *net_if, buf_t **bufs, int n);
+int driver_send_defer(net_if_t *net_if, buf_t *buf);
+void driver_flush();
+int driver_wait(int timeout_ms);
+void driver_close(net_if_t *net_if);
+void driver_stats(net_if_t *net_if, driver_stats_t *stats);
+#endif
@@ -0,0 +1,23 @@
+#ifndef DRIVER_VLINK_H
+#define DRIVER_VLINK_H
+
+#include "driver.h"
+
+typedef struct driver_vlink_conf //虚拟链路一个方向的损伤参数，与netem相仿，全为0时是无损、无时延、不限速的链路
+{
+    double loss;          // 随机丢包率
+    double burst_enter;   // Gilbert-Elliott突发丢包：由好状态进入坏状态的概率，为0表示不模拟突发丢包
+    double burst_exit;    // 由坏状态回到好状态的概率
+    double burst_loss;    // 坏状态下的丢包率
+    uint64_t delay_us;    // 固定时延，微秒
+    uint64_t jitter_us;   // 时延抖动，在[-jitter_us, jitter_us]内均匀分布，会造成乱序
+    double reorder;       // 不经时延立即送达的概率，造成乱序
+    double duplicate;     // 重复送达的概率
+    uint64_t rate_bps;    // 带宽上限，比特每秒，为0表示不限速
+    uint32_t limit;       // 链路上最多排队的帧数，超出时尾部丢弃，为0表示NET_VLINK_LIMIT
+    uint32_t seed;        // 随机数种子，相同的种子与发送序列得到相同的损伤
+} driver_vlink_conf_t;
+
+int driver_vlink_config(net_if_t *net_if, const driver_vlink_conf_t *conf);
+int64_t driver_vlink_next();
+#endif
@@ -14,9 +14,13 @@ typedef struct ether_hdr
     uint16_t protocol16;      // 协议/长度
 } ether_hdr_t;
 #pragma pack()
+
+#define ETHERNET_HEADROOM sizeof(ether_hdr_t) //以太网发送路径需预留的头部空间
+
 void ethernet_init();
-void ethernet_in(buf_t *buf);
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
-void ethernet_poll();
+void ethernet_in(net_stack_t *stack, buf_t *buf);
+void ethernet_in_vector(net_stack_t *stack, buf_t **bufs, size_t n);
+void ethernet_out(net_stack_t *stack, net_if_t *net_if, buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
+int ethernet_poll(net_stack_t *stack);
 static const uint8_t ether_broadcast_mac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}; //以太网广播mac地址
 #endif
\ No newline at end of file
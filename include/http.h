@@ -2,6 +2,7 @@
 #define HTTP_H
 
 #include <stdint.h>
+#include "net.h"
 /**
  * @brief web网页文件在路径
  *        调试时建议改为绝对路径
@@ -10,7 +11,7 @@
 #define HTTP_DOC_DIR               "../htmldocs"
 // #define HTTP_DOC_DIR               "Absolute path"
 
-int http_server_open(uint16_t port);
+int http_server_open(net_stack_t *stack, uint16_t port);
 void http_server_run(void);
 
 #endif
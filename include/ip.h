@@ -2,6 +2,7 @@
 #define IP_H
 
 #include "net.h"
+#include "ethernet.h"
 
 #pragma pack(1)
 typedef struct ip_hdr
@@ -20,12 +21,17 @@ typedef struct ip_hdr
 } ip_hdr_t;
 #pragma pack()
 
+#define IP_HEADROOM (ETHERNET_HEADROOM + sizeof(ip_hdr_t)) //IP发送路径需预留的头部空间
+
 #define IP_HDR_LEN_PER_BYTE 4      //ip包头长度单位
 #define IP_HDR_OFFSET_PER_BYTE 8   //ip分片偏移长度单位
 #define IP_VERSION_4 4             //ipv4
 #define IP_MORE_FRAGMENT (1 << 13) //ip分片mf位
+#define IP_FRAGMENT_OFFSET_MASK 0x1FFF //ip分片offset位
 #define IP_MAX_TRANSPRT_UNIT (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t)) // ip层最大传输单元（1480）
-void ip_in(buf_t *buf, uint8_t *src_mac);
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+void ip_in(net_stack_t *stack, buf_t *buf, uint8_t *src_mac);
+void ip_in_vector(net_stack_t *stack, buf_t **bufs, uint8_t **src_macs, size_t n);
+void ip_out(net_stack_t *stack, buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+uint8_t *ip_src_addr(net_stack_t *stack, uint8_t *dst_ip);
 void ip_init();
 #endif
\ No newline at end of file
@@ -3,11 +3,20 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "config.h"
+#include "clock.h"
 
 typedef void (*map_constuctor_t)(void *dst, const void *src, size_t len);
 typedef void (*map_entry_handler_t)(void *key, void *value, time_t *timestamp);
+typedef void (*map_entry_arg_handler_t)(void *key, void *value, time_t *timestamp, void *arg);
+
+typedef struct map_slot //map哈希索引表的一个槽位
+{
+    uint32_t hash; // 键的哈希值
+    uint32_t pos;  // 键值对在条目数组中的位置+1，为0表示空槽
+} map_slot_t;
 
 typedef struct map //协议栈的通用泛型map，即键值对的容器，支持超时时间与非平凡值类型
 {
@@ -16,8 +25,18 @@ typedef struct map //协议栈的通用泛型map，即键值对的容器，支
     size_t size;                       //当前大小
     size_t max_size;                   //最大容量
     time_t timeout;                    //超时时间，0为永不超时
-    map_constuctor_t value_constuctor; //形如memcpy的值构造函数，用于拷贝非平凡数据结构到容器中，如buf_copy
-    uint8_t data[MAP_MAX_LEN];         //数据
+    map_constuctor_t value_constuctor; //形如memcpy的值构造函数，用于拷贝非平凡数据结构到容器中，如buf_clone，为NULL时直接拷贝
+    size_t index_mask;                 //哈希索引表槽数-1，槽数为2的幂，索引表未分配时为0
+    size_t used;                       //条目数组中已使用部分的长度，其后的条目都是空闲的
+    size_t free_num;                   //空闲堆中的条目数
+    size_t free_cap;                   //空闲堆的容量
+    size_t chunk_num;                  //已分配的条目块数
+    size_t sweep_pos;                  //过期清理的游标，下一次从该条目位置开始检查
+    map_entry_handler_t expire_handler; //表项过期被清理前的回调，用于释放值中持有的资源，可为NULL
+    struct map *sweep_next;            //有超时时间的map串成链表，由map_sweep_poll逐个清理
+    map_slot_t *index;                 //Robin Hood开放寻址的哈希索引表，随大小增长与收缩
+    uint32_t *free_heap;               //已删除条目位置的小根堆，优先复用靠前的条目
+    uint8_t **chunks;                  //条目块表，每块MAP_CHUNK_SIZE个键值对，块不移动，条目地址在其生命期内不变
 } map_t;
 
 void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_len, time_t timeout, map_constuctor_t value_constuctor);
@@ -26,5 +45,208 @@ void *map_get(map_t *map, const void *key);
 int map_set(map_t *map, const void *key, const void *value);
 void map_delete(map_t *map, const void *key);
 void map_foreach(map_t *map, map_entry_handler_t handler);
+void map_foreach_arg(map_t *map, map_entry_arg_handler_t handler, void *arg);
+void map_set_expire_handler(map_t *map, map_entry_handler_t handler);
+size_t map_sweep(map_t *map, size_t budget);
+void map_sweep_poll();
+void *map_entry_insert(map_t *map, const void *key, uint32_t hash);
+void map_slot_delete(map_t *map, size_t slot);
+void map_slot_expire(map_t *map, size_t slot);
+
+/*
+ * 以下为map的查找、插入与删除的内联实现，键值长度与构造函数作为参数传入。
+ * 通用接口以运行时的长度调用它们；MAP_DEFINE生成的特化接口以sizeof常量调用，
+ * 编译器可以把键的比较内联为整数比较，把条目地址的计算折叠为常量乘法。
+ */
+
+/**
+ * @brief 内部函数，计算键的哈希值（FNV-1a，再经过murmur3的finalizer打散低位）
+ *
+ * @param key 键指针
+ * @param len 键的长度
+ * @return uint32_t 哈希值
+ */
+static inline uint32_t map_hash(const void *key, size_t len)
+{
+    const uint8_t *p = key;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * @brief 内部函数，计算索引表槽位到其哈希理想位置的探测距离
+ *
+ * @param map 要操作的map
+ * @param i 槽位
+ * @return size_t 探测距离
+ */
+static inline size_t map_slot_dist(const map_t *map, size_t i)
+{
+    return (i - map->index[i].hash) & map->index_mask;
+}
+
+/**
+ * @brief 内部函数，获取条目数组中第n个位置的键值对，不检查越界
+ *
+ * @param map 要获取的map
+ * @param pos 位置
+ * @param entry_len 条目长度
+ * @return uint8_t* 键值对指针
+ */
+static inline uint8_t *map_entry_at(const map_t *map, size_t pos, size_t entry_len)
+{
+    return map->chunks[pos / MAP_CHUNK_SIZE] + pos % MAP_CHUNK_SIZE * entry_len;
+}
+
+/**
+ * @brief 内部函数，判断键值对是否有效（已写入且未过期）
+ *
+ * @param map 要判断的map
+ * @param entry 键值对指针
+ * @param time_offset 更新时间在条目中的偏移，即键值长度之和
+ * @return int 1为合法，0为不合法
+ */
+static inline int map_entry_alive(const map_t *map, const uint8_t *entry, size_t time_offset)
+{
+    time_t entry_time = *(const time_t *)(entry + time_offset);
+    return entry_time && (!map->timeout || entry_time + map->timeout >= net_clock_time());
+}
+
+/**
+ * @brief 内部函数，在索引表中查找键所在的槽位
+ *        Robin Hood探测保证同一链上的探测距离不会小于当前距离，遇到更短的即可提前结束
+ *
+ * @param map 要查找的map
+ * @param key 键指针
+ * @param hash 键的哈希值
+ * @param key_len 键的长度
+ * @param entry_len 条目长度
+ * @return long 槽位，找不到为-1
+ */
+static inline long map_find(const map_t *map, const void *key, uint32_t hash, size_t key_len, size_t entry_len)
+{
+    if (map->index == NULL)
+        return -1;
+    size_t i = hash & map->index_mask;
+    for (size_t dist = 0;; dist++, i = (i + 1) & map->index_mask)
+    {
+        const map_slot_t *slot = &map->index[i];
+        if (slot->pos == 0 || map_slot_dist(map, i) < dist)
+            return -1;
+        if (slot->hash == hash && !memcmp(key, map_entry_at(map, slot->pos - 1, entry_len), key_len))
+            return i;
+    }
+}
+
+/**
+ * @brief 内部函数，map_get的内联实现
+ *
+ * @param map 要获取的map
+ * @param key 键指针
+ * @param key_len 键的长度
+ * @param value_len 值的长度
+ * @return void* 值指针，找不到为NULL
+ */
+static inline void *map_get_inline(map_t *map, const void *key, size_t key_len, size_t value_len)
+{
+    size_t entry_len = key_len + value_len + sizeof(time_t);
+    if (key == NULL)
+        return NULL;
+    long i = map_find(map, key, map_hash(key, key_len), key_len, entry_len);
+    if (i < 0)
+        return NULL;
+    uint8_t *entry = map_entry_at(map, map->index[i].pos - 1, entry_len);
+    if (!map_entry_alive(map, entry, key_len + value_len))
+    {
+        map_slot_expire(map, i); // 查到过期的键时顺便清理
+        return NULL;
+    }
+    return entry + key_len;
+}
+
+/**
+ * @brief 内部函数，map_set的内联实现，已存在的键原地更新，新键的插入走map_entry_insert
+ *
+ * @param map 要操作的map
+ * @param key 键指针
+ * @param value 值指针
+ * @param key_len 键的长度
+ * @param value_len 值的长度
+ * @param value_constuctor 值构造函数，为NULL时直接内联拷贝
+ * @return int 成功为0，失败为-1
+ */
+static inline int map_set_inline(map_t *map, const void *key, const void *value, size_t key_len, size_t value_len, map_constuctor_t value_constuctor)
+{
+    size_t entry_len = key_len + value_len + sizeof(time_t);
+    uint32_t hash = map_hash(key, key_len);
+    long i = map_find(map, key, hash, key_len, entry_len);
+    uint8_t *entry = NULL;
+    if (i >= 0)
+    {
+        entry = map_entry_at(map, map->index[i].pos - 1, entry_len);
+        if (!map_entry_alive(map, entry, key_len + value_len)) // 过期的旧值先清理，再作为新键插入
+        {
+            map_slot_expire(map, i);
+            entry = NULL;
+        }
+    }
+    if (entry == NULL && (entry = map_entry_insert(map, key, hash)) == NULL)
+        return -1;
+    if (value_constuctor == NULL)
+        memcpy(entry + key_len, value, value_len);
+    else
+        value_constuctor(entry + key_len, value, value_len);
+    *(time_t *)(entry + key_len + value_len) = net_clock_time();
+    return 0;
+}
+
+/**
+ * @brief 内部函数，map_delete的内联实现
+ *
+ * @param map 要操作的map
+ * @param key 键指针
+ * @param key_len 键的长度
+ * @param value_len 值的长度
+ */
+static inline void map_delete_inline(map_t *map, const void *key, size_t key_len, size_t value_len)
+{
+    long i = map_find(map, key, map_hash(key, key_len), key_len, key_len + value_len + sizeof(time_t));
+    if (i >= 0)
+        map_slot_delete(map, i);
+}
+
+/**
+ * @brief 生成键类型为K、值类型为V的特化map接口：name_init/name_get/name_set/name_delete
+ *        存储仍为map_t，可以与map_foreach等通用接口混用；K与V须为单个类型名，数组类型先typedef
+ *        键与值以const K *、const V *传入，由编译器检查类型；数组类型的键传&key，指向数组首元素的指针先转换为const K *
+ *        值的拷贝使用构造函数ctor，MAP_DEFINE传NULL，直接内联拷贝
+ *
+ */
+#define MAP_DEFINE_CTOR(name, K, V, ctor)                                                      \
+    static inline void name##_init(map_t *map, size_t max_size, time_t timeout)                \
+    {                                                                                          \
+        map_init(map, sizeof(K), sizeof(V), max_size, timeout, (map_constuctor_t)(ctor));      \
+    }                                                                                          \
+    static inline V *name##_get(map_t *map, const K *key)                                      \
+    {                                                                                          \
+        return (V *)map_get_inline(map, key, sizeof(K), sizeof(V));                            \
+    }                                                                                          \
+    static inline int name##_set(map_t *map, const K *key, const V *value)                     \
+    {                                                                                          \
+        return map_set_inline(map, key, value, sizeof(K), sizeof(V), (map_constuctor_t)(ctor)); \
+    }                                                                                          \
+    static inline void name##_delete(map_t *map, const K *key)                                 \
+    {                                                                                          \
+        map_delete_inline(map, key, sizeof(K), sizeof(V));                                     \
+    }
+
+#define MAP_DEFINE(name, K, V) MAP_DEFINE_CTOR(name, K, V, NULL)
 
 #endif
\ No newline at end of file
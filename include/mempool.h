@@ -0,0 +1,15 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "config.h"
+
+void mempool_init();
+void *mempool_alloc(size_t size, size_t *cap);
+void mempool_ref(void *ptr);
+size_t mempool_refcnt(const void *ptr);
+void mempool_free(void *ptr);
+void mempool_print();
+
+#endif
@@ -16,18 +16,38 @@ typedef enum net_protocol
     NET_PROTOCOL_TCP = 6,
 } net_protocol_t;
 
-typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
+typedef struct net_stack net_stack_t; //协议栈上下文，定义见stack.h
+
+typedef void (*net_handler_t)(net_stack_t *stack, buf_t *buf, uint8_t *src);
+typedef void (*net_vector_handler_t)(net_stack_t *stack, buf_t **bufs, uint8_t **srcs, size_t n);
+typedef int (*net_poll_hook_t)(net_stack_t *stack); // 代替本线程net_poll的轮询函数，返回处理的数据包个数
 
 #define NET_MAC_LEN 6 //mac地址长度
 #define NET_IP_LEN 4  //ip地址长度
 
-extern uint8_t net_if_mac[NET_MAC_LEN];
+typedef struct net_if //协议栈的一个网卡
+{
+    uint8_t id;                   // 网卡在协议栈网卡表中的编号
+    uint8_t prefix_len;           // 网卡所在网段的前缀长度
+    uint16_t mtu;                 // 以太网MTU
+    uint8_t mac[NET_MAC_LEN];     // 网卡mac地址
+    uint8_t ip[NET_IP_LEN];       // 网卡ip地址
+    const struct driver_ops *ops; // 网卡使用的驱动后端，打开后设置
+    void *driver;                 // 驱动后端的私有状态
+} net_if_t;
+
 extern uint8_t net_broadcast_mac[NET_MAC_LEN];
-extern uint8_t net_if_ip[NET_IP_LEN];
-extern buf_t rxbuf, txbuf; //一个buf足够单线程使用
+extern net_stack_t net_default_stack; //单线程主循环使用的协议栈
 
 int net_init();
-void net_poll();
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
+int net_stack_init(net_stack_t *stack);
+int net_if_add(net_stack_t *stack, const uint8_t *ip, uint8_t prefix_len, const uint8_t *mac);
+int net_poll(net_stack_t *stack);
+void net_poll_hook_set(net_poll_hook_t hook);
+void net_wait();
+int net_in(net_stack_t *stack, buf_t *buf, uint16_t protocol, uint8_t *src);
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
+int net_in_vector(net_stack_t *stack, buf_t **bufs, uint8_t **srcs, size_t n, uint16_t protocol);
+void net_in_runs(net_stack_t *stack, buf_t **bufs, uint8_t **srcs, const uint16_t *protocols, size_t n);
+void net_add_protocol_vector(uint16_t protocol, net_vector_handler_t handler);
 #endif
\ No newline at end of file
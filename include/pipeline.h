@@ -0,0 +1,13 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "net.h"
+#include "busypoll.h"
+
+void net_run_pipeline(net_stack_t *stack, net_app_poll_t app);
+int net_pipeline_udp_send(const uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int net_pipeline_tcp_write(uint8_t *ip, uint16_t remote_port, uint16_t local_port, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define RING_CACHE_LINE 64 // 生产者与消费者的下标放在不同的cache line上，避免伪共享
+
+typedef struct ring //无锁单生产者单消费者环形队列，元素为指针
+{
+    _Alignas(RING_CACHE_LINE) atomic_size_t head; // 生产者的写入位置，只增不减
+    size_t tail_cache;                            // 生产者缓存的消费者位置，队列看似满时才重新读取
+    _Alignas(RING_CACHE_LINE) atomic_size_t tail; // 消费者的读取位置，只增不减
+    size_t head_cache;                            // 消费者缓存的生产者位置，队列看似空时才重新读取
+    _Alignas(RING_CACHE_LINE) size_t mask;        // 容量减1，容量为2的幂
+    void **slots;                                 // 元素数组
+} ring_t;
+
+typedef struct ring_doorbell //消费者空闲时睡眠等待的门铃，生产者入队后只在其睡眠时才加锁唤醒
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    atomic_int sleeping; // 消费者是否登记了睡眠
+} ring_doorbell_t;
+
+int ring_init(ring_t *ring, size_t size);
+void ring_free(ring_t *ring);
+int ring_doorbell_init(ring_doorbell_t *bell);
+void ring_doorbell_ring(ring_doorbell_t *bell);
+void ring_doorbell_wait(ring_doorbell_t *bell, ring_t **rings, size_t n, int64_t timeout_ms);
+
+/**
+ * @brief 生产者向队列尾部放入一个元素
+ *
+ * @param ring 队列
+ * @param item 要放入的元素
+ * @return int 成功为0，队列满为-1
+ */
+static inline int ring_enqueue(ring_t *ring, void *item)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->tail_cache > ring->mask)
+    {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->tail_cache > ring->mask)
+            return -1;
+    }
+    ring->slots[head & ring->mask] = item;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief 消费者从队列头部取出至多n个元素
+ *
+ * @param ring 队列
+ * @param items 出口参数，取出的元素
+ * @param n 最多取出的个数
+ * @return size_t 取出的个数，队列空为0
+ */
+static inline size_t ring_dequeue_burst(ring_t *ring, void **items, size_t n)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (ring->head_cache - tail < n)
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t count = ring->head_cache - tail;
+    if (count > n)
+        count = n;
+    for (size_t i = 0; i < count; i++)
+        items[i] = ring->slots[(tail + i) & ring->mask];
+    if (count)
+        atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+/**
+ * @brief 消费者从队列头部取出一个元素
+ *
+ * @param ring 队列
+ * @return void* 取出的元素，队列空为NULL
+ */
+static inline void *ring_dequeue(ring_t *ring)
+{
+    void *item;
+    return ring_dequeue_burst(ring, &item, 1) ? item : NULL;
+}
+
+/**
+ * @brief 判断队列是否为空，生产者与消费者都可调用
+ *
+ * @param ring 队列
+ * @return int 为空为1，否则为0
+ */
+static inline int ring_empty(ring_t *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) == atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+#endif
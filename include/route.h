@@ -0,0 +1,72 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "map.h"
+
+#define NET_ROUTE_TBL24_NUM (1 << 24)     // tbl24的表项数，按目的地址的高24位直接索引
+#define NET_ROUTE_TBL8_SIZE 256           // 每个tbl8组的表项数，按目的地址的低8位索引
+#define NET_ROUTE_EXT 0x80000000u         // tbl24表项的扩展位，置位时低24位是tbl8组号
+#define NET_ROUTE_DEPTH_SHIFT 24          // 表项中前缀长度所在的位置
+#define NET_ROUTE_INDEX_MASK 0x00FFFFFFu  // 表项中下一跳编号+1（为0表示无路由）或tbl8组号
+
+typedef struct net_nexthop //路由的下一跳
+{
+    uint8_t gateway[4]; // 网关ip地址，全0表示目的地址直接可达
+    uint16_t mtu;       // 路径MTU，为0时使用出口网卡的MTU
+    uint8_t if_id;      // 出口网卡在协议栈网卡表中的编号
+} net_nexthop_t;
+
+typedef struct net_route_table //DIR-24-8最长前缀匹配路由表，查找最多访问两次内存
+{
+    uint32_t *tbl24;         // 第一级表，表项为（前缀长度，下一跳编号+1），或扩展位与tbl8组号
+    uint32_t *tbl8;          // 第二级表，NET_ROUTE_TBL8_GROUPS组，每组NET_ROUTE_TBL8_SIZE项，处理长于24位的前缀
+    uint32_t *tbl8_free;     // 空闲的tbl8组号栈
+    size_t tbl8_free_num;    // 空闲的tbl8组数
+    uint32_t default_index;  // 默认路由的下一跳编号+1，为0表示没有默认路由；默认路由不填入tbl24
+    net_nexthop_t *nexthops; // 下一跳数组，按编号索引，只增不减
+    size_t nexthop_num;      // 下一跳个数
+    size_t nexthop_cap;      // 下一跳数组的容量
+    map_t nexthop_map;       // <net_nexthop_t,编号>，相同的下一跳只保存一份
+    map_t rules;             // <前缀,前缀长度> -> 下一跳编号，删除路由时查找覆盖它的较短前缀
+} net_route_table_t;
+
+int net_route_init(net_route_table_t *table);
+int net_route_add(net_route_table_t *table, const uint8_t *prefix, uint8_t len, const net_nexthop_t *nexthop);
+int net_route_delete(net_route_table_t *table, const uint8_t *prefix, uint8_t len);
+
+/**
+ * @brief 按目的地址查找最长前缀匹配的路由
+ *
+ * @param table 路由表
+ * @param ip 目的ip地址
+ * @return net_nexthop_t* 下一跳，没有匹配的路由时为NULL
+ */
+static inline net_nexthop_t *net_route_lookup(const net_route_table_t *table, const uint8_t *ip)
+{
+    uint32_t addr = ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+    uint32_t entry = table->tbl24[addr >> 8];
+    if (entry & NET_ROUTE_EXT)
+        entry = table->tbl8[(size_t)(entry & NET_ROUTE_INDEX_MASK) * NET_ROUTE_TBL8_SIZE + (addr & 0xFF)];
+    uint32_t index = entry & NET_ROUTE_INDEX_MASK;
+    if (index == 0)
+        index = table->default_index;
+    return index ? &table->nexthops[index - 1] : NULL;
+}
+
+/**
+ * @brief 获取发往目的地址的数据包在链路上的下一跳地址
+ *
+ * @param nexthop 路由的下一跳
+ * @param dst 目的ip地址
+ * @return uint8_t* 有网关时为网关地址，否则为目的地址
+ */
+static inline uint8_t *net_nexthop_addr(net_nexthop_t *nexthop, uint8_t *dst)
+{
+    uint8_t *gateway = nexthop->gateway;
+    return (gateway[0] | gateway[1] | gateway[2] | gateway[3]) ? gateway : dst;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "net.h"
+#include "busypoll.h"
+
+uint32_t net_shard_hash(const uint8_t *tuple, size_t len);
+void net_run_sharded(net_stack_t *stack, net_app_poll_t app);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef STACK_H
+#define STACK_H
+
+#include "net.h"
+#include "udp.h"
+#include "tcp.h"
+#include "route.h"
+
+struct net_stack //协议栈上下文，收发路径上的状态都在这里，每个协议处理线程各持有一份，互不加锁
+{
+    net_if_t ifs[NET_IF_MAX];                // 网卡表，按编号索引
+    int if_num;                              // 网卡数
+    net_route_table_t *routes;               // 路由表，各协议栈共享，启动工作线程之后只读
+    buf_t txbuf;                             // 发送缓冲区
+    map_t arp_table;                         // arp地址转换表，<ip,mac>的容器
+    map_t arp_buf;                           // arp buffer，<ip,arp_pending_t>的容器，等待arp响应的数据包
+    uint16_t ip_id;                          // 下一个发送的ip数据包的标识
+    map_t connect_table;                     // tcp连接表，<tcp_key_t,tcp_connect_t>的容器
+    udp_handler_t udp_table[UINT16_MAX + 1]; // udp处理程序表，按端口号直接索引，为NULL表示端口未打开
+    tcp_handler_t tcp_table[UINT16_MAX + 1]; // tcp处理程序表，按端口号直接索引，为NULL表示端口未打开
+};
+
+#endif
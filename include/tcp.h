@@ -2,6 +2,7 @@
 #define TCP_H
 
 #include "net.h"
+#include "ip.h"
 
 #pragma pack(1)
 
@@ -45,6 +46,8 @@ typedef struct tcp_peso_hdr {
 
 #pragma pack()
 
+#define TCP_HEADROOM (IP_HEADROOM + sizeof(tcp_hdr_t)) //TCP发送路径需预留的头部空间
+
 
 typedef enum tcp_state {
     // 不使用状态 TCP_CLOSED,
@@ -77,6 +80,7 @@ typedef struct tcp_connect {
     uint16_t remote_mss;
     uint16_t remote_win;
     void* handler;
+    net_stack_t* stack; // 连接所属的协议栈
     buf_t* rx_buf; // 接收缓存
     buf_t* tx_buf; // 发送缓存
 } tcp_connect_t;
@@ -97,11 +101,13 @@ typedef enum connect_state {
 typedef void (*tcp_handler_t)(tcp_connect_t* conect, connect_state_t state);
 
 void tcp_init();
-int tcp_open(uint16_t port, tcp_handler_t handler);
-void tcp_close(uint16_t port);
+void tcp_stack_init(net_stack_t* stack);
+int tcp_open(net_stack_t* stack, uint16_t port, tcp_handler_t handler);
+void tcp_close(net_stack_t* stack, uint16_t port);
 void tcp_connect_close(tcp_connect_t* connect);
+tcp_connect_t* tcp_connect_find(net_stack_t* stack, uint8_t* ip, uint16_t remote_port, uint16_t local_port);
 size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len);
 size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len);
-void tcp_in(buf_t* buf, uint8_t* src_ip);
+void tcp_in(net_stack_t* stack, buf_t* buf, uint8_t* src_ip);
 
 #endif
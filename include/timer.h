@@ -0,0 +1,36 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+struct net_timer;
+typedef void (*net_timer_handler_t)(struct net_timer *timer, void *arg);
+
+typedef struct net_timer //协议栈定时器，由使用者持有（通常嵌在连接等结构体中），挂在时间轮的槽链表上
+{
+    struct net_timer *next;      // 槽链表中的下一个定时器
+    struct net_timer **pprev;    // 指向前一个节点next域的指针，为NULL表示未挂在时间轮上
+    uint64_t expires;            // 到期时刻，缓存单调时钟的毫秒数
+    net_timer_handler_t handler; // 到期回调，回调中可以重新添加定时器
+    void *arg;                   // 回调参数
+} net_timer_t;
+
+void net_timer_init();
+void net_timer_setup(net_timer_t *timer, net_timer_handler_t handler, void *arg);
+void net_timer_add(net_timer_t *timer, uint64_t delay_ms);
+void net_timer_cancel(net_timer_t *timer);
+void net_timer_poll();
+int64_t net_timer_next();
+
+/**
+ * @brief 判断定时器是否在等待到期
+ *
+ * @param timer 要判断的定时器
+ * @return int 等待中为1，否则为0
+ */
+static inline int net_timer_pending(const net_timer_t *timer)
+{
+    return timer->pprev != NULL;
+}
+
+#endif
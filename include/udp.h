@@ -2,6 +2,7 @@
 #define UDP_H
 
 #include "net.h"
+#include "ip.h"
 
 #pragma pack(1)
 typedef struct udp_hdr
@@ -22,12 +23,15 @@ typedef struct udp_peso_hdr
 } udp_peso_hdr_t;
 #pragma pack()
 
-typedef void (*udp_handler_t)(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
+#define UDP_HEADROOM (IP_HEADROOM + sizeof(udp_hdr_t)) //UDP发送路径需预留的头部空间
+
+typedef void (*udp_handler_t)(net_stack_t *stack, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
 
 void udp_init();
-void udp_in(buf_t *buf, uint8_t *src_ip);
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
-int udp_open(uint16_t port, udp_handler_t handler);
-void udp_close(uint16_t port);
+void udp_in(net_stack_t *stack, buf_t *buf, uint8_t *src_ip);
+void udp_in_vector(net_stack_t *stack, buf_t **bufs, uint8_t **src_ips, size_t n);
+void udp_out(net_stack_t *stack, buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_send(net_stack_t *stack, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int udp_open(net_stack_t *stack, uint16_t port, udp_handler_t handler);
+void udp_close(net_stack_t *stack, uint16_t port);
 #endif
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <time.h>
 
 uint16_t checksum16(uint16_t *data, size_t len);
+uint32_t checksum16_partial(uint32_t sum, const void *data, size_t len, size_t offset);
+uint16_t checksum16_fold(uint32_t sum);
 
 #define constswap16(x) ((((x)&0xFF) << 8) | (((x) >> 8) & 0xFF)) //为16位数据交换大小端
 //为16位数据交换大小端
@@ -20,6 +22,11 @@ static inline uint32_t swap32(uint32_t x) {
         (((x >> 24) & 0xFF) << 0);
 }
 
+//预取addr所在的cache line，供批量处理时提前取下一个包的头部
+static inline void prefetch(const void *addr) {
+    __builtin_prefetch(addr);
+}
+
 static inline uint32_t min32(uint32_t a, uint32_t b) {
     return a < b ? a : b;
 }
@@ -3,6 +3,8 @@
 #include "net.h"
 #include "arp.h"
 #include "ethernet.h"
+#include "stack.h"
+#include "timer.h"
 /**
  * @brief 初始的arp包
  * 
@@ -12,21 +14,59 @@ static const arp_pkt_t arp_init_pkt = {
     .pro_type16 = constswap16(NET_PROTOCOL_IP),
     .hw_len = NET_MAC_LEN,
     .pro_len = NET_IP_LEN,
-    .sender_ip = NET_IF_IP,
-    .sender_mac = NET_IF_MAC,
     .target_mac = {0}};
 
+typedef uint8_t arp_ip_t[NET_IP_LEN];
+typedef uint8_t arp_mac_t[NET_MAC_LEN];
+
+typedef struct arp_pending //arp buffer的值，等待arp响应的数据包及其到期定时器
+{
+    buf_t buf;          //缓存的数据包，须为第一个成员，测试程序按buf_t打印arp buffer
+    net_timer_t timer;  //ARP_MIN_INTERVAL秒后到期，丢弃数据包，之后可以再次发送arp请求
+    net_stack_t *stack; //所属的协议栈
+    arp_ip_t ip;        //等待解析的ip地址
+} arp_pending_t;
+
+static void arp_pending_clone(void *dst, const void *src, size_t len);
+
+MAP_DEFINE(arp_map, arp_ip_t, arp_mac_t)
+MAP_DEFINE_CTOR(arp_buf_map, arp_ip_t, arp_pending_t, arp_pending_clone)
+
 /**
- * @brief arp地址转换表，<ip,mac>的容器
+ * @brief arp buffer表项的定时器到期，释放缓存的数据包并删除表项
  * 
+ * @param timer 到期的定时器
+ * @param arg 表项的值
  */
-map_t arp_table;
+static void arp_pending_expire(net_timer_t *timer, void *arg)
+{
+    arp_pending_t *pending = arg;
+    arp_ip_t ip;
+    memcpy(ip, pending->ip, NET_IP_LEN); // 删除表项后pending不再有效
+    buf_release(&pending->buf);
+    arp_buf_map_delete(&pending->stack->arp_buf, (const arp_ip_t *)ip);
+}
 
 /**
- * @brief arp buffer，<ip,buf_t>的容器
+ * @brief arp buffer的值构造函数，与发送方共享数据包（buf_clone），并在时间轮上挂到期定时器
+ *        表项在map中的地址不变，定时器可以直接嵌在值里
  * 
+ * @param dst 表项中的值
+ * @param src 要存入的值
+ * @param len 占位用，与memcpy保持形式一致，无意义
  */
-map_t arp_buf;
+static void arp_pending_clone(void *dst, const void *src, size_t len)
+{
+    arp_pending_t *pending = dst;
+    const arp_pending_t *from = src;
+    (void)len;
+    net_timer_cancel(&pending->timer); // 覆盖已有表项时先摘下旧的定时器，新表项为清零的
+    buf_clone(&pending->buf, &from->buf, sizeof(buf_t));
+    pending->stack = from->stack;
+    memcpy(pending->ip, from->ip, NET_IP_LEN);
+    net_timer_setup(&pending->timer, arp_pending_expire, pending);
+    net_timer_add(&pending->timer, ARP_MIN_INTERVAL * 1000);
+}
 
 /**
  * @brief 打印一条arp表项
@@ -43,60 +83,80 @@ void arp_entry_print(void *ip, void *mac, time_t *timestamp)
 /**
  * @brief 打印整个arp表
  * 
+ * @param stack 协议栈
  */
-void arp_print()
+void arp_print(net_stack_t *stack)
 {
     printf("===ARP TABLE BEGIN===\n");
-    map_foreach(&arp_table, arp_entry_print);
+    map_foreach(&stack->arp_table, arp_entry_print);
     printf("===ARP TABLE  END ===\n");
 }
 
+/**
+ * @brief 在协议栈的发送缓冲区里准备一个arp包，填写固定字段与网卡地址
+ * 
+ * @param stack 协议栈
+ * @param net_if 发送arp包的网卡
+ * @return arp_pkt_t* 准备好的arp包
+ */
+static arp_pkt_t *arp_pkt_prepare(net_stack_t *stack, net_if_t *net_if)
+{
+    buf_init(&stack->txbuf, sizeof(arp_pkt_t));
+    buf_reserve(&stack->txbuf, ARP_HEADROOM);
+    arp_pkt_t *arp_pkt = (arp_pkt_t*)stack->txbuf.data;
+    memcpy(arp_pkt, &arp_init_pkt, sizeof(arp_pkt_t));
+    memcpy(arp_pkt->sender_mac, net_if->mac, NET_MAC_LEN);
+    memcpy(arp_pkt->sender_ip, net_if->ip, NET_IP_LEN);
+    return arp_pkt;
+}
+
 /**
  * @brief 发送一个arp请求
  * 
+ * @param stack 协议栈
+ * @param net_if 发送请求的网卡
  * @param target_ip 想要知道的目标的ip地址
  */
-void arp_req(uint8_t *target_ip)
+void arp_req(net_stack_t *stack, net_if_t *net_if, uint8_t *target_ip)
 {
     // TO-DO
-    buf_init(&txbuf, sizeof(arp_pkt_t));
-    arp_pkt_t *arp_pkt = (arp_pkt_t*)txbuf.data;
     // 填写arp报头
-    memcpy(arp_pkt, &arp_init_pkt, sizeof(arp_pkt_t));
+    arp_pkt_t *arp_pkt = arp_pkt_prepare(stack, net_if);
     memcpy(&(arp_pkt->target_ip), target_ip, NET_IP_LEN);
     arp_pkt->opcode16 = swap16(ARP_REQUEST);
 
     // 将 ARP 报文发送出去
-    ethernet_out(&txbuf, ether_broadcast_mac, NET_PROTOCOL_ARP);
+    ethernet_out(stack, net_if, &stack->txbuf, ether_broadcast_mac, NET_PROTOCOL_ARP);
 }
 
 /**
  * @brief 发送一个arp响应
  * 
+ * @param stack 协议栈
+ * @param net_if 发送响应的网卡
  * @param target_ip 目标ip地址
  * @param target_mac 目标mac地址
  */
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac)
+void arp_resp(net_stack_t *stack, net_if_t *net_if, uint8_t *target_ip, uint8_t *target_mac)
 {
     // TO-DO
-    buf_init(&txbuf, sizeof(arp_pkt_t));
-    arp_pkt_t *arp_pkt = (arp_pkt_t*)txbuf.data;
     // 填写arp报头
-    memcpy(arp_pkt, &arp_init_pkt, sizeof(arp_pkt_t));
+    arp_pkt_t *arp_pkt = arp_pkt_prepare(stack, net_if);
     memcpy(arp_pkt->target_ip, target_ip, NET_IP_LEN);
     memcpy(arp_pkt->target_mac, target_mac, NET_MAC_LEN);
     arp_pkt->opcode16 = swap16(ARP_REPLY);
 
-    ethernet_out(&txbuf, target_mac, NET_PROTOCOL_ARP);
+    ethernet_out(stack, net_if, &stack->txbuf, target_mac, NET_PROTOCOL_ARP);
 }
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param stack 协议栈
  * @param buf 要处理的数据包
  * @param src_mac 源mac地址
  */
-void arp_in(buf_t *buf, uint8_t *src_mac)
+void arp_in(net_stack_t *stack, buf_t *buf, uint8_t *src_mac)
 {
     // TO-DO
     // 判断数据包是否完整
@@ -115,54 +175,76 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
         return;
     }
     // 更新 ARP 表项
-    map_set(&arp_table, arp_pkt->sender_ip, arp_pkt->sender_mac);
+    net_if_t *net_if = &stack->ifs[buf->if_id];
+    const arp_ip_t *sender_ip = (const arp_ip_t *)arp_pkt->sender_ip;
+    arp_map_set(&stack->arp_table, sender_ip, (const arp_mac_t *)arp_pkt->sender_mac);
 
-    buf_t *buf_in_map = NULL;
-    if ((buf_in_map = (buf_t *)map_get(&arp_buf, arp_pkt->sender_ip)) != NULL) 
+    arp_pending_t *pending = NULL;
+    if ((pending = arp_buf_map_get(&stack->arp_buf, sender_ip)) != NULL) 
     {
-        ethernet_out(buf_in_map, arp_pkt->sender_mac, NET_PROTOCOL_IP);
-        map_delete(&arp_buf, arp_pkt->sender_ip);
-    } else if (opcode == ARP_REQUEST && memcmp(net_if_ip, arp_pkt->target_ip, NET_IP_LEN) == 0)
+        net_timer_cancel(&pending->timer);
+        ethernet_out(stack, net_if, &pending->buf, arp_pkt->sender_mac, NET_PROTOCOL_IP);
+        buf_release(&pending->buf);
+        arp_buf_map_delete(&stack->arp_buf, sender_ip);
+    } else if (opcode == ARP_REQUEST && memcmp(net_if->ip, arp_pkt->target_ip, NET_IP_LEN) == 0)
     {
-        arp_resp(arp_pkt->sender_ip, arp_pkt->sender_mac);
+        arp_resp(stack, net_if, arp_pkt->sender_ip, arp_pkt->sender_mac);
     }
 }
 
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param stack 协议栈
+ * @param net_if 出口网卡
  * @param buf 要处理的数据包
- * @param ip 目标ip地址
+ * @param ip 下一跳ip地址
  */
-void arp_out(buf_t *buf, uint8_t *ip)
+void arp_out(net_stack_t *stack, net_if_t *net_if, buf_t *buf, uint8_t *ip)
 {
     // TO-DO
     // 根据 ip 查找 ARP
-    uint8_t *target_mac = (uint8_t *)map_get(&arp_table, ip);
+    const arp_ip_t *key = (const arp_ip_t *)ip;
+    uint8_t *target_mac = (uint8_t *)arp_map_get(&stack->arp_table, key);
     if (target_mac != NULL)
     {
-        ethernet_out(buf, target_mac, NET_PROTOCOL_IP);
+        ethernet_out(stack, net_if, buf, target_mac, NET_PROTOCOL_IP);
         return;
     }
 
-    // arp_buf 有包时，表示正在等待回应，不能再发送arp请求
-    if (map_get(&arp_buf, ip) != NULL)
+    // arp_buf 有包时，表示正在等待回应，不能再发送arp请求，表项由定时器到期删除
+    if (arp_buf_map_get(&stack->arp_buf, key) != NULL)
     {
         return;
     }
     // 缓存来自 ip 层的数据并发送 arp 请求
-    map_set(&arp_buf, ip, buf);
-    arp_req(ip);
+    arp_pending_t pending = {.buf = *buf, .stack = stack}; // 浅拷贝，由构造函数共享缓冲区
+    memcpy(pending.ip, ip, NET_IP_LEN);
+    arp_buf_map_set(&stack->arp_buf, key, &pending);
+    arp_req(stack, net_if, ip);
+}
+
+/**
+ * @brief 初始化协议栈的arp表和arp buffer
+ *        arp buffer存入时与发送方共享缓冲区（buf_clone），不拷贝数据
+ *        arp buffer的表项不用map的超时清理，由本线程时间轮上的定时器按毫秒到期删除
+ * 
+ * @param stack 协议栈
+ */
+void arp_stack_init(net_stack_t *stack)
+{
+    arp_map_init(&stack->arp_table, 0, ARP_TIMEOUT_SEC);
+    arp_buf_map_init(&stack->arp_buf, 0, 0);
 }
 
 /**
  * @brief 初始化arp协议
  * 
+ * @param stack 协议栈，在它的每个网卡上广播一次针对本机ip的arp请求
  */
-void arp_init()
+void arp_init(net_stack_t *stack)
 {
-    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
-    map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
-    arp_req(net_if_ip);
+    for (int i = 0; i < stack->if_num; i++)
+        arp_req(stack, &stack->ifs[i], stack->ifs[i].ip);
 }
\ No newline at end of file
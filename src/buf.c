@@ -1,4 +1,6 @@
 #include "buf.h"
+#include "mempool.h"
+#include "utils.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -6,8 +8,233 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat="
 #pragma GCC diagnostic ignored "-Wformat-extra-args"
+
+/**
+ * @brief 空闲的buf描述符链表，空闲时借用data字段串联
+ * 
+ */
+static _Thread_local buf_t *buf_desc_free;
+
+/**
+ * @brief 空闲的分段描述符链表
+ * 
+ */
+static _Thread_local buf_seg_t *buf_seg_free_list;
+
+/**
+ * @brief 从堆上分配一个buf描述符并初始化为给定的长度
+ * 
+ * @param len 数据初始长度
+ * @return buf_t* 分配的buffer，失败为NULL
+ */
+buf_t *buf_alloc(size_t len)
+{
+    if (buf_desc_free == NULL)
+    {
+        buf_t *descs = malloc(BUF_DESC_NUM * sizeof(buf_t));
+        if (descs == NULL)
+        {
+            fprintf(stderr, "Error in buf_alloc:%zu\n", len);
+            return NULL;
+        }
+        for (size_t i = 0; i < BUF_DESC_NUM; i++)
+        {
+            descs[i].data = (uint8_t *)buf_desc_free;
+            buf_desc_free = &descs[i];
+        }
+    }
+    buf_t *buf = buf_desc_free;
+    buf_desc_free = (buf_t *)buf->data;
+    memset(buf, 0, sizeof(buf_t));
+    if (buf_init(buf, len) < 0)
+    {
+        buf_free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/**
+ * @brief 释放buf_alloc分配的buffer，连同其负载缓冲区
+ * 
+ * @param buf 要释放的buffer，为NULL则忽略
+ */
+void buf_free(buf_t *buf)
+{
+    if (buf == NULL)
+        return;
+    buf_release(buf);
+    buf->data = (uint8_t *)buf_desc_free;
+    buf_desc_free = buf;
+}
+
+/**
+ * @brief 内部函数，分配一个分段描述符并引用owner
+ * 
+ * @param data 分段数据起始地址
+ * @param len 分段长度
+ * @param owner 分段数据所在的mempool缓冲区
+ * @return buf_seg_t* 分配的分段，失败为NULL
+ */
+static buf_seg_t *buf_seg_new(uint8_t *data, size_t len, uint8_t *owner)
+{
+    if (buf_seg_free_list == NULL)
+    {
+        buf_seg_t *segs = malloc(BUF_DESC_NUM * sizeof(buf_seg_t));
+        if (segs == NULL)
+        {
+            fprintf(stderr, "Error in buf_seg_new:%zu\n", len);
+            return NULL;
+        }
+        for (size_t i = 0; i < BUF_DESC_NUM; i++)
+        {
+            segs[i].next = buf_seg_free_list;
+            buf_seg_free_list = &segs[i];
+        }
+    }
+    buf_seg_t *seg = buf_seg_free_list;
+    buf_seg_free_list = seg->next;
+    seg->data = data;
+    seg->len = len;
+    seg->owner = owner;
+    seg->next = NULL;
+    if (owner)
+        mempool_ref(owner);
+    return seg;
+}
+
+/**
+ * @brief 内部函数，释放buffer的全部后续分段
+ * 
+ * @param buf 要操作的buffer
+ */
+static void buf_release_segs(buf_t *buf)
+{
+    while (buf->segs)
+    {
+        buf_seg_t *seg = buf->segs;
+        buf->segs = seg->next;
+        mempool_free(seg->owner);
+        seg->next = buf_seg_free_list;
+        buf_seg_free_list = seg;
+    }
+    buf->len -= buf->seg_len;
+    buf->seg_len = 0;
+}
+
 /**
- * @brief 初始化buffer为给定的长度，用于装载数据包
+ * @brief 将buffer的负载缓冲区（含后续分段）归还mempool，buffer变为未分配状态
+ * 
+ * @param buf 要操作的buffer
+ */
+void buf_release(buf_t *buf)
+{
+    buf_release_segs(buf);
+    if (!buf->borrowed)
+        mempool_free(buf->payload);
+    buf->borrowed = 0;
+    buf->payload = NULL;
+    buf->data = NULL;
+    buf->size = 0;
+    buf->len = 0;
+}
+
+/**
+ * @brief 内部函数，把buffer首段的有效数据迁移到能容纳size字节的新缓冲区，保持数据相对位置不变
+ * 
+ * @param buf 要操作的buffer
+ * @param size 需要的缓冲区大小
+ * @return int 成功为0，失败为-1
+ */
+static int buf_grow(buf_t *buf, size_t size)
+{
+    size_t cap;
+    uint8_t *payload = mempool_alloc(size, &cap);
+    if (payload == NULL)
+        return -1;
+    size_t headroom = buf->data - buf->payload;
+    memcpy(payload + headroom, buf->data, buf_head_len(buf));
+    if (!buf->borrowed)
+        mempool_free(buf->payload);
+    buf->borrowed = 0;
+    buf->payload = payload;
+    buf->size = cap;
+    buf->data = payload + headroom;
+    return 0;
+}
+
+/**
+ * @brief 内部函数，在buffer前面挂一个新的首段用于装载len字节的协议头，原首段变为后续分段，不拷贝数据
+ * 
+ * @param buf 要操作的buffer
+ * @param len 新首段的长度
+ * @return int 成功为0，失败为-1
+ */
+static int buf_prepend_head(buf_t *buf, size_t len)
+{
+    if (buf->borrowed && buf_grow(buf, buf->data - buf->payload + buf_head_len(buf) + 1) < 0) // 借用的帧不能挂为分段，先拷贝
+        return -1;
+    size_t cap;
+    uint8_t *payload = mempool_alloc(BUF_DEFAULT_HEADROOM + len, &cap);
+    if (payload == NULL)
+        return -1;
+    size_t head_len = buf_head_len(buf);
+    if (head_len > 0)
+    {
+        buf_seg_t *seg = buf_seg_new(buf->data, head_len, NULL);
+        if (seg == NULL)
+        {
+            mempool_free(payload);
+            return -1;
+        }
+        seg->owner = buf->payload; // 原首段的引用直接转移给分段
+        seg->next = buf->segs;
+        buf->segs = seg;
+        buf->seg_len += head_len;
+    }
+    else
+        mempool_free(buf->payload);
+    buf->payload = payload;
+    buf->size = cap;
+    buf->data = payload + BUF_DEFAULT_HEADROOM;
+    buf->len += len;
+    return 0;
+}
+
+/**
+ * @brief 判断buffer首段的缓冲区是否被多个持有者共享
+ *        借用的帧在本次处理期间由该buffer独占，可以就地修改
+ * 
+ * @param buf 要判断的buffer
+ * @return int 共享为1，独占、借用或未分配为0
+ */
+int buf_shared(const buf_t *buf)
+{
+    return buf->payload != NULL && !buf->borrowed && mempool_refcnt(buf->payload) > 1;
+}
+
+/**
+ * @brief 确保buffer独占首段的缓冲区，共享时把有效数据拷贝到新的缓冲区（写时复制）
+ *        直接写buf->data之前须调用，buf_add_padding会自动调用；后续分段始终只读
+ * 
+ * @param buf 要操作的buffer
+ * @return int 成功为0，失败为-1
+ */
+int buf_unshare(buf_t *buf)
+{
+    if (!buf_shared(buf))
+        return 0;
+    if (buf_grow(buf, buf->size) < 0)
+    {
+        fprintf(stderr, "Error in buf_unshare:%zu\n", buf->len);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 初始化buffer为给定的长度，用于装载数据包，头部预留BUF_DEFAULT_HEADROOM
+ *        buffer须为已初始化或清零的，缓冲区不足或被共享时从mempool重新分配
  * 
  * @param buf 要初始化的buffer
  * @param len 数据初始长度
@@ -15,19 +242,73 @@
  */
 int buf_init(buf_t *buf, size_t len)
 {
-    if (len >= BUF_MAX_LEN / 2)
+    if (len + BUF_DEFAULT_HEADROOM >= BUF_MAX_LEN)
     {
         fprintf(stderr, "Error in buf_init:%zu\n", len);
         return -1;
     }
 
+    buf_release_segs(buf);
+    buf->len = len;
+    buf->if_id = 0;
+    return buf_reserve(buf, BUF_DEFAULT_HEADROOM);
+}
+
+/**
+ * @brief 让buffer借用驱动接收缓冲区中的一帧，不拷贝数据，协议头在帧内就地剥离与恢复
+ *        帧只在驱动下次接收前有效，要保留数据包的层（arp buffer、分段引用）会自动拷贝
+ *        buffer须为已初始化或清零的，其原有缓冲区会被释放
+ * 
+ * @param buf 要借用的buffer
+ * @param frame 帧的起始地址
+ * @param len 帧长度
+ * @return int 成功为0，失败为-1
+ */
+int buf_borrow(buf_t *buf, uint8_t *frame, size_t len)
+{
+    if (len + BUF_DEFAULT_HEADROOM >= BUF_MAX_LEN) // 保证之后需要时能拷贝到mempool
+    {
+        fprintf(stderr, "Error in buf_borrow:%zu\n", len);
+        return -1;
+    }
+    buf_release(buf);
+    buf->payload = buf->data = frame;
+    buf->size = buf->len = len;
+    buf->borrowed = 1;
+    buf->if_id = 0;
+    return 0;
+}
+
+/**
+ * @brief 设置buffer头部预留的空间，数据起始地址移到缓冲区的headroom处，长度不变
+ *        须在buf_init之后、写入数据之前调用，不保留原有数据和后续分段
+ *        发送路径应预留该路径所有协议头的总长（如UDP_HEADROOM），使协议头添加时无需挂新的首段
+ * 
+ * @param buf 要操作的buffer
+ * @param headroom 头部预留的长度
+ * @return int 成功为0，失败为-1
+ */
+int buf_reserve(buf_t *buf, size_t headroom)
+{
+    buf_release_segs(buf);
+    size_t len = buf->len;
+    if (buf->payload == NULL || buf->borrowed || headroom + len >= buf->size || buf_shared(buf))
+    {
+        buf_release(buf);
+        if ((buf->payload = mempool_alloc(headroom + len + 1, &buf->size)) == NULL)
+        {
+            fprintf(stderr, "Error in buf_reserve:%zu+%zu\n", headroom, len);
+            return -1;
+        }
+    }
     buf->len = len;
-    buf->data = buf->payload + BUF_MAX_LEN / 2 - len;
+    buf->data = buf->payload + headroom;
     return 0;
 }
 
 /**
  * @brief 为buffer在头部增加一段长度，用于添加协议头
+ *        首段头部空间不足或被共享时，在前面挂一个新的首段，不拷贝原有数据
  * 
  * @param buf 要修改的buffer
  * @param len 增加的长度
@@ -35,10 +316,14 @@ int buf_init(buf_t *buf, size_t len)
  */
 int buf_add_header(buf_t *buf, size_t len)
 {
-    if (buf->data - len < buf->payload)
+    if (buf->data - len < buf->payload || buf_shared(buf))
     {
-        fprintf(stderr, "Error in buf_add_header:%zu+%zu\n", buf->len, len);
-        return -1;
+        if (buf_prepend_head(buf, len) < 0)
+        {
+            fprintf(stderr, "Error in buf_add_header:%zu+%zu\n", buf->len, len);
+            return -1;
+        }
+        return 0;
     }
     buf->len += len;
     buf->data -= len;
@@ -54,7 +339,7 @@ int buf_add_header(buf_t *buf, size_t len)
  */
 int buf_remove_header(buf_t *buf, size_t len)
 {
-    if (buf->len < len)
+    if (buf->len < len || (len > buf_head_len(buf) && buf_linearize(buf) < 0))
     {
         fprintf(stderr, "Error in buf_remove_header:%zu-%zu\n", buf->len, len);
         return -1;
@@ -73,7 +358,10 @@ int buf_remove_header(buf_t *buf, size_t len)
  */
 int buf_add_padding(buf_t *buf, size_t len)
 {
-    if (buf->data + buf->len + len >= buf->payload + BUF_MAX_LEN)
+    if (buf_linearize(buf) < 0 ||
+        (buf->data + buf->len + len >= buf->payload + buf->size
+            ? buf_grow(buf, buf->data - buf->payload + buf->len + len + 1) < 0
+            : buf_unshare(buf) < 0))
     {
         fprintf(stderr, "Error in buf_add_padding:%zu+%zu\n", buf->len, len);
         return -1;
@@ -92,7 +380,7 @@ int buf_add_padding(buf_t *buf, size_t len)
  */
 int buf_remove_padding(buf_t *buf, size_t len)
 {
-    if (buf->len < len)
+    if (buf->len < len || buf_linearize(buf) < 0)
     {
         fprintf(stderr, "Error in buf_remove_padding:%zu-%zu\n", buf->len, len);
         return -1;
@@ -102,22 +390,197 @@ int buf_remove_padding(buf_t *buf, size_t len)
 }
 
 /**
- * @brief buf拷贝构造函数
+ * @brief buf拷贝，只拷贝有效数据，分段的源buffer会被拷贝为连续的
+ *        dst须为已初始化或清零的，其原有缓冲区独占且足够大时直接复用
+ *        失败时dst被释放为空buffer（payload为NULL，len为0），不会保留旧数据
+ * 
+ * @param dst 目的buffer
+ * @param src 源buffer
+ * @return int 成功为0，失败为-1
+ */
+int buf_copy(buf_t *dst, const buf_t *src)
+{
+    assert(src->data >= src->payload);
+    assert(buf_head_len(src) <= src->size);
+    assert(src->data + buf_head_len(src) <= src->payload + src->size);
+    size_t headroom = src->data - src->payload;
+    size_t size = src->segs ? headroom + src->len + 1 : src->size;
+    buf_release_segs(dst);
+    if (dst->payload == NULL || dst->borrowed || dst->size < size || buf_shared(dst))
+    {
+        buf_release(dst);
+        if ((dst->payload = mempool_alloc(size, &dst->size)) == NULL)
+        {
+            fprintf(stderr, "Error in buf_copy: out of memory, size:%zu\n", size);
+            dst->size = 0;
+            return -1;
+        }
+    }
+    dst->data = dst->payload + headroom;
+    dst->len = buf_gather(src, dst->data);
+    return 0;
+}
+
+/**
+ * @brief buf共享构造函数，与源buffer共享缓冲区并增加引用计数，不拷贝数据
+ *        dst须为已初始化或清零的，其原有缓冲区会被释放；之后任一持有者写入时才会拷贝
+ *        源buffer借用驱动的帧时无法共享，退化为buf_copy，拷贝失败时dst的payload为NULL
  * 
  * @param pdst 目的buffer
  * @param psrc 源buffer
  * @param len 占位用，与memcpy保持形式一致，无意义
  */
-void buf_copy(void *pdst, const void *psrc, size_t len)
+void buf_clone(void *pdst, const void *psrc, size_t len)
 {
     buf_t *dst = pdst;
     const buf_t *src = psrc;
-    assert(src->data >= src->payload);
-    assert(src->len <= BUF_MAX_LEN);
-    assert(src->data + src->len < src->payload + BUF_MAX_LEN);
-    dst->len = src->len;
-    dst->data = dst->payload + (src->data - src->payload);
-    memcpy(dst->payload, src->payload, BUF_MAX_LEN);
+    (void)len;
+    if (src->borrowed)
+    {
+        if (buf_copy(dst, src) == 0)
+            dst->if_id = src->if_id;
+        return;
+    }
+    buf_seg_t *segs = NULL, **tail = &segs;
+    for (buf_seg_t *seg = src->segs; seg; seg = seg->next)
+    {
+        *tail = buf_seg_new(seg->data, seg->len, seg->owner);
+        if (*tail == NULL)
+            break;
+        tail = &(*tail)->next;
+    }
+    if (src->payload)
+        mempool_ref(src->payload);
+    buf_release(dst);
+    *dst = *src;
+    dst->segs = segs;
+}
+
+/**
+ * @brief 在buffer尾部追加一个分段，引用src中[offset, offset + len)的数据，不拷贝
+ *        src首段借用驱动的帧时，引用的这部分先拷贝到mempool
+ * 
+ * @param buf 要追加的buffer
+ * @param src 被引用的buffer，可以是分段的
+ * @param offset 引用数据在src中的偏移
+ * @param len 引用数据的长度
+ * @return int 成功为0，失败为-1
+ */
+int buf_append_ref(buf_t *buf, const buf_t *src, size_t offset, size_t len)
+{
+    if (offset + len > src->len)
+    {
+        fprintf(stderr, "Error in buf_append_ref:%zu+%zu>%zu\n", offset, len, src->len);
+        return -1;
+    }
+    buf_seg_t **tail = &buf->segs;
+    while (*tail)
+        tail = &(*tail)->next;
+
+    uint8_t *data = src->data, *owner = src->borrowed ? NULL : src->payload;
+    size_t piece = buf_head_len(src);
+    const buf_seg_t *seg = src->segs;
+    while (len > 0)
+    {
+        if (offset < piece)
+        {
+            size_t n = piece - offset < len ? piece - offset : len;
+            if (owner == NULL) // 借用的帧，分段只能引用mempool缓冲区
+            {
+                size_t cap;
+                if ((owner = mempool_alloc(n, &cap)) == NULL)
+                    return -1;
+                memcpy(owner, data + offset, n);
+                *tail = buf_seg_new(owner, n, owner);
+                mempool_free(owner); // 引用已转移给分段
+            }
+            else
+                *tail = buf_seg_new(data + offset, n, owner);
+            if (*tail == NULL)
+                return -1;
+            tail = &(*tail)->next;
+            buf->len += n;
+            buf->seg_len += n;
+            len -= n;
+            offset = 0;
+        }
+        else
+            offset -= piece;
+        if (len == 0 || seg == NULL)
+            break;
+        data = seg->data, owner = seg->owner, piece = seg->len;
+        seg = seg->next;
+    }
+    return 0;
+}
+
+/**
+ * @brief 把分段的buffer合并为连续的，保持首段头部空间不变
+ * 
+ * @param buf 要操作的buffer
+ * @return int 成功为0，失败为-1
+ */
+int buf_linearize(buf_t *buf)
+{
+    if (buf->segs == NULL)
+        return 0;
+    size_t cap, len = buf->len;
+    size_t headroom = buf->data - buf->payload;
+    uint8_t *payload = mempool_alloc(headroom + len + 1, &cap);
+    if (payload == NULL)
+    {
+        fprintf(stderr, "Error in buf_linearize:%zu\n", len);
+        return -1;
+    }
+    buf_gather(buf, payload + headroom);
+    buf_release(buf);
+    buf->payload = payload;
+    buf->size = cap;
+    buf->data = payload + headroom;
+    buf->len = len;
+    return 0;
+}
+
+/**
+ * @brief 把buffer（含后续分段）的数据依次拷贝到连续的内存中
+ * 
+ * @param buf 要拷贝的buffer
+ * @param dst 目的地址，须至少有buf->len字节
+ * @return size_t 拷贝的字节数
+ */
+size_t buf_gather(const buf_t *buf, uint8_t *dst)
+{
+    size_t head_len = buf_head_len(buf);
+    memcpy(dst, buf->data, head_len);
+    dst += head_len;
+    for (const buf_seg_t *seg = buf->segs; seg; seg = seg->next)
+    {
+        memcpy(dst, seg->data, seg->len);
+        dst += seg->len;
+    }
+    return buf->len;
+}
+
+/**
+ * @brief 计算buffer（含后续分段）前len字节的16位校验和
+ * 
+ * @param buf 要计算的buffer
+ * @param len 要计算的长度
+ * @param sum 附加数据（如伪头部）的部分和，由checksum16_partial得到，没有则为0
+ * @return uint16_t 校验和
+ */
+uint16_t buf_checksum16(const buf_t *buf, size_t len, uint32_t sum)
+{
+    size_t n = buf_head_len(buf) < len ? buf_head_len(buf) : len;
+    size_t offset = n;
+    sum = checksum16_partial(sum, buf->data, n, 0);
+    for (const buf_seg_t *seg = buf->segs; seg && offset < len; seg = seg->next)
+    {
+        n = seg->len < len - offset ? seg->len : len - offset;
+        sum = checksum16_partial(sum, seg->data, n, offset);
+        offset += n;
+    }
+    return checksum16_fold(sum);
 }
 
 #pragma GCC diagnostic pop
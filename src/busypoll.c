@@ -0,0 +1,121 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+#include "busypoll.h"
+#include "net.h"
+#include "timer.h"
+#include "clock.h"
+
+net_busypoll_stats_t net_busypoll_stats;
+
+static net_timer_t busypoll_report_timer; // 定期打印统计的定时器
+
+/**
+ * @brief 把当前线程绑定到一个CPU核上
+ *
+ * @param cpu CPU核编号，为负数时不绑定
+ * @return int 成功为0，失败为-1
+ */
+int net_busypoll_pin(int cpu)
+{
+    if (cpu < 0)
+        return 0;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    {
+        fprintf(stderr, "Error in net_busypoll_pin: cpu %d.\n", cpu);
+        return -1;
+    }
+    return 0;
+#else
+    fprintf(stderr, "Error in net_busypoll_pin: not supported.\n");
+    return -1;
+#endif
+}
+
+/**
+ * @brief 打印忙轮询统计：空转与处理数据包的时间之比，以及退回阻塞的次数
+ *
+ */
+void net_busypoll_report()
+{
+    net_busypoll_stats_t *stats = &net_busypoll_stats;
+    uint64_t total_ns = stats->spin_ns + stats->work_ns;
+    printf("busypoll: spin %.1f%% (%llu polls), work %llu polls, %llu packets, spin/work %.2f, %llu blocks\n",
+           total_ns ? 100.0 * stats->spin_ns / total_ns : 0.0,
+           (unsigned long long)stats->spin_polls, (unsigned long long)stats->work_polls,
+           (unsigned long long)stats->packets,
+           stats->work_ns ? (double)stats->spin_ns / stats->work_ns : 0.0,
+           (unsigned long long)stats->blocks);
+}
+
+/**
+ * @brief 定期打印统计的定时器回调
+ *
+ * @param timer 统计定时器
+ * @param arg 未使用
+ */
+static void net_busypoll_report_handler(net_timer_t *timer, void *arg)
+{
+    net_busypoll_report();
+    net_timer_add(timer, NET_BUSYPOLL_REPORT_SEC * 1000);
+}
+
+/**
+ * @brief 忙轮询主循环，不再返回
+ *        绑定到NET_BUSYPOLL_CPU后不停地轮询协议栈；连续空转超过NET_BUSYPOLL_SPIN_US后退回阻塞等待，
+ *        有数据包或定时器到期后重新开始空转
+ *
+ * @param stack 轮询的协议栈
+ * @param app 每次轮询之后调用的应用层处理程序，可以为NULL
+ */
+void net_run_busypoll(net_stack_t *stack, net_app_poll_t app)
+{
+    net_busypoll_pin(NET_BUSYPOLL_CPU);
+    if (NET_BUSYPOLL_REPORT_SEC > 0)
+    {
+        net_timer_setup(&busypoll_report_timer, net_busypoll_report_handler, NULL);
+        net_timer_add(&busypoll_report_timer, NET_BUSYPOLL_REPORT_SEC * 1000);
+    }
+
+    net_busypoll_stats_t *stats = &net_busypoll_stats;
+    uint64_t last = net_clock_ns(); // 上一次轮询开始的时刻，两次轮询开始之差计入上一次轮询
+    uint64_t idle_since = last;     // 开始连续空转的时刻
+    int worked = 0;                 // 上一次轮询是否收到了数据包
+    while (1)
+    {
+        int n = net_poll(stack);
+        if (app)
+            app();
+
+        uint64_t now = net_clock_ns(); // net_poll已刷新缓存的时钟，不再额外读取
+        if (worked)
+            stats->work_ns += now - last;
+        else
+            stats->spin_ns += now - last;
+        last = now;
+
+        worked = n > 0;
+        if (worked)
+        {
+            stats->work_polls++;
+            stats->packets += n;
+            idle_since = now;
+        }
+        else
+        {
+            stats->spin_polls++;
+            if (now - idle_since >= NET_BUSYPOLL_SPIN_US * 1000ull)
+            {
+                stats->blocks++;
+                net_wait();
+                net_clock_update(); // 阻塞的时间不计入空转
+                last = idle_since = net_clock_ns();
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#include "clock.h"
+
+#define CLOCK_OBSERVE_MAX_AHEAD 1000000000ll // 数据包时间戳最多把缓存时钟推前1秒，防止日历时间跳变带偏单调时钟
+
+_Thread_local uint64_t net_clock_now;
+int64_t net_clock_wall_offset;
+
+static _Thread_local uint64_t clock_read; // 最近一次真正读取的单调时钟，纳秒
+static int clock_observe = 1;            // 是否用数据包时间戳推进时钟
+static _Thread_local int clock_virtual;  // 为1时缓存的时钟是虚拟时钟，只由net_clock_advance推进
+
+/**
+ * @brief 读取一个时钟
+ *
+ * @param id 时钟类型
+ * @return uint64_t 纳秒
+ */
+static uint64_t net_clock_get(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief 初始化时钟，记录日历时间与单调时钟之差，之后日历时间由单调时钟推算
+ *
+ */
+void net_clock_init()
+{
+    net_clock_now = clock_read = net_clock_get(CLOCK_MONOTONIC);
+    net_clock_wall_offset = (int64_t)net_clock_get(CLOCK_REALTIME) - (int64_t)net_clock_now;
+}
+
+/**
+ * @brief 刷新缓存的时钟，每次协议栈轮询调用一次
+ *
+ */
+void net_clock_update()
+{
+    if (clock_virtual)
+        return;
+    clock_read = net_clock_get(CLOCK_MONOTONIC);
+    if (clock_read > net_clock_now) // 数据包时间戳可能已把缓存推到了前面，保持单调
+        net_clock_now = clock_read;
+}
+
+/**
+ * @brief 用数据包的接收时间戳推进缓存的时钟，免去一次读取
+ *
+ * @param wall_ns 接收时间戳（日历时间），纳秒
+ */
+void net_clock_observe(uint64_t wall_ns)
+{
+    if (!clock_observe || clock_virtual)
+        return;
+    int64_t now = (int64_t)wall_ns - net_clock_wall_offset;
+    if (now > (int64_t)net_clock_now && now <= (int64_t)clock_read + CLOCK_OBSERVE_MAX_AHEAD)
+        net_clock_now = now;
+}
+
+/**
+ * @brief 设置是否用数据包时间戳推进时钟。接收与协议处理不在同一线程时须关闭，缓存的时钟只由协议线程写
+ *
+ * @param enable 为1时开启，为0时关闭
+ */
+void net_clock_set_observe(int enable)
+{
+    clock_observe = enable;
+}
+
+/**
+ * @brief 设置本线程是否使用虚拟时钟。开启时从当前缓存的时刻起冻结，之后只由net_clock_advance推进，
+ *        用于在一个线程内按事件驱动模拟协议栈；关闭后恢复读取单调时钟，缓存的时钟保持单调
+ *
+ * @param enable 为1时开启，为0时关闭
+ */
+void net_clock_set_virtual(int enable)
+{
+    if (net_clock_now == 0)
+        net_clock_init();
+    clock_virtual = enable;
+}
+
+/**
+ * @brief 推进本线程的虚拟时钟
+ *
+ * @param ns 推进的纳秒数
+ */
+void net_clock_advance(uint64_t ns)
+{
+    if (clock_virtual)
+        net_clock_now += ns;
+}
@@ -1,195 +1,326 @@
-#include <pcap.h>
+#include <stdlib.h>
 #include "driver.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
 
-#ifdef _WIN32
-#include <tchar.h>
 /**
- * @brief npcp官方提供的加载npcap的dll库函数
+ * @brief 可选的驱动后端，以NULL结尾
  * 
- * @return BOOL 是否成功
  */
-BOOL LoadNpcapDlls()
-{
-    _TCHAR npcap_dir[512];
-    UINT len;
-    len = GetSystemDirectory(npcap_dir, 480);
-    if (!len)
-    {
-        fprintf(stderr, "Error in GetSystemDirectory: %lx", GetLastError());
-        return FALSE;
-    }
-    _tcscat_s(npcap_dir, 512, _T("\\Npcap"));
-    if (SetDllDirectory(npcap_dir) == 0)
-    {
-        fprintf(stderr, "Error in SetDllDirectory: %lx", GetLastError());
-        return FALSE;
-    }
-    return TRUE;
-}
+static const driver_ops_t *driver_backends[] = {
+    &driver_pcap_ops,
+    &driver_vlink_ops,
+#ifdef __linux__
+    &driver_af_packet_ops,
+    &driver_shm_ops,
 #endif
-
-pcap_t *pcap;
-char pcap_errbuf[PCAP_ERRBUF_SIZE];
+    NULL,
+};
 
 /**
- * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
+ * @brief 之后打开的网卡使用的驱动后端，为NULL时在第一次打开网卡时按环境变量NET_DRIVER或NET_DRIVER_DEFAULT选择
  * 
- * @param ip ip地址
- * @param if_name 出口参数，选取的网卡名
- * @param mask 出口参数，该网卡的掩码
- * @return int 成功为0，失败为-1
  */
-int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
+static const driver_ops_t *driver_selected;
+
+typedef struct driver_txq //一个网卡的发送队列，暂存本轮轮询中要发送的数据包
 {
-    pcap_if_t *alldevs;
-    pcap_if_t *d;
-    pcap_addr_t *a;
-    size_t i;
-    uint8_t match[PCAP_BUF_SIZE] = {0};
-    size_t if_num = 0;
-    uint32_t mask_all = PCAP_NETMASK_UNKNOWN;
-    if (pcap_findalldevs(&alldevs, pcap_errbuf) == -1)
-    {
-        fprintf(stderr, "Error in pcap_findalldevs: %s\n", pcap_errbuf);
-        return -1;
-    }
+    net_if_t *net_if;          // 队列所属的网卡
+    int n;                     // 暂存的数据包数
+    buf_t bufs[NET_TX_BATCH];  // 暂存的数据包，与调用者共享负载，写时复制
+} driver_txq_t;
 
-    for (d = alldevs; d; d = d->next, if_num++)
-        for (a = d->addresses; a; a = a->next)
-            if (a->addr && a->addr->sa_family == AF_INET)
-            {
-                match[if_num] = ip_prefix_match(ip, (uint8_t *)&((struct sockaddr_in *)a->addr)->sin_addr.s_addr);
-                if (match[if_num] < ip_prefix_match((uint8_t *)&mask_all, (uint8_t *)&((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr))
-                    match[if_num] = 0;
-            }
-    if (if_num == 0)
-    {
-        fprintf(stderr, "Error, no interface found.\n");
-        return -1;
-    }
-    uint8_t max_match = 0;
-    size_t max_if = 0;
-    for (i = 0; i < if_num; i++)
-        if (match[i] > max_match)
-            max_if = i, max_match = match[i];
-    if (max_match == 0)
-    {
-        fprintf(stderr, "Error, no interface found.\n");
-        return -1;
-    }
+/**
+ * @brief 各网卡的发送队列，按网卡编号索引，每个线程各有一份，互不加锁
+ * 
+ */
+static _Thread_local driver_txq_t driver_txqs[NET_IF_MAX];
 
-    for (d = alldevs, i = 0; i < max_if; d = d->next, i++)
-        ;
-    if (max_match == 32)
-    {
-        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(net_if_ip));
-        return -1;
-    }
-    for (a = d->addresses; a; a = a->next)
-        if (a->addr && a->addr->sa_family == AF_INET)
-            *(uint32_t *)mask = ((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr;
+/**
+ * @brief 已打开的网卡数，最后一个网卡关闭时释放等待用的资源
+ * 
+ */
+static int driver_open_num;
 
-    strcpy(if_name, d->name);
-    return 0;
-}
+/**
+ * @brief 已打开的没有可等待描述符的网卡数（如vlink），不为0时driver_wait至多等待1毫秒，由调用者轮询这些网卡
+ * 
+ */
+static int driver_nofd_num;
 
+#ifdef __linux__
 /**
- * @brief 打开网卡
+ * @brief 等待网卡可读的epoll实例，监听各网卡驱动的可选择描述符
  * 
- * @return int 成功为0，失败为-1
  */
-int driver_open()
-{
-#ifdef _WIN32
-    /* Load Npcap and its functions. */
-    if (!LoadNpcapDlls())
-    {
-        fprintf(stderr, "Couldn't load Npcap\n");
-        return -1;
-    }
+static int driver_epfd = -1;
+/**
+ * @brief epoll不可用或有描述符加入失败时置1，此后driver_wait退回睡眠
+ * 
+ */
+static int driver_epoll_broken;
+#elif defined(_WIN32)
+/**
+ * @brief 各已打开网卡的接收事件，供WaitForMultipleObjects等待，没有事件的网卡不在其中
+ * 
+ */
+static HANDLE driver_events[NET_IF_MAX];
+static int driver_event_num; // driver_events中的事件个数
 #endif
 
-    char if_name[PCAP_BUF_SIZE];
-    uint32_t mask;
-    if (driver_find(net_if_ip, if_name, (uint8_t *)&mask) < 0)
-    {
-        fprintf(stderr, "Error in driver find.\n");
-        return -1;
-    }
-    printf("Using interface %s, my ip is %s.\n", if_name, iptos(net_if_ip));
+/**
+ * @brief 按名字选择之后打开的网卡使用的驱动后端
+ * 
+ * @param name 后端名
+ * @return int 成功为0，没有该后端为-1
+ */
+int driver_select(const char *name)
+{
+    for (const driver_ops_t **ops = driver_backends; *ops; ops++)
+        if (strcmp((*ops)->name, name) == 0)
+        {
+            driver_selected = *ops;
+            return 0;
+        }
+    fprintf(stderr, "Error in driver_select: no driver backend named %s, available:", name);
+    for (const driver_ops_t **ops = driver_backends; *ops; ops++)
+        fprintf(stderr, " %s", (*ops)->name);
+    fprintf(stderr, "\n");
+    return -1;
+}
 
-    if ((pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL) //混杂模式打开网卡
+/**
+ * @brief 用选定的驱动后端打开网卡，并把其描述符加入等待集合
+ *        后端没有描述符时不加入，其余网卡照常用描述符等待
+ * 
+ * @param net_if 要打开的网卡
+ * @return int 成功为0，失败为-1
+ */
+int driver_open(net_if_t *net_if)
+{
+    if (driver_selected == NULL)
     {
-        fprintf(stderr, "Error in pcap_open_live.\n%s.\n", pcap_errbuf);
-        return -1;
+        const char *name = getenv("NET_DRIVER");
+        if (driver_select(name ? name : NET_DRIVER_DEFAULT) < 0)
+            return -1;
     }
-    if (pcap_setnonblock(pcap, 1, pcap_errbuf) < 0) //设置非阻塞模式
-    {
-        fprintf(stderr, "Error in pcap_setnonblock. %s.\n", pcap_errbuf);
+    if (driver_selected->open(net_if) < 0)
         return -1;
-    }
-    char filter_exp[PCAP_BUF_SIZE];
-    struct bpf_program fp;
-    uint8_t mac_addr[6] = NET_IF_MAC;
-    sprintf(filter_exp, //过滤数据包
-            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
-            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
-            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-    if (pcap_compile(pcap, &fp, filter_exp, 0, mask) < 0)
+    net_if->ops = driver_selected;
+    driver_fd_t fd = net_if->ops->get_fd(net_if);
+    driver_open_num++;
+    if (fd == DRIVER_FD_NONE)
     {
-        fprintf(stderr, "Error in pcap_compile.\n%s.\n", pcap_geterr(pcap));
-        return -1;
+        driver_nofd_num++;
+        return 0;
     }
-    if (pcap_setfilter(pcap, &fp) < 0)
+#ifdef __linux__
+    struct epoll_event ev = {.events = EPOLLIN};
+    if (!driver_epoll_broken && driver_epfd < 0)
+        driver_epfd = epoll_create1(0);
+    if (!driver_epoll_broken && (driver_epfd < 0 || epoll_ctl(driver_epfd, EPOLL_CTL_ADD, fd, &ev) < 0))
     {
-        fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
-        return -1;
+        fprintf(stderr, "Error in driver_open: epoll unavailable, falling back to sleep.\n");
+        if (driver_epfd >= 0)
+            close(driver_epfd);
+        driver_epfd = -1;
+        driver_epoll_broken = 1;
     }
+#elif defined(_WIN32)
+    driver_events[driver_event_num++] = fd;
+#endif
     return 0;
 }
+
 /**
  * @brief 试图从网卡接收数据包
+ *        定义NET_RX_ZERO_COPY时buf可能借用驱动的接收缓冲区，只在该网卡下次接收前有效
  * 
- * @param buf 收到的数据包
+ * @param net_if 网卡
+ * @param buf 收到的数据包，if_id置为该网卡的编号
  * @return int 数据包的长度，未收到为0，错误为-1
  */
-int driver_recv(buf_t *buf)
+int driver_recv(net_if_t *net_if, buf_t *buf)
 {
-    struct pcap_pkthdr *pkt_hdr;
-    const uint8_t *pkt_data;
-    int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
-    if (ret == 0)
-        return 0;
-    else if (ret == 1)
-    {
-        memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
-        return pkt_hdr->len;
-    }
-    fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
-    return -1;
+    return net_if->ops->recv(net_if, buf);
 }
+
+/**
+ * @brief 从网卡批量接收已到达的数据包
+ *        定义NET_RX_ZERO_COPY时后端可以借用接收缓冲区中的帧，只在该网卡下次接收前有效，否则拷贝到bufs中
+ * 
+ * @param net_if 网卡
+ * @param bufs 接收缓冲区，前若干个依次填入收到的数据包
+ * @param max 最多接收的数据包个数
+ * @return int 收到的数据包个数，错误为-1
+ */
+int driver_recv_burst(net_if_t *net_if, buf_t **bufs, int max)
+{
+    return net_if->ops->recv_burst(net_if, bufs, max);
+}
+
 /**
  * @brief 使用网卡发送一个数据包
  * 
- * @param buf 要发送的数据包
+ * @param net_if 网卡
+ * @param buf 要发送的数据包，可以是分段的
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(net_if_t *net_if, buf_t *buf)
+{
+    return net_if->ops->send_burst(net_if, &buf, 1) == 1 ? 0 : -1;
+}
+
+/**
+ * @brief 使用网卡批量发送数据包
+ * 
+ * @param net_if 网卡
+ * @param bufs 要发送的数据包，可以是分段的
+ * @param n 数据包个数
+ * @return int 发出的数据包个数，错误为-1
+ */
+int driver_send_burst(net_if_t *net_if, buf_t **bufs, int n)
+{
+    return net_if->ops->send_burst(net_if, bufs, n);
+}
+
+/**
+ * @brief 把发送队列中的数据包整批交给驱动发送，并释放暂存的引用
+ * 
+ * @param txq 发送队列
+ */
+static void driver_txq_flush(driver_txq_t *txq)
+{
+    buf_t *bufs[NET_TX_BATCH];
+    for (int i = 0; i < txq->n; i++)
+        bufs[i] = &txq->bufs[i];
+    driver_send_burst(txq->net_if, bufs, txq->n); // 发送失败由后端计入统计
+    for (int i = 0; i < txq->n; i++)
+        buf_release(&txq->bufs[i]);
+    txq->n = 0;
+}
+
+/**
+ * @brief 把数据包放入网卡的发送队列，队列满时整批发送，否则留到driver_flush
+ *        只增加负载的引用而不拷贝，调用者之后可以继续修改或重用buf
+ * 
+ * @param net_if 网卡
+ * @param buf 要发送的数据包，可以是分段的
  * @return int 成功为0，失败为-1
  */
-int driver_send(buf_t *buf)
+int driver_send_defer(net_if_t *net_if, buf_t *buf)
 {
-    if (pcap_sendpacket(pcap, buf->data, buf->len) == -1)
+    driver_txq_t *txq = &driver_txqs[net_if->id];
+    if (txq->n > 0 && txq->net_if != net_if)
+        driver_txq_flush(txq);
+    txq->net_if = net_if;
+    buf_clone(&txq->bufs[txq->n], buf, sizeof(buf_t));
+    if (txq->bufs[txq->n].payload == NULL)
     {
-        fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
+        fprintf(stderr, "Error in driver_send_defer.\n");
         return -1;
     }
+    if (++txq->n == NET_TX_BATCH)
+        driver_txq_flush(txq);
+    return 0;
+}
+
+/**
+ * @brief 发送本线程各网卡发送队列中暂存的数据包，每次轮询结束及等待之前调用
+ * 
+ */
+void driver_flush()
+{
+    for (int i = 0; i < NET_IF_MAX; i++)
+        if (driver_txqs[i].n > 0)
+            driver_txq_flush(&driver_txqs[i]);
+}
 
+/**
+ * @brief 等待任一已打开的网卡收到数据包，最多等待timeout_ms毫秒
+ *        有网卡没有可等待的描述符时至多等待1毫秒，由调用者继续轮询这些网卡；一个描述符也没有时睡眠1毫秒
+ * 
+ * @param timeout_ms 最长等待时间，毫秒，为-1表示一直等待
+ * @return int 网卡可读为1，超时为0，错误为-1
+ */
+int driver_wait(int timeout_ms)
+{
+    if (driver_nofd_num > 0 && (timeout_ms < 0 || timeout_ms > 1))
+        timeout_ms = 1;
+#ifdef __linux__
+    if (driver_epfd >= 0)
+    {
+        struct epoll_event ev;
+        int ret = epoll_wait(driver_epfd, &ev, 1, timeout_ms);
+        if (ret < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "Error in driver_wait: %s.\n", strerror(errno));
+            return -1;
+        }
+        return ret > 0;
+    }
+#elif defined(_WIN32)
+    if (driver_event_num > 0)
+    {
+        DWORD ret = WaitForMultipleObjects(driver_event_num, driver_events, FALSE, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms);
+        return ret < WAIT_OBJECT_0 + driver_event_num;
+    }
+#endif
+    struct timespec sleep_time = {0, 1000000};
+    if (timeout_ms == 0)
+        return 0;
+    nanosleep(&sleep_time, NULL);
     return 0;
 }
+
 /**
  * @brief 关闭网卡
  * 
+ * @param net_if 要关闭的网卡
+ */
+void driver_close(net_if_t *net_if)
+{
+    if (net_if->ops == NULL)
+        return;
+    if (driver_txqs[net_if->id].n > 0 && driver_txqs[net_if->id].net_if == net_if)
+        driver_txq_flush(&driver_txqs[net_if->id]);
+    driver_fd_t fd = net_if->ops->get_fd(net_if);
+    if (fd == DRIVER_FD_NONE)
+        driver_nofd_num--;
+#ifdef __linux__
+    if (driver_epfd >= 0 && fd >= 0)
+        epoll_ctl(driver_epfd, EPOLL_CTL_DEL, fd, NULL);
+    if (driver_open_num == 1 && driver_epfd >= 0)
+    {
+        close(driver_epfd);
+        driver_epfd = -1;
+    }
+#elif defined(_WIN32)
+    for (int i = 0; fd != DRIVER_FD_NONE && i < driver_event_num; i++)
+        if (driver_events[i] == fd)
+        {
+            driver_events[i] = driver_events[--driver_event_num];
+            break;
+        }
+#endif
+    driver_open_num--;
+    net_if->ops->close(net_if);
+    net_if->ops = NULL;
+    net_if->driver = NULL;
+}
+
+/**
+ * @brief 读取网卡的收发统计，后端不支持时全为0
+ * 
+ * @param net_if 网卡
+ * @param stats 出口参数，统计
  */
-void driver_close()
+void driver_stats(net_if_t *net_if, driver_stats_t *stats)
 {
-    pcap_close(pcap);
+    memset(stats, 0, sizeof(driver_stats_t));
+    if (net_if->ops && net_if->ops->stats)
+        net_if->ops->stats(net_if, stats);
 }
@@ -0,0 +1,421 @@
+#ifdef __linux__
+#include <pcap.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include "driver.h"
+#include "clock.h"
+
+#define AF_PACKET_TX_FRAME_SIZE 2048                                                  // 发送环每帧大小，容纳一个以太网帧
+#define AF_PACKET_TX_DATA_OFFSET (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll))       // 发送帧中数据相对帧头的偏移
+
+typedef struct driver_af_packet //AF_PACKET后端的私有状态
+{
+    int rx_fd;                     // 接收套接字，TPACKET_V3接收环
+    int tx_fd;                     // 发送套接字，TPACKET_V2发送环，不接收
+    uint8_t *rx_ring;              // 接收环的映射
+    size_t rx_ring_len;            // 接收环的长度
+    uint8_t *tx_ring;              // 发送环的映射
+    size_t tx_ring_len;            // 发送环的长度
+    unsigned int rx_block;         // 当前读取的块
+    unsigned int rx_release;       // 下一个要归还内核的块，[rx_release, rx_block)已读完
+    uint32_t rx_left;              // 当前块中未读取的数据包数，为0表示尚未取得当前块
+    struct tpacket3_hdr *rx_next;  // 当前块中下一个数据包
+    unsigned int tx_frame;         // 下一个要填写的发送帧
+    pthread_mutex_t tx_lock;       // 多个协议线程可能同时发送
+    driver_stats_t stats;          // 收发统计
+} driver_af_packet_t;
+
+/**
+ * @brief 获取接收环的一块
+ *
+ * @param state 后端状态
+ * @param i 块号
+ * @return struct tpacket_block_desc* 块描述符
+ */
+static inline struct tpacket_block_desc *af_packet_block(driver_af_packet_t *state, unsigned int i)
+{
+    return (struct tpacket_block_desc *)(state->rx_ring + (size_t)i * NET_AF_PACKET_BLOCK_SIZE);
+}
+
+/**
+ * @brief 获取发送环的一帧
+ *
+ * @param state 后端状态
+ * @param i 帧号
+ * @return struct tpacket2_hdr* 帧头
+ */
+static inline struct tpacket2_hdr *af_packet_tx_frame(driver_af_packet_t *state, unsigned int i)
+{
+    return (struct tpacket2_hdr *)(state->tx_ring + (size_t)i * AF_PACKET_TX_FRAME_SIZE);
+}
+
+/**
+ * @brief 给套接字安装与pcap后端相同的过滤表达式，用libpcap编译为经典BPF
+ *
+ * @param fd 套接字
+ * @param net_if 网卡
+ * @param mask 网卡的掩码
+ * @return int 成功为0，失败为-1
+ */
+static int af_packet_attach_filter(int fd, net_if_t *net_if, uint32_t mask)
+{
+    char filter_exp[PCAP_BUF_SIZE];
+    struct bpf_program fp;
+    pcap_t *dead = pcap_open_dead(DLT_EN10MB, 65535);
+    if (dead == NULL)
+        return -1;
+    driver_filter_exp(net_if, filter_exp);
+    if (pcap_compile(dead, &fp, filter_exp, 1, mask) < 0)
+    {
+        fprintf(stderr, "Error in pcap_compile.\n%s.\n", pcap_geterr(dead));
+        pcap_close(dead);
+        return -1;
+    }
+    struct // 与struct sock_fprog布局相同，bpf_insn与sock_filter布局相同
+    {
+        unsigned short len;
+        struct bpf_insn *filter;
+    } prog = {fp.bf_len, fp.bf_insns};
+    int ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+    pcap_freecode(&fp);
+    pcap_close(dead);
+    return ret;
+}
+
+/**
+ * @brief 打开一个绑定到网卡的AF_PACKET套接字并映射环
+ *        先以协议0创建（不接收任何帧），装好过滤器和环之后再绑定，避免收到未过滤的帧
+ *
+ * @param ifindex 网卡序号
+ * @param version TPACKET版本
+ * @param ring PACKET_RX_RING或PACKET_TX_RING
+ * @param req 环的参数
+ * @param req_len 参数长度
+ * @param net_if 网卡，接收套接字据此安装过滤器
+ * @param mask 网卡的掩码
+ * @param map 出口参数，环的映射
+ * @param map_len 环的长度
+ * @return int 套接字，失败为-1
+ */
+static int af_packet_socket(int ifindex, int version, int ring, void *req, socklen_t req_len,
+                            net_if_t *net_if, uint32_t mask, uint8_t **map, size_t map_len)
+{
+    int fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0)
+        return -1;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        goto fail;
+    if (ring == PACKET_RX_RING)
+    {
+        struct packet_mreq mreq = {.mr_ifindex = ifindex, .mr_type = PACKET_MR_PROMISC}; //混杂模式，与pcap后端一致
+        if (af_packet_attach_filter(fd, net_if, mask) < 0 ||
+            setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+            goto fail;
+    }
+    else
+    {
+        struct bpf_insn drop_all = {0x06, 0, 0, 0}; // ret #0，发送套接字不接收
+        struct
+        {
+            unsigned short len;
+            struct bpf_insn *filter;
+        } prog = {1, &drop_all};
+        int one = 1; // 绕过qdisc直接交给网卡驱动，失败时仍走qdisc
+        if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+            goto fail;
+        setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+    }
+    if (setsockopt(fd, SOL_PACKET, ring, req, req_len) < 0)
+        goto fail;
+    *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
+    if (*map == MAP_FAILED)
+        *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); // 锁定内存的限额不足时退回普通映射
+    if (*map == MAP_FAILED)
+        goto fail;
+    struct sockaddr_ll addr = {.sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL), .sll_ifindex = ifindex};
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        munmap(*map, map_len);
+        goto fail;
+    }
+    return fd;
+fail:
+    fprintf(stderr, "Error in af_packet_socket: %s.\n", strerror(errno));
+    close(fd);
+    return -1;
+}
+
+/**
+ * @brief 打开网卡，按网卡ip选取网卡，建立TPACKET_V3接收环与TPACKET_V2发送环
+ *
+ * @param net_if 要打开的网卡
+ * @return int 成功为0，失败为-1
+ */
+static int driver_af_packet_open(net_if_t *net_if)
+{
+    char if_name[PCAP_BUF_SIZE];
+    uint32_t mask;
+    if (driver_find(net_if->ip, if_name, (uint8_t *)&mask) < 0)
+    {
+        fprintf(stderr, "Error in driver find.\n");
+        return -1;
+    }
+    int ifindex = if_nametoindex(if_name);
+    if (ifindex == 0)
+    {
+        fprintf(stderr, "Error in if_nametoindex: %s.\n", if_name);
+        return -1;
+    }
+    printf("Using interface %s (AF_PACKET), my ip is %s.\n", if_name, iptos(net_if->ip));
+
+    driver_af_packet_t *state = calloc(1, sizeof(driver_af_packet_t));
+    if (state == NULL)
+    {
+        fprintf(stderr, "Error in driver_af_packet_open: out of memory\n");
+        return -1;
+    }
+    struct tpacket_req3 rx_req = {
+        .tp_block_size = NET_AF_PACKET_BLOCK_SIZE,
+        .tp_block_nr = NET_AF_PACKET_BLOCK_NUM,
+        .tp_frame_size = AF_PACKET_TX_FRAME_SIZE, // V3的帧长可变，只用于校验
+        .tp_frame_nr = (NET_AF_PACKET_BLOCK_SIZE / AF_PACKET_TX_FRAME_SIZE) * NET_AF_PACKET_BLOCK_NUM,
+        .tp_retire_blk_tov = NET_AF_PACKET_BLOCK_TIMEOUT_MS,
+    };
+    struct tpacket_req tx_req = {
+        .tp_block_size = NET_AF_PACKET_BLOCK_SIZE,
+        .tp_block_nr = NET_AF_PACKET_TX_FRAME_NUM / (NET_AF_PACKET_BLOCK_SIZE / AF_PACKET_TX_FRAME_SIZE),
+        .tp_frame_size = AF_PACKET_TX_FRAME_SIZE,
+    };
+    if (tx_req.tp_block_nr == 0)
+        tx_req.tp_block_nr = 1;
+    tx_req.tp_frame_nr = tx_req.tp_block_nr * (NET_AF_PACKET_BLOCK_SIZE / AF_PACKET_TX_FRAME_SIZE);
+    state->rx_ring_len = (size_t)rx_req.tp_block_size * rx_req.tp_block_nr;
+    state->tx_ring_len = (size_t)tx_req.tp_block_size * tx_req.tp_block_nr;
+
+    state->rx_fd = af_packet_socket(ifindex, TPACKET_V3, PACKET_RX_RING, &rx_req, sizeof(rx_req),
+                                    net_if, mask, &state->rx_ring, state->rx_ring_len);
+    if (state->rx_fd < 0)
+    {
+        free(state);
+        return -1;
+    }
+    state->tx_fd = af_packet_socket(ifindex, TPACKET_V2, PACKET_TX_RING, &tx_req, sizeof(tx_req),
+                                    net_if, mask, &state->tx_ring, state->tx_ring_len);
+    if (state->tx_fd < 0)
+    {
+        munmap(state->rx_ring, state->rx_ring_len);
+        close(state->rx_fd);
+        free(state);
+        return -1;
+    }
+    pthread_mutex_init(&state->tx_lock, NULL);
+    net_if->driver = state;
+    return 0;
+}
+
+/**
+ * @brief 把已读完的块归还内核，在每次接收开始时调用，因此借用的帧在下次接收之前一直有效
+ *
+ * @param state 后端状态
+ */
+static void af_packet_release(driver_af_packet_t *state)
+{
+    while (state->rx_release != state->rx_block)
+    {
+        atomic_thread_fence(memory_order_release); // 读完块中的数据之后才交还
+        af_packet_block(state, state->rx_release)->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        state->rx_release = (state->rx_release + 1) % NET_AF_PACKET_BLOCK_NUM;
+    }
+}
+
+/**
+ * @brief 从接收环中取下一个数据包，当前块读完时前进到下一块，块在下次接收开始时才归还
+ *
+ * @param state 后端状态
+ * @return struct tpacket3_hdr* 数据包头，暂无数据包时为NULL
+ */
+static struct tpacket3_hdr *af_packet_next(driver_af_packet_t *state)
+{
+    while (state->rx_left == 0)
+    {
+        struct tpacket_block_desc *block = af_packet_block(state, state->rx_block);
+        if (!(block->hdr.bh1.block_status & TP_STATUS_USER) || (state->rx_block + 1) % NET_AF_PACKET_BLOCK_NUM == state->rx_release)
+            return NULL; // 内核尚未交出，或者一圈的块都在借用中
+        atomic_thread_fence(memory_order_acquire);
+        state->rx_left = block->hdr.bh1.num_pkts;
+        state->rx_next = (struct tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+        if (state->rx_left == 0) // 超时退役的空块
+            state->rx_block = (state->rx_block + 1) % NET_AF_PACKET_BLOCK_NUM;
+    }
+    struct tpacket3_hdr *hdr = state->rx_next;
+    state->rx_next = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+    if (--state->rx_left == 0)
+        state->rx_block = (state->rx_block + 1) % NET_AF_PACKET_BLOCK_NUM;
+    return hdr;
+}
+
+/**
+ * @brief 批量接收数据包
+ *        定义NET_RX_ZERO_COPY时buf借用接收环中的帧，只在该网卡下次接收前有效，否则拷贝
+ *
+ * @param net_if 网卡
+ * @param bufs 接收缓冲区，前若干个依次填入收到的数据包
+ * @param max 最多接收的数据包个数
+ * @return int 收到的数据包个数
+ */
+static int driver_af_packet_recv_burst(net_if_t *net_if, buf_t **bufs, int max)
+{
+    driver_af_packet_t *state = net_if->driver;
+    struct tpacket3_hdr *hdr = NULL, *last = NULL;
+    int n = 0;
+    af_packet_release(state);
+    while (n < max && (hdr = af_packet_next(state)) != NULL)
+    {
+        uint8_t *frame = (uint8_t *)hdr + hdr->tp_mac;
+        buf_t *buf = bufs[n];
+#ifdef NET_RX_ZERO_COPY
+        if (buf_borrow(buf, frame, hdr->tp_snaplen) < 0)
+            continue;
+#else
+        if (buf_init(buf, hdr->tp_snaplen) < 0)
+            continue;
+        memcpy(buf->data, frame, hdr->tp_snaplen);
+#endif
+        buf->if_id = net_if->id;
+        state->stats.rx_bytes += hdr->tp_snaplen;
+        last = hdr;
+        n++;
+    }
+#ifndef NET_RX_ZERO_COPY
+    af_packet_release(state); // 已经拷贝，读完的块立即归还
+#endif
+    if (last)
+        net_clock_observe((uint64_t)last->tp_sec * 1000000000ull + last->tp_nsec);
+    state->stats.rx_packets += n;
+    return n;
+}
+
+/**
+ * @brief 接收一个数据包
+ *
+ * @param net_if 网卡
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+static int driver_af_packet_recv(net_if_t *net_if, buf_t *buf)
+{
+    return driver_af_packet_recv_burst(net_if, &buf, 1) > 0 ? (int)buf->len : 0;
+}
+
+/**
+ * @brief 批量发送：依次拷贝到发送环的空闲帧中，最后用一次sendto通知内核发出整批
+ *
+ * @param net_if 网卡
+ * @param bufs 要发送的数据包，可以是分段的
+ * @param n 数据包个数
+ * @return int 放入发送环的数据包个数
+ */
+static int driver_af_packet_send_burst(net_if_t *net_if, buf_t **bufs, int n)
+{
+    driver_af_packet_t *state = net_if->driver;
+    unsigned int frame_num = state->tx_ring_len / AF_PACKET_TX_FRAME_SIZE;
+    int queued = 0;
+    pthread_mutex_lock(&state->tx_lock);
+    for (int i = 0; i < n; i++)
+    {
+        buf_t *buf = bufs[i];
+        struct tpacket2_hdr *hdr = af_packet_tx_frame(state, state->tx_frame);
+        if (buf->len > AF_PACKET_TX_FRAME_SIZE - AF_PACKET_TX_DATA_OFFSET)
+        {
+            fprintf(stderr, "Error in driver_send: %zu bytes too long.\n", buf->len);
+            state->stats.tx_errors++;
+            continue;
+        }
+        if (hdr->tp_status != TP_STATUS_AVAILABLE) // 发送环满，先把已填写的发出去再看一次
+        {
+            sendto(state->tx_fd, NULL, 0, 0, NULL, 0);
+            if (hdr->tp_status != TP_STATUS_AVAILABLE)
+            {
+                state->stats.tx_errors += n - i;
+                break;
+            }
+        }
+        atomic_thread_fence(memory_order_acquire);
+        buf_gather(buf, (uint8_t *)hdr + AF_PACKET_TX_DATA_OFFSET);
+        hdr->tp_len = buf->len;
+        atomic_thread_fence(memory_order_release);
+        hdr->tp_status = TP_STATUS_SEND_REQUEST;
+        state->tx_frame = (state->tx_frame + 1) % frame_num;
+        state->stats.tx_packets++;
+        state->stats.tx_bytes += buf->len;
+        queued++;
+    }
+    if (queued > 0 && sendto(state->tx_fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 && errno != EAGAIN && errno != ENOBUFS)
+        fprintf(stderr, "Error in driver_send: %s.\n", strerror(errno));
+    pthread_mutex_unlock(&state->tx_lock);
+    return queued;
+}
+
+/**
+ * @brief 关闭网卡
+ *
+ * @param net_if 要关闭的网卡
+ */
+static void driver_af_packet_close(net_if_t *net_if)
+{
+    driver_af_packet_t *state = net_if->driver;
+    munmap(state->rx_ring, state->rx_ring_len);
+    munmap(state->tx_ring, state->tx_ring_len);
+    close(state->rx_fd);
+    close(state->tx_fd);
+    pthread_mutex_destroy(&state->tx_lock);
+    free(state);
+}
+
+/**
+ * @brief 获取网卡可等待的描述符，接收环有块交给用户态时可读
+ *
+ * @param net_if 网卡
+ * @return driver_fd_t 接收套接字
+ */
+static driver_fd_t driver_af_packet_get_fd(net_if_t *net_if)
+{
+    driver_af_packet_t *state = net_if->driver;
+    return state->rx_fd;
+}
+
+/**
+ * @brief 读取收发统计，丢包数来自PACKET_STATISTICS，内核每次读取后清零，因此在此累加
+ *
+ * @param net_if 网卡
+ * @param stats 出口参数，统计
+ */
+static void driver_af_packet_stats(net_if_t *net_if, driver_stats_t *stats)
+{
+    driver_af_packet_t *state = net_if->driver;
+    struct tpacket_stats_v3 ps;
+    socklen_t len = sizeof(ps);
+    if (getsockopt(state->rx_fd, SOL_PACKET, PACKET_STATISTICS, &ps, &len) == 0)
+        state->stats.rx_dropped += ps.tp_drops;
+    *stats = state->stats;
+}
+
+const driver_ops_t driver_af_packet_ops = {
+    .name = "af_packet",
+    .open = driver_af_packet_open,
+    .recv = driver_af_packet_recv,
+    .recv_burst = driver_af_packet_recv_burst,
+    .send_burst = driver_af_packet_send_burst,
+    .close = driver_af_packet_close,
+    .get_fd = driver_af_packet_get_fd,
+    .stats = driver_af_packet_stats,
+};
+#endif
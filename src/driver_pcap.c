@@ -0,0 +1,488 @@
+#include <pcap.h>
+#include <pthread.h>
+#include "driver.h"
+#include "clock.h"
+
+#ifdef _WIN32
+#include <tchar.h>
+/**
+ * @brief npcp官方提供的加载npcap的dll库函数
+ * 
+ * @return BOOL 是否成功
+ */
+BOOL LoadNpcapDlls()
+{
+    _TCHAR npcap_dir[512];
+    UINT len;
+    len = GetSystemDirectory(npcap_dir, 480);
+    if (!len)
+    {
+        fprintf(stderr, "Error in GetSystemDirectory: %lx", GetLastError());
+        return FALSE;
+    }
+    _tcscat_s(npcap_dir, 512, _T("\\Npcap"));
+    if (SetDllDirectory(npcap_dir) == 0)
+    {
+        fprintf(stderr, "Error in SetDllDirectory: %lx", GetLastError());
+        return FALSE;
+    }
+    return TRUE;
+}
+#endif
+
+static char pcap_errbuf[PCAP_ERRBUF_SIZE];
+
+typedef struct driver_pcap //pcap后端的私有状态
+{
+    pcap_t *pcap;            // 打开的pcap句柄
+    pthread_mutex_t tx_lock; // 分片模式下多个协议线程可能同时发送，libpcap句柄不是线程安全的
+    driver_stats_t stats;    // 收发统计，rx_dropped在读取时向pcap查询
+} driver_pcap_t;
+
+/**
+ * @brief 发送分段数据包时用于合并的缓冲区
+ * 
+ */
+static _Thread_local uint8_t driver_sendbuf[BUF_MAX_LEN / 2];
+
+#ifdef _WIN32
+/**
+ * @brief 批量发送用的npcap发送队列，整批数据包一次交给内核
+ * 
+ */
+static _Thread_local pcap_send_queue *driver_sendqueue;
+#endif
+
+/**
+ * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
+ * 
+ * @param ip ip地址
+ * @param if_name 出口参数，选取的网卡名
+ * @param mask 出口参数，该网卡的掩码
+ * @return int 成功为0，失败为-1
+ */
+int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
+{
+    pcap_if_t *alldevs;
+    pcap_if_t *d;
+    pcap_addr_t *a;
+    size_t i;
+    uint8_t match[PCAP_BUF_SIZE] = {0};
+    size_t if_num = 0;
+    uint32_t mask_all = PCAP_NETMASK_UNKNOWN;
+    if (pcap_findalldevs(&alldevs, pcap_errbuf) == -1)
+    {
+        fprintf(stderr, "Error in pcap_findalldevs: %s\n", pcap_errbuf);
+        return -1;
+    }
+
+    for (d = alldevs; d; d = d->next, if_num++)
+        for (a = d->addresses; a; a = a->next)
+            if (a->addr && a->addr->sa_family == AF_INET)
+            {
+                match[if_num] = ip_prefix_match(ip, (uint8_t *)&((struct sockaddr_in *)a->addr)->sin_addr.s_addr);
+                if (match[if_num] < ip_prefix_match((uint8_t *)&mask_all, (uint8_t *)&((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr))
+                    match[if_num] = 0;
+            }
+    if (if_num == 0)
+    {
+        fprintf(stderr, "Error, no interface found.\n");
+        return -1;
+    }
+    uint8_t max_match = 0;
+    size_t max_if = 0;
+    for (i = 0; i < if_num; i++)
+        if (match[i] > max_match)
+            max_if = i, max_match = match[i];
+    if (max_match == 0)
+    {
+        fprintf(stderr, "Error, no interface found.\n");
+        return -1;
+    }
+
+    for (d = alldevs, i = 0; i < max_if; d = d->next, i++)
+        ;
+    if (max_match == 32)
+    {
+        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(ip));
+        return -1;
+    }
+    for (a = d->addresses; a; a = a->next)
+        if (a->addr && a->addr->sa_family == AF_INET)
+            *(uint32_t *)mask = ((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr;
+
+    strcpy(if_name, d->name);
+    return 0;
+}
+
+
+/**
+ * @brief 生成网卡的pcap过滤表达式：只收发给本网卡或广播的帧，且不收自己发出的帧
+ * 
+ * @param net_if 网卡
+ * @param filter_exp 出口参数，过滤表达式，至少PCAP_BUF_SIZE字节
+ */
+void driver_filter_exp(net_if_t *net_if, char *filter_exp)
+{
+    uint8_t *mac_addr = net_if->mac;
+    sprintf(filter_exp, //过滤数据包
+            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
+            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
+            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
+}
+
+/**
+ * @brief 打开网卡，按网卡ip选取pcap网卡
+ * 
+ * @param net_if 要打开的网卡
+ * @return int 成功为0，失败为-1
+ */
+static int driver_pcap_open(net_if_t *net_if)
+{
+#ifdef _WIN32
+    /* Load Npcap and its functions. */
+    static int npcap_loaded;
+    if (!npcap_loaded && !(npcap_loaded = LoadNpcapDlls()))
+    {
+        fprintf(stderr, "Couldn't load Npcap\n");
+        return -1;
+    }
+#endif
+
+    char if_name[PCAP_BUF_SIZE];
+    uint32_t mask;
+    if (driver_find(net_if->ip, if_name, (uint8_t *)&mask) < 0)
+    {
+        fprintf(stderr, "Error in driver find.\n");
+        return -1;
+    }
+    printf("Using interface %s, my ip is %s.\n", if_name, iptos(net_if->ip));
+
+    pcap_t *pcap;
+    if ((pcap = pcap_create(if_name, pcap_errbuf)) == NULL)
+    {
+        fprintf(stderr, "Error in pcap_create.\n%s.\n", pcap_errbuf);
+        return -1;
+    }
+    pcap_set_snaplen(pcap, 65536);
+    pcap_set_promisc(pcap, 1); //混杂模式打开网卡
+    pcap_set_timeout(pcap, 10);
+    pcap_set_immediate_mode(pcap, 1); //数据包一到就唤醒等待者，不等内核攒满一块
+    if (pcap_activate(pcap) < 0)
+    {
+        fprintf(stderr, "Error in pcap_activate.\n%s.\n", pcap_geterr(pcap));
+        pcap_close(pcap);
+        return -1;
+    }
+    if (pcap_setnonblock(pcap, 1, pcap_errbuf) < 0) //设置非阻塞模式
+    {
+        fprintf(stderr, "Error in pcap_setnonblock. %s.\n", pcap_errbuf);
+        pcap_close(pcap);
+        return -1;
+    }
+    char filter_exp[PCAP_BUF_SIZE];
+    struct bpf_program fp;
+    driver_filter_exp(net_if, filter_exp);
+    if (pcap_compile(pcap, &fp, filter_exp, 0, mask) < 0)
+    {
+        fprintf(stderr, "Error in pcap_compile.\n%s.\n", pcap_geterr(pcap));
+        pcap_close(pcap);
+        return -1;
+    }
+    if (pcap_setfilter(pcap, &fp) < 0)
+    {
+        fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
+        pcap_close(pcap);
+        return -1;
+    }
+    driver_pcap_t *state = calloc(1, sizeof(driver_pcap_t));
+    if (state == NULL)
+    {
+        fprintf(stderr, "Error in driver_pcap_open: out of memory\n");
+        pcap_close(pcap);
+        return -1;
+    }
+    state->pcap = pcap;
+    pthread_mutex_init(&state->tx_lock, NULL);
+    net_if->driver = state;
+    return 0;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *        定义NET_RX_ZERO_COPY时buf借用pcap的接收缓冲区，只在该网卡下次接收前有效
+ * 
+ * @param net_if 网卡
+ * @param buf 收到的数据包，if_id置为该网卡的编号
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+static int driver_pcap_recv(net_if_t *net_if, buf_t *buf)
+{
+    driver_pcap_t *state = net_if->driver;
+    struct pcap_pkthdr *pkt_hdr;
+    const uint8_t *pkt_data;
+    int ret = pcap_next_ex(state->pcap, &pkt_hdr, &pkt_data);
+    if (ret == 0)
+        return 0;
+    else if (ret == 1)
+    {
+        net_clock_observe((uint64_t)pkt_hdr->ts.tv_sec * 1000000000ull + pkt_hdr->ts.tv_usec * 1000ull);
+#ifdef NET_RX_ZERO_COPY
+        if (buf_borrow(buf, (uint8_t *)pkt_data, pkt_hdr->caplen) < 0) // libpcap的缓冲区可写，协议层就地剥离协议头
+            return -1;
+#else
+        if (buf_init(buf, pkt_hdr->len) < 0)
+            return -1;
+        memcpy(buf->data, pkt_data, pkt_hdr->len);
+#endif
+        buf->if_id = net_if->id;
+        state->stats.rx_packets++;
+        state->stats.rx_bytes += buf->len;
+        return buf->len;
+    }
+    fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(state->pcap));
+    return -1;
+}
+
+/**
+ * @brief 批量接收的上下文，经pcap_dispatch的user参数传给回调
+ * 
+ */
+typedef struct driver_burst
+{
+    net_if_t *net_if; // 网卡
+    buf_t **bufs;     // 接收缓冲区
+    int n;            // 已收到的数据包个数
+} driver_burst_t;
+
+/**
+ * @brief pcap_dispatch的回调，把一个数据包拷贝到下一个接收缓冲区
+ *        回调返回后pcap可能回收该帧，因此只用于拷贝接收
+ * 
+ * @param user 批量接收的上下文
+ * @param pkt_hdr 数据包头
+ * @param pkt_data 数据包
+ */
+static void driver_burst_handler(u_char *user, const struct pcap_pkthdr *pkt_hdr, const u_char *pkt_data)
+{
+    driver_burst_t *burst = (driver_burst_t *)user;
+    buf_t *buf = burst->bufs[burst->n];
+    net_clock_observe((uint64_t)pkt_hdr->ts.tv_sec * 1000000000ull + pkt_hdr->ts.tv_usec * 1000ull);
+    if (buf_init(buf, pkt_hdr->caplen) < 0)
+        return;
+    memcpy(buf->data, pkt_data, pkt_hdr->caplen);
+    buf->if_id = burst->net_if->id;
+    burst->n++;
+}
+
+/**
+ * @brief 从网卡批量接收数据包，一次pcap_dispatch收下已到达的至多max个
+ *        定义NET_RX_ZERO_COPY时只有pcap_next_ex返回的帧能借用到下次接收，因此每次只借用一帧
+ * 
+ * @param net_if 网卡
+ * @param bufs 接收缓冲区，前若干个依次填入收到的数据包
+ * @param max 最多接收的数据包个数
+ * @return int 收到的数据包个数，错误为-1
+ */
+static int driver_pcap_recv_burst(net_if_t *net_if, buf_t **bufs, int max)
+{
+#ifdef NET_RX_ZERO_COPY
+    if (max < 1)
+        return 0;
+    int len = driver_pcap_recv(net_if, bufs[0]);
+    return len > 0 ? 1 : len;
+#endif
+    driver_pcap_t *state = net_if->driver;
+    driver_burst_t burst = {net_if, bufs, 0};
+    int ret = pcap_dispatch(state->pcap, max, driver_burst_handler, (u_char *)&burst);
+    for (int i = 0; i < burst.n; i++)
+        state->stats.rx_bytes += bufs[i]->len;
+    state->stats.rx_packets += burst.n;
+    if (ret < 0)
+    {
+        fprintf(stderr, "Error in driver_recv_burst.\n%s.\n", pcap_geterr(state->pcap));
+        return burst.n ? burst.n : -1;
+    }
+    return burst.n;
+}
+
+#ifdef _WIN32
+/**
+ * @brief 用npcap发送队列批量发送，一次系统调用发出整批
+ * 
+ * @param net_if 网卡
+ * @param bufs 要发送的数据包，可以是分段的
+ * @param n 数据包个数
+ * @return int 发出的数据包个数
+ */
+static int driver_pcap_send_queue(net_if_t *net_if, buf_t **bufs, int n)
+{
+    driver_pcap_t *state = net_if->driver;
+    struct pcap_pkthdr header = {0};
+    int sent = 0, i = 0;
+    while (i < n)
+    {
+        int first = i;
+        driver_sendqueue->len = 0;
+        for (; i < n; i++)
+        {
+            buf_t *buf = bufs[i];
+            uint8_t *data = buf->data;
+            if (buf->segs)
+            {
+                if (buf->len > sizeof(driver_sendbuf))
+                    break;
+                data = driver_sendbuf;
+                buf_gather(buf, data);
+            }
+            header.caplen = header.len = buf->len;
+            if (pcap_sendqueue_queue(driver_sendqueue, &header, data) < 0)
+                break;
+        }
+        if (i == first) // 单个数据包放不进队列
+        {
+            fprintf(stderr, "Error in driver_send: %zu bytes too long.\n", bufs[i]->len);
+            state->stats.tx_errors++;
+            i++;
+            continue;
+        }
+        u_int bytes = pcap_sendqueue_transmit(state->pcap, driver_sendqueue, 0);
+        for (int j = first; j < i; j++)
+        {
+            u_int need = sizeof(struct pcap_pkthdr) + bufs[j]->len;
+            if (bytes < need)
+            {
+                fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(state->pcap));
+                state->stats.tx_errors += i - j;
+                break;
+            }
+            bytes -= need;
+            state->stats.tx_packets++;
+            state->stats.tx_bytes += bufs[j]->len;
+            sent++;
+        }
+    }
+    return sent;
+}
+#endif
+
+/**
+ * @brief 每个数据包一次pcap_sendpacket依次发送
+ * 
+ * @param net_if 网卡
+ * @param bufs 要发送的数据包，可以是分段的
+ * @param n 数据包个数
+ * @return int 发出的数据包个数
+ */
+static int driver_pcap_send_each(net_if_t *net_if, buf_t **bufs, int n)
+{
+    driver_pcap_t *state = net_if->driver;
+    int sent = 0;
+    for (int i = 0; i < n; i++)
+    {
+        buf_t *buf = bufs[i];
+        uint8_t *data = buf->data;
+        if (buf->segs)
+        {
+            if (buf->len > sizeof(driver_sendbuf))
+            {
+                fprintf(stderr, "Error in driver_send: %zu bytes too long.\n", buf->len);
+                state->stats.tx_errors++;
+                continue;
+            }
+            data = driver_sendbuf;
+            buf_gather(buf, data);
+        }
+        if (pcap_sendpacket(state->pcap, data, buf->len) == -1)
+        {
+            fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(state->pcap));
+            state->stats.tx_errors++;
+            continue;
+        }
+        state->stats.tx_packets++;
+        state->stats.tx_bytes += buf->len;
+        sent++;
+    }
+    return sent;
+}
+
+/**
+ * @brief 使用网卡发送一批数据包，npcap用发送队列一次发出，其他平台每个数据包一次系统调用
+ *        持有发送锁，多个协议线程可以同时调用；接收只能由一个线程进行
+ * 
+ * @param net_if 网卡
+ * @param bufs 要发送的数据包，可以是分段的
+ * @param n 数据包个数
+ * @return int 发出的数据包个数
+ */
+static int driver_pcap_send_burst(net_if_t *net_if, buf_t **bufs, int n)
+{
+    driver_pcap_t *state = net_if->driver;
+    int sent;
+    pthread_mutex_lock(&state->tx_lock);
+#ifdef _WIN32
+    if (n > 1 && driver_sendqueue == NULL)
+        driver_sendqueue = pcap_sendqueue_alloc(NET_TX_BATCH * (sizeof(struct pcap_pkthdr) + ETHERNET_MAX_TRANSPORT_UNIT + 18)); // 18为以太网头与填充余量
+    if (n > 1 && driver_sendqueue)
+        sent = driver_pcap_send_queue(net_if, bufs, n);
+    else
+#endif
+        sent = driver_pcap_send_each(net_if, bufs, n);
+    pthread_mutex_unlock(&state->tx_lock);
+    return sent;
+}
+
+/**
+ * @brief 关闭网卡
+ * 
+ * @param net_if 要关闭的网卡
+ */
+static void driver_pcap_close(net_if_t *net_if)
+{
+    driver_pcap_t *state = net_if->driver;
+    pcap_close(state->pcap);
+    pthread_mutex_destroy(&state->tx_lock);
+    free(state);
+}
+
+/**
+ * @brief 获取网卡可等待的描述符，Linux上为pcap的可选择描述符，Windows上为接收事件
+ * 
+ * @param net_if 网卡
+ * @return driver_fd_t 描述符，没有时为DRIVER_FD_NONE
+ */
+static driver_fd_t driver_pcap_get_fd(net_if_t *net_if)
+{
+    driver_pcap_t *state = net_if->driver;
+#ifdef _WIN32
+    return pcap_getevent(state->pcap);
+#else
+    return pcap_get_selectable_fd(state->pcap);
+#endif
+}
+
+/**
+ * @brief 读取收发统计，丢包数来自pcap_stats
+ * 
+ * @param net_if 网卡
+ * @param stats 出口参数，统计
+ */
+static void driver_pcap_stats(net_if_t *net_if, driver_stats_t *stats)
+{
+    driver_pcap_t *state = net_if->driver;
+    struct pcap_stat ps;
+    *stats = state->stats;
+    if (pcap_stats(state->pcap, &ps) == 0)
+        stats->rx_dropped = ps.ps_drop + ps.ps_ifdrop;
+}
+
+const driver_ops_t driver_pcap_ops = {
+    .name = "pcap",
+    .open = driver_pcap_open,
+    .recv = driver_pcap_recv,
+    .recv_burst = driver_pcap_recv_burst,
+    .send_burst = driver_pcap_send_burst,
+    .close = driver_pcap_close,
+    .get_fd = driver_pcap_get_fd,
+    .stats = driver_pcap_stats,
+};
@@ -0,0 +1,440 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include "driver.h"
+
+#define SHM_RING_MASK (NET_SHM_RING_SIZE - 1)
+#define SHM_MAGIC 0x6E65746Du // "netm"，主端初始化完共享内存后写入
+
+typedef struct shm_ring //单生产者单消费者的描述符环，位于共享内存中
+{
+    _Alignas(64) _Atomic uint32_t head;     // 生产者下一个要写的位置
+    _Alignas(64) _Atomic uint32_t consumed; // 消费者已经读到的位置，生产者据此决定是否敲门铃
+    _Alignas(64) _Atomic uint32_t tail;     // 消费者已经归还的位置，[tail, head)的帧槽不可写
+    uint32_t desc[NET_SHM_RING_SIZE];       // 描述符，各帧槽中帧的长度
+    uint8_t frames[NET_SHM_RING_SIZE][NET_SHM_FRAME_SIZE]; // 帧槽
+} shm_ring_t;
+
+typedef struct shm_region //两个进程共享的内存区域
+{
+    _Atomic uint32_t magic; // 为SHM_MAGIC表示已初始化
+    shm_ring_t rings[2];    // rings[0]由主端发往从端，rings[1]由从端发往主端
+} shm_region_t;
+
+typedef struct driver_shm //shm后端的私有状态
+{
+    shm_region_t *region;    // 共享内存
+    shm_ring_t *rx;          // 接收环
+    shm_ring_t *tx;          // 发送环
+    int region_fd;           // 共享内存的memfd，主端交给从端后可关闭，此处保留以便重复交付
+    int rx_efd;              // 接收环的门铃，对端写入
+    int tx_efd;              // 发送环的门铃，本端写入
+    int epfd;                // 主端等待门铃与对端连接的epoll实例，从端为-1
+    int listen_fd;           // 主端等待对端连接的套接字，连接后关闭，为-1
+    int conn_fd;             // 与对端的控制连接
+    uint32_t rx_pending;     // 已借出但尚未归还的接收帧数，在下次接收时归还
+    int rx_armed;            // 为1表示已清空门铃且此后还未收到帧，接收环空时不必再读门铃
+    pthread_mutex_t tx_lock; // 多个协议线程可能同时发送，发送环只能有一个生产者
+    driver_stats_t stats;    // 收发统计
+} driver_shm_t;
+
+/**
+ * @brief 生成网卡对应的控制套接字地址，位于抽象命名空间，不在文件系统中留下文件
+ *        名字取环境变量NET_SHM_NAME或NET_SHM_NAME_DEFAULT，后接网卡编号
+ *
+ * @param net_if 网卡
+ * @param addr 出口参数，套接字地址
+ * @return socklen_t 地址长度
+ */
+static socklen_t shm_addr(net_if_t *net_if, struct sockaddr_un *addr)
+{
+    const char *name = getenv("NET_SHM_NAME");
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    int len = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "%s.%u",
+                       name ? name : NET_SHM_NAME_DEFAULT, net_if->id);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+/**
+ * @brief 主端：创建共享内存、门铃与等待对端连接的套接字
+ *
+ * @param state 后端状态
+ * @param addr 控制套接字地址
+ * @param addr_len 地址长度
+ * @return int 成功为0，地址已被占用为1，失败为-1
+ */
+static int shm_master(driver_shm_t *state, struct sockaddr_un *addr, socklen_t addr_len)
+{
+    state->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+    if (state->listen_fd < 0)
+        return -1;
+    if (bind(state->listen_fd, (struct sockaddr *)addr, addr_len) < 0)
+        return errno == EADDRINUSE ? 1 : -1;
+    if (listen(state->listen_fd, 1) < 0)
+        return -1;
+    state->region_fd = memfd_create("net_shm", MFD_CLOEXEC);
+    if (state->region_fd < 0 || ftruncate(state->region_fd, sizeof(shm_region_t)) < 0)
+        return -1;
+    state->region = mmap(NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, state->region_fd, 0);
+    if (state->region == MAP_FAILED)
+    {
+        state->region = NULL;
+        return -1;
+    }
+    state->tx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    state->rx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    state->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (state->tx_efd < 0 || state->rx_efd < 0 || state->epfd < 0)
+        return -1;
+    struct epoll_event ev = {.events = EPOLLIN};
+    if (epoll_ctl(state->epfd, EPOLL_CTL_ADD, state->rx_efd, &ev) < 0 ||
+        epoll_ctl(state->epfd, EPOLL_CTL_ADD, state->listen_fd, &ev) < 0)
+        return -1;
+    state->tx = &state->region->rings[0];
+    state->rx = &state->region->rings[1];
+    atomic_store(&state->region->magic, SHM_MAGIC); // memfd初始为0，环已是空的
+    return 0;
+}
+
+/**
+ * @brief 从端：连接主端，收取共享内存与两个门铃
+ *
+ * @param state 后端状态
+ * @param addr 控制套接字地址
+ * @param addr_len 地址长度
+ * @return int 成功为0，没有主端为1，失败为-1
+ */
+static int shm_slave(driver_shm_t *state, struct sockaddr_un *addr, socklen_t addr_len)
+{
+    state->conn_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (state->conn_fd < 0)
+        return -1;
+    if (connect(state->conn_fd, (struct sockaddr *)addr, addr_len) < 0)
+    {
+        int ret = errno == ECONNREFUSED || errno == ENOENT ? 1 : -1;
+        close(state->conn_fd);
+        state->conn_fd = -1;
+        return ret;
+    }
+    struct timeval timeout = {NET_SHM_CONNECT_TIMEOUT_MS / 1000, NET_SHM_CONNECT_TIMEOUT_MS % 1000 * 1000};
+    setsockopt(state->conn_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int fds[3];
+    char byte;
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    if (recvmsg(state->conn_fd, &msg, MSG_CMSG_CLOEXEC) <= 0)
+        return -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+        return -1;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    state->region_fd = fds[0];
+    state->rx_efd = fds[1]; // 主端的发送门铃即从端的接收门铃
+    state->tx_efd = fds[2];
+    state->region = mmap(NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, state->region_fd, 0);
+    if (state->region == MAP_FAILED)
+    {
+        state->region = NULL;
+        return -1;
+    }
+    if (atomic_load(&state->region->magic) != SHM_MAGIC)
+        return -1;
+    state->rx = &state->region->rings[0];
+    state->tx = &state->region->rings[1];
+    return 0;
+}
+
+/**
+ * @brief 主端：接受对端连接并把共享内存与门铃交给它，之后不再接受连接
+ *
+ * @param state 后端状态
+ */
+static void shm_accept(driver_shm_t *state)
+{
+    int conn = accept4(state->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn < 0)
+        return;
+    int fds[3] = {state->region_fd, state->tx_efd, state->rx_efd};
+    char byte = 0;
+    char control[CMSG_SPACE(sizeof(fds))] = {0};
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) < 0)
+    {
+        fprintf(stderr, "Error in shm_accept: %s.\n", strerror(errno));
+        close(conn);
+        return;
+    }
+    epoll_ctl(state->epfd, EPOLL_CTL_DEL, state->listen_fd, NULL);
+    close(state->listen_fd);
+    state->listen_fd = -1;
+    state->conn_fd = conn;
+}
+
+/**
+ * @brief 关闭后端持有的资源
+ *
+ * @param state 后端状态
+ */
+static void shm_release(driver_shm_t *state)
+{
+    if (state->region)
+        munmap(state->region, sizeof(shm_region_t));
+    int fds[] = {state->region_fd, state->rx_efd, state->tx_efd, state->epfd, state->listen_fd, state->conn_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    free(state);
+}
+
+/**
+ * @brief 打开网卡，同名的控制套接字上先打开者为主端，后打开者为从端
+ *
+ * @param net_if 要打开的网卡
+ * @return int 成功为0，失败为-1
+ */
+static int driver_shm_open(net_if_t *net_if)
+{
+    driver_shm_t *state = malloc(sizeof(driver_shm_t));
+    if (state == NULL)
+    {
+        fprintf(stderr, "Error in driver_shm_open: out of memory\n");
+        return -1;
+    }
+    memset(state, 0, sizeof(driver_shm_t));
+    state->region_fd = state->rx_efd = state->tx_efd = state->epfd = state->listen_fd = state->conn_fd = -1;
+    struct sockaddr_un addr;
+    socklen_t addr_len = shm_addr(net_if, &addr);
+    int ret = 1;
+    for (int i = 0; i < 3 && ret == 1; i++) // 两端同时打开时，绑定失败的一方改为连接
+    {
+        ret = shm_slave(state, &addr, addr_len);
+        if (ret == 1)
+        {
+            ret = shm_master(state, &addr, addr_len);
+            if (ret == 1)
+            {
+                close(state->listen_fd);
+                state->listen_fd = -1;
+            }
+        }
+    }
+    if (ret != 0)
+    {
+        fprintf(stderr, "Error in driver_shm_open: %s.\n", ret < 0 ? strerror(errno) : "address busy");
+        shm_release(state);
+        return -1;
+    }
+    pthread_mutex_init(&state->tx_lock, NULL);
+    printf("Using shared memory link %s (%s), my ip is %s.\n", addr.sun_path + 1,
+           state->listen_fd >= 0 ? "master" : "slave", iptos(net_if->ip));
+    net_if->driver = state;
+    return 0;
+}
+
+/**
+ * @brief 批量接收数据包
+ *        定义NET_RX_ZERO_COPY时buf借用共享内存中的帧，只在该网卡下次接收前有效，否则拷贝；
+ *        长度超出帧槽的描述符与分配失败的帧丢弃并计入rx_dropped，帧槽照常归还
+ *
+ * @param net_if 网卡
+ * @param bufs 接收缓冲区，前若干个依次填入收到的数据包
+ * @param max 最多接收的数据包个数
+ * @return int 收到的数据包个数
+ */
+static int driver_shm_recv_burst(net_if_t *net_if, buf_t **bufs, int max)
+{
+    driver_shm_t *state = net_if->driver;
+    shm_ring_t *rx = state->rx;
+    if (state->listen_fd >= 0)
+        shm_accept(state);
+    uint32_t consumed = atomic_load_explicit(&rx->consumed, memory_order_relaxed);
+    if (state->rx_pending)
+    {
+        atomic_store_explicit(&rx->tail, consumed, memory_order_release);
+        state->rx_pending = 0;
+    }
+    uint32_t head = atomic_load_explicit(&rx->head, memory_order_acquire);
+    uint32_t n = head - consumed < (uint32_t)max ? head - consumed : (uint32_t)max;
+    int got = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t slot = (consumed + i) & SHM_RING_MASK;
+        uint32_t len = *(volatile uint32_t *)&rx->desc[slot]; // 描述符对端可写，只读一次，检查后使用同一个值
+        buf_t *buf = bufs[got];
+        if (len > NET_SHM_FRAME_SIZE) // 损坏的描述符，不能越过帧槽读取
+        {
+            state->stats.rx_dropped++;
+            continue;
+        }
+#ifdef NET_RX_ZERO_COPY
+        int ret = buf_borrow(buf, rx->frames[slot], len);
+#else
+        int ret = buf_init(buf, len);
+        if (ret == 0)
+            memcpy(buf->data, rx->frames[slot], len);
+#endif
+        if (ret < 0)
+        {
+            state->stats.rx_dropped++;
+            continue;
+        }
+        buf->if_id = net_if->id;
+        state->stats.rx_bytes += len;
+        got++;
+    }
+    consumed += n;
+    atomic_store(&rx->consumed, consumed);
+#ifdef NET_RX_ZERO_COPY
+    state->rx_pending = n;
+#else
+    atomic_store_explicit(&rx->tail, consumed, memory_order_release);
+#endif
+    if (n > 0)
+    {
+        state->rx_armed = 0;
+        state->stats.rx_packets += got;
+    }
+    if (!state->rx_armed && atomic_load(&rx->head) == consumed) // 读空了，清空门铃以便等待
+    {
+        uint64_t count;
+        if (read(state->rx_efd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            fprintf(stderr, "Error in driver_recv: %s.\n", strerror(errno));
+        state->rx_armed = 1;
+        if (atomic_load(&rx->head) != consumed) // 清空之前对端又放入了帧，门铃可能被清掉，补敲一次
+        {
+            count = 1;
+            write(state->rx_efd, &count, sizeof(count));
+            state->rx_armed = 0;
+        }
+    }
+    return got;
+}
+
+/**
+ * @brief 接收一个数据包
+ *
+ * @param net_if 网卡
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+static int driver_shm_recv(net_if_t *net_if, buf_t *buf)
+{
+    return driver_shm_recv_burst(net_if, &buf, 1) > 0 ? (int)buf->len : 0;
+}
+
+/**
+ * @brief 批量发送：依次拷贝到发送环的帧槽，发布后对端若已读空发送环则敲一次门铃
+ *
+ * @param net_if 网卡
+ * @param bufs 要发送的数据包，可以是分段的
+ * @param n 数据包个数
+ * @return int 放入发送环的数据包个数
+ */
+static int driver_shm_send_burst(net_if_t *net_if, buf_t **bufs, int n)
+{
+    driver_shm_t *state = net_if->driver;
+    shm_ring_t *tx = state->tx;
+    int queued = 0;
+    pthread_mutex_lock(&state->tx_lock);
+    uint32_t start = atomic_load_explicit(&tx->head, memory_order_relaxed), head = start;
+    uint32_t tail = atomic_load_explicit(&tx->tail, memory_order_acquire);
+    for (int i = 0; i < n; i++)
+    {
+        buf_t *buf = bufs[i];
+        if (buf->len > NET_SHM_FRAME_SIZE)
+        {
+            fprintf(stderr, "Error in driver_send: %zu bytes too long.\n", buf->len);
+            state->stats.tx_errors++;
+            continue;
+        }
+        if (head - tail == NET_SHM_RING_SIZE) // 对端来不及接收，丢弃其余的数据包
+        {
+            state->stats.tx_errors += n - i;
+            break;
+        }
+        uint32_t slot = head & SHM_RING_MASK;
+        buf_gather(buf, tx->frames[slot]);
+        tx->desc[slot] = buf->len;
+        head++;
+        state->stats.tx_bytes += buf->len;
+        queued++;
+    }
+    if (queued > 0)
+    {
+        atomic_store(&tx->head, head);
+        if (atomic_load(&tx->consumed) == start) // 对端已读空，可能正在等待
+        {
+            uint64_t count = 1;
+            write(state->tx_efd, &count, sizeof(count));
+        }
+    }
+    state->stats.tx_packets += queued;
+    pthread_mutex_unlock(&state->tx_lock);
+    return queued;
+}
+
+/**
+ * @brief 关闭网卡
+ *
+ * @param net_if 要关闭的网卡
+ */
+static void driver_shm_close(net_if_t *net_if)
+{
+    driver_shm_t *state = net_if->driver;
+    pthread_mutex_destroy(&state->tx_lock);
+    shm_release(state);
+}
+
+/**
+ * @brief 获取网卡可等待的描述符：从端为接收门铃，主端为同时等待接收门铃与对端连接的epoll实例
+ *
+ * @param net_if 网卡
+ * @return driver_fd_t 描述符
+ */
+static driver_fd_t driver_shm_get_fd(net_if_t *net_if)
+{
+    driver_shm_t *state = net_if->driver;
+    return state->epfd >= 0 ? state->epfd : state->rx_efd;
+}
+
+/**
+ * @brief 读取收发统计，发送环满时丢弃的数据包计入tx_errors
+ *
+ * @param net_if 网卡
+ * @param stats 出口参数，统计
+ */
+static void driver_shm_stats(net_if_t *net_if, driver_stats_t *stats)
+{
+    driver_shm_t *state = net_if->driver;
+    *stats = state->stats;
+}
+
+const driver_ops_t driver_shm_ops = {
+    .name = "shm",
+    .open = driver_shm_open,
+    .recv = driver_shm_recv,
+    .recv_burst = driver_shm_recv_burst,
+    .send_burst = driver_shm_send_burst,
+    .close = driver_shm_close,
+    .get_fd = driver_shm_get_fd,
+    .stats = driver_shm_stats,
+};
+#endif
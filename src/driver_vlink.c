@@ -0,0 +1,420 @@
+#include <pthread.h>
+#include "driver_vlink.h"
+#include "clock.h"
+
+typedef struct vlink_frame //链路上在途的一帧，按送达时刻排队
+{
+    struct vlink_frame *next; // 下一帧
+    uint64_t time;            // 送达时刻，缓存时钟的纳秒数
+    size_t len;               // 帧长
+    uint8_t data[];           // 帧的内容
+} vlink_frame_t;
+
+typedef struct vlink_end //虚拟链路的一端
+{
+    struct vlink *link;          // 所属的链路
+    struct vlink_end *peer;      // 对端，尚未连接时为NULL
+    net_if_t *net_if;            // 打开这一端的网卡，未打开时为NULL
+    vlink_frame_t *rx_head;      // 发往本端的在途帧，按送达时刻升序
+    vlink_frame_t *rx_tail;      // 队尾
+    uint32_t rx_num;             // 在途帧数
+    vlink_frame_t *rx_borrowed;  // 已借出、在下次接收时释放的帧
+    driver_vlink_conf_t conf;    // 从本端发出的帧的损伤参数
+    uint32_t rand;               // 随机数状态
+    int burst_bad;               // Gilbert-Elliott模型当前是否处于坏状态
+    uint64_t busy_until;         // 限速时发送端忙到的时刻，纳秒
+    driver_stats_t stats;        // 收发统计，损伤与排队溢出丢弃的帧计入接收端的rx_dropped
+} vlink_end_t;
+
+typedef struct vlink //一条连接两个网卡的虚拟链路
+{
+    struct vlink *next;   // 下一条链路
+    vlink_end_t ends[2];  // 两端，先打开者为ends[0]
+    pthread_mutex_t lock; // 两端可能由不同线程收发
+} vlink_t;
+
+/**
+ * @brief 所有的虚拟链路
+ *
+ */
+static vlink_t *vlink_list;
+static pthread_mutex_t vlink_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief xorshift伪随机数，返回[0, 1)内的均匀分布
+ *
+ * @param end 链路端
+ * @return double 随机数
+ */
+static double vlink_rand(vlink_end_t *end)
+{
+    end->rand ^= end->rand << 13;
+    end->rand ^= end->rand >> 17;
+    end->rand ^= end->rand << 5;
+    return end->rand / 4294967296.0;
+}
+
+/**
+ * @brief 按损伤参数决定一帧是否丢失，突发丢包时先转移Gilbert-Elliott模型的状态
+ *
+ * @param end 发送端
+ * @return int 丢失为1
+ */
+static int vlink_lost(vlink_end_t *end)
+{
+    driver_vlink_conf_t *conf = &end->conf;
+    if (conf->burst_enter > 0)
+    {
+        if (vlink_rand(end) < (end->burst_bad ? conf->burst_exit : conf->burst_enter))
+            end->burst_bad = !end->burst_bad;
+        if (end->burst_bad && vlink_rand(end) < conf->burst_loss)
+            return 1;
+    }
+    return conf->loss > 0 && vlink_rand(end) < conf->loss;
+}
+
+/**
+ * @brief 把一帧按送达时刻插入接收端的队列，时刻相同的帧保持发送顺序
+ *
+ * @param end 接收端
+ * @param frame 帧
+ */
+static void vlink_insert(vlink_end_t *end, vlink_frame_t *frame)
+{
+    vlink_frame_t **pos = &end->rx_head;
+    if (end->rx_tail && end->rx_tail->time <= frame->time)
+        pos = &end->rx_tail->next;
+    else
+        while (*pos && (*pos)->time <= frame->time)
+            pos = &(*pos)->next;
+    frame->next = *pos;
+    *pos = frame;
+    if (frame->next == NULL)
+        end->rx_tail = frame;
+    end->rx_num++;
+}
+
+/**
+ * @brief 释放帧链表
+ *
+ * @param frame 链表头
+ */
+static void vlink_free_frames(vlink_frame_t *frame)
+{
+    while (frame)
+    {
+        vlink_frame_t *next = frame->next;
+        free(frame);
+        frame = next;
+    }
+}
+
+/**
+ * @brief 打开网卡：接到一条只打开了一端的链路上，没有时新建一条链路
+ *
+ * @param net_if 要打开的网卡
+ * @return int 成功为0，失败为-1
+ */
+static int driver_vlink_open(net_if_t *net_if)
+{
+    pthread_mutex_lock(&vlink_list_lock);
+    vlink_t *link = vlink_list;
+    while (link && !(link->ends[0].net_if && !link->ends[1].net_if && !link->ends[1].link))
+        link = link->next;
+    vlink_end_t *end;
+    if (link)
+        end = &link->ends[1];
+    else
+    {
+        link = calloc(1, sizeof(vlink_t));
+        if (link == NULL)
+        {
+            pthread_mutex_unlock(&vlink_list_lock);
+            fprintf(stderr, "Error in driver_vlink_open: out of memory\n");
+            return -1;
+        }
+        pthread_mutex_init(&link->lock, NULL);
+        link->next = vlink_list;
+        vlink_list = link;
+        end = &link->ends[0];
+    }
+    pthread_mutex_lock(&link->lock);
+    end->link = link;
+    end->net_if = net_if;
+    end->rand = 2463534242u + (end - link->ends);
+    if (end == &link->ends[1])
+    {
+        link->ends[0].peer = &link->ends[1];
+        link->ends[1].peer = &link->ends[0];
+    }
+    pthread_mutex_unlock(&link->lock);
+    pthread_mutex_unlock(&vlink_list_lock);
+    printf("Using virtual link end %d, my ip is %s.\n", (int)(end - link->ends), iptos(net_if->ip));
+    net_if->driver = end;
+    return 0;
+}
+
+/**
+ * @brief 设置从网卡发出的帧的损伤参数
+ *
+ * @param net_if 使用虚拟链路的网卡
+ * @param conf 损伤参数
+ * @return int 成功为0，网卡不是虚拟链路为-1
+ */
+int driver_vlink_config(net_if_t *net_if, const driver_vlink_conf_t *conf)
+{
+    if (net_if->ops != &driver_vlink_ops)
+    {
+        fprintf(stderr, "Error in driver_vlink_config: not a virtual link\n");
+        return -1;
+    }
+    vlink_end_t *end = net_if->driver;
+    pthread_mutex_lock(&end->link->lock);
+    end->conf = *conf;
+    if (end->conf.limit == 0)
+        end->conf.limit = NET_VLINK_LIMIT;
+    if (conf->seed)
+        end->rand = conf->seed;
+    end->burst_bad = 0;
+    pthread_mutex_unlock(&end->link->lock);
+    return 0;
+}
+
+/**
+ * @brief 获取所有虚拟链路上下一帧送达的时刻距现在的时间，供模拟时推进虚拟时钟
+ *
+ * @return int64_t 纳秒，已有帧可接收时为0，链路上没有在途帧时为-1
+ */
+int64_t driver_vlink_next()
+{
+    int64_t next = -1;
+    uint64_t now = net_clock_ns();
+    pthread_mutex_lock(&vlink_list_lock);
+    for (vlink_t *link = vlink_list; link; link = link->next)
+    {
+        pthread_mutex_lock(&link->lock);
+        for (int i = 0; i < 2; i++)
+            if (link->ends[i].rx_head)
+            {
+                uint64_t time = link->ends[i].rx_head->time;
+                int64_t wait = time > now ? (int64_t)(time - now) : 0;
+                if (next < 0 || wait < next)
+                    next = wait;
+            }
+        pthread_mutex_unlock(&link->lock);
+    }
+    pthread_mutex_unlock(&vlink_list_lock);
+    return next;
+}
+
+/**
+ * @brief 批量接收已送达的帧
+ *        定义NET_RX_ZERO_COPY时buf借用链路上的帧，只在该网卡下次接收前有效，否则拷贝；分配失败的帧丢弃并计入rx_dropped
+ *
+ * @param net_if 网卡
+ * @param bufs 接收缓冲区，前若干个依次填入收到的数据包
+ * @param max 最多接收的数据包个数
+ * @return int 收到的数据包个数
+ */
+static int driver_vlink_recv_burst(net_if_t *net_if, buf_t **bufs, int max)
+{
+    vlink_end_t *end = net_if->driver;
+    vlink_free_frames(end->rx_borrowed);
+    end->rx_borrowed = NULL;
+    uint64_t now = net_clock_ns();
+    vlink_frame_t *frames = NULL, **tail = &frames;
+    int n = 0;
+    pthread_mutex_lock(&end->link->lock);
+    while (n < max && end->rx_head && end->rx_head->time <= now)
+    {
+        *tail = end->rx_head;
+        tail = &end->rx_head->next;
+        end->rx_head = end->rx_head->next;
+        end->rx_num--;
+        n++;
+    }
+    *tail = NULL;
+    if (end->rx_head == NULL)
+        end->rx_tail = NULL;
+    pthread_mutex_unlock(&end->link->lock);
+
+    int got = 0, dropped = 0;
+    for (vlink_frame_t *frame = frames; frame; frame = frame->next)
+    {
+        buf_t *buf = bufs[got];
+#ifdef NET_RX_ZERO_COPY
+        int ret = buf_borrow(buf, frame->data, frame->len);
+#else
+        int ret = buf_init(buf, frame->len);
+        if (ret == 0)
+            memcpy(buf->data, frame->data, frame->len);
+#endif
+        if (ret < 0)
+        {
+            dropped++;
+            continue;
+        }
+        buf->if_id = net_if->id;
+        end->stats.rx_bytes += frame->len;
+        got++;
+    }
+#ifdef NET_RX_ZERO_COPY
+    end->rx_borrowed = frames;
+#else
+    vlink_free_frames(frames);
+#endif
+    end->stats.rx_packets += got;
+    if (dropped > 0) // rx_dropped也由对端发送时在锁内累加
+    {
+        pthread_mutex_lock(&end->link->lock);
+        end->stats.rx_dropped += dropped;
+        pthread_mutex_unlock(&end->link->lock);
+    }
+    return got;
+}
+
+/**
+ * @brief 接收一个已送达的帧
+ *
+ * @param net_if 网卡
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+static int driver_vlink_recv(net_if_t *net_if, buf_t *buf)
+{
+    return driver_vlink_recv_burst(net_if, &buf, 1) > 0 ? (int)buf->len : 0;
+}
+
+/**
+ * @brief 批量发送：逐帧按损伤参数决定丢弃、限速排队、时延与重复，放入对端的在途队列
+ *
+ * @param net_if 网卡
+ * @param bufs 要发送的数据包，可以是分段的
+ * @param n 数据包个数
+ * @return int 发出的数据包个数，链路未连接时为0
+ */
+static int driver_vlink_send_burst(net_if_t *net_if, buf_t **bufs, int n)
+{
+    vlink_end_t *end = net_if->driver;
+    driver_vlink_conf_t *conf = &end->conf;
+    uint64_t now = net_clock_ns();
+    int sent = 0;
+    pthread_mutex_lock(&end->link->lock);
+    vlink_end_t *peer = end->peer;
+    for (int i = 0; i < n; i++)
+    {
+        buf_t *buf = bufs[i];
+        if (peer == NULL || peer->net_if == NULL) // 对端未打开，相当于网线未接
+        {
+            end->stats.tx_errors++;
+            continue;
+        }
+        end->stats.tx_packets++;
+        end->stats.tx_bytes += buf->len;
+        sent++;
+        uint64_t depart = now;
+        if (conf->rate_bps)
+        {
+            depart = end->busy_until > now ? end->busy_until : now;
+            depart += buf->len * 8 * 1000000000ull / conf->rate_bps;
+            end->busy_until = depart;
+        }
+        if (vlink_lost(end))
+        {
+            peer->stats.rx_dropped++;
+            continue;
+        }
+        int copies = conf->duplicate > 0 && vlink_rand(end) < conf->duplicate ? 2 : 1;
+        for (int c = 0; c < copies; c++)
+        {
+            uint64_t time = depart;
+            if (!(conf->reorder > 0 && vlink_rand(end) < conf->reorder))
+            {
+                int64_t delay = conf->delay_us * 1000;
+                if (conf->jitter_us)
+                    delay += (int64_t)((vlink_rand(end) * 2 - 1) * conf->jitter_us * 1000);
+                time += delay > 0 ? delay : 0;
+            }
+            vlink_frame_t *frame = peer->rx_num < (conf->limit ? conf->limit : NET_VLINK_LIMIT)
+                                       ? malloc(sizeof(vlink_frame_t) + buf->len)
+                                       : NULL;
+            if (frame == NULL) // 链路上排队已满，尾部丢弃
+            {
+                peer->stats.rx_dropped++;
+                continue;
+            }
+            frame->time = time;
+            frame->len = buf->len;
+            buf_gather(buf, frame->data);
+            vlink_insert(peer, frame);
+        }
+    }
+    pthread_mutex_unlock(&end->link->lock);
+    return sent;
+}
+
+/**
+ * @brief 关闭网卡，两端都关闭后释放链路
+ *
+ * @param net_if 要关闭的网卡
+ */
+static void driver_vlink_close(net_if_t *net_if)
+{
+    vlink_end_t *end = net_if->driver;
+    vlink_t *link = end->link;
+    pthread_mutex_lock(&vlink_list_lock);
+    pthread_mutex_lock(&link->lock);
+    vlink_free_frames(end->rx_head);
+    vlink_free_frames(end->rx_borrowed);
+    end->rx_head = end->rx_tail = end->rx_borrowed = NULL;
+    end->rx_num = 0;
+    end->net_if = NULL;
+    int in_use = link->ends[0].net_if || link->ends[1].net_if;
+    pthread_mutex_unlock(&link->lock);
+    if (!in_use)
+    {
+        vlink_t **pos = &vlink_list;
+        while (*pos != link)
+            pos = &(*pos)->next;
+        *pos = link->next;
+        pthread_mutex_destroy(&link->lock);
+        free(link);
+    }
+    pthread_mutex_unlock(&vlink_list_lock);
+}
+
+/**
+ * @brief 虚拟链路没有可等待的描述符，driver_wait退回睡眠；按虚拟时钟模拟时由driver_vlink_next决定推进多少
+ *
+ * @param net_if 网卡
+ * @return driver_fd_t DRIVER_FD_NONE
+ */
+static driver_fd_t driver_vlink_get_fd(net_if_t *net_if)
+{
+    return DRIVER_FD_NONE;
+}
+
+/**
+ * @brief 读取收发统计
+ *
+ * @param net_if 网卡
+ * @param stats 出口参数，统计
+ */
+static void driver_vlink_stats(net_if_t *net_if, driver_stats_t *stats)
+{
+    vlink_end_t *end = net_if->driver;
+    pthread_mutex_lock(&end->link->lock);
+    *stats = end->stats;
+    pthread_mutex_unlock(&end->link->lock);
+}
+
+const driver_ops_t driver_vlink_ops = {
+    .name = "vlink",
+    .open = driver_vlink_open,
+    .recv = driver_vlink_recv,
+    .recv_burst = driver_vlink_recv_burst,
+    .send_burst = driver_vlink_send_burst,
+    .close = driver_vlink_close,
+    .get_fd = driver_vlink_get_fd,
+    .stats = driver_vlink_stats,
+};
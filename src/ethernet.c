@@ -1,39 +1,77 @@
 #include "ethernet.h"
+#include "stack.h"
 #include "utils.h"
 #include "driver.h"
 #include "arp.h"
 #include "ip.h"
 /**
- * @brief 处理一个收到的数据包
+ * @brief 接收缓冲区，每次轮询最多批量接收NET_VECTOR_SIZE个数据包
+ *        每个线程各有一份，多个线程轮询各自的协议栈时互不覆盖；ethernet_init只为调用它的线程预先分配，
+ *        其他线程的缓冲区在第一次接收时由驱动分配
  * 
- * @param buf 要处理的数据包
  */
-void ethernet_in(buf_t *buf)
+static _Thread_local buf_t ethernet_rxbufs[NET_VECTOR_SIZE];
+
+/**
+ * @brief 批量处理收到的数据包，先剥离整批的以太网头部，再按上层协议分段交给上层
+ * 
+ * @param stack 协议栈
+ * @param bufs 要处理的数据包
+ * @param n 数据包个数
+ */
+void ethernet_in_vector(net_stack_t *stack, buf_t **bufs, size_t n)
 {
-    // TO-DO
-    if (buf->len < sizeof(ether_hdr_t))
+    buf_t *in[NET_VECTOR_SIZE];
+    uint8_t *srcs[NET_VECTOR_SIZE];
+    uint16_t protocols[NET_VECTOR_SIZE];
+    while (n > 0)
     {
-        return;
-    }
-    ether_hdr_t *hdr = (ether_hdr_t *) buf->data;
-    if (buf_remove_header(buf, sizeof(ether_hdr_t)) < 0) 
-    {
-        fprintf(stderr, "ethernet_in: buf_remove_header");
-        return;
-    }
-    if (net_in(buf, swap16(hdr->protocol16), hdr->src) < 0)
-    {
-        fprintf(stderr, "ethernet_in: net_in");
+        size_t count = n < NET_VECTOR_SIZE ? n : NET_VECTOR_SIZE;
+        size_t m = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            buf_t *buf = bufs[i];
+            if (i + 1 < count)
+                prefetch(bufs[i + 1]->data);
+            if (buf->len < sizeof(ether_hdr_t))
+                continue;
+            ether_hdr_t *hdr = (ether_hdr_t *) buf->data;
+            if (buf_remove_header(buf, sizeof(ether_hdr_t)) < 0) 
+            {
+                fprintf(stderr, "ethernet_in: buf_remove_header");
+                continue;
+            }
+            in[m] = buf;
+            srcs[m] = hdr->src;
+            protocols[m++] = swap16(hdr->protocol16);
+        }
+        net_in_runs(stack, in, srcs, protocols, m);
+        bufs += count;
+        n -= count;
     }
 }
+
+/**
+ * @brief 处理一个收到的数据包
+ * 
+ * @param stack 协议栈
+ * @param buf 要处理的数据包
+ */
+void ethernet_in(net_stack_t *stack, buf_t *buf)
+{
+    ethernet_in_vector(stack, &buf, 1);
+}
+
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param stack 协议栈
+ * @param net_if 出口网卡
  * @param buf 要处理的数据包
  * @param mac 目标MAC地址
  * @param protocol 上层协议
  */
-void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
+void ethernet_out(net_stack_t *stack, net_if_t *net_if, buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
 {
     // TO-DO
     if (buf->len < ETHERNET_MIN_TRANSPORT_UNIT && buf_add_padding(buf, ETHERNET_MIN_TRANSPORT_UNIT - buf->len) < 0) 
@@ -45,11 +83,11 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
     buf_add_header(buf, sizeof(ether_hdr_t));
     ether_hdr_t *hdr = (ether_hdr_t *) buf->data;
     memcpy(hdr->dst, mac, NET_MAC_LEN);
-    memcpy(hdr->src, net_if_mac, NET_MAC_LEN);
+    memcpy(hdr->src, net_if->mac, NET_MAC_LEN);
     hdr->protocol16 = swap16(protocol);
-    if (driver_send(buf) < 0) 
+    if (driver_send_defer(net_if, buf) < 0) 
     {
-        fprintf(stderr, "ethernet: driver_send");
+        fprintf(stderr, "ethernet: driver_send_defer");
     }
 }
 /**
@@ -58,15 +96,62 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
  */
 void ethernet_init()
 {
-    buf_init(&rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+    for (int i = 0; i < NET_VECTOR_SIZE; i++)
+        buf_init(&ethernet_rxbufs[i], ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
 }
 
 /**
- * @brief 一次以太网轮询
+ * @brief 一次以太网轮询，各网卡轮流批量接收，收满一批或各网卡都暂无数据包后整批处理，
+ *        直到处理了NET_POLL_BUDGET个数据包或各网卡都已收空
+ *        每轮每个网卡最多收一批的1/if_num，避免一个繁忙的网卡占满整批
+ *        定义NET_RX_ZERO_COPY时，借用的帧在同一网卡下次接收时失效，
+ *        因此每批从每个网卡只批量接收一次，整批处理完再收下一批
  * 
+ * @param stack 协议栈
+ * @return int 本次收到的数据包个数
  */
-void ethernet_poll()
+int ethernet_poll(net_stack_t *stack)
 {
-    if (driver_recv(&rxbuf) > 0)
-        ethernet_in(&rxbuf);
+    buf_t *bufs[NET_VECTOR_SIZE];
+    size_t n = 0, total = 0;
+    int quota = (NET_VECTOR_SIZE + stack->if_num - 1) / stack->if_num;
+    for (size_t i = 0; i < NET_VECTOR_SIZE; i++)
+        bufs[i] = &ethernet_rxbufs[i];
+#ifdef NET_RX_ZERO_COPY
+    do
+    {
+        n = 0;
+        for (int i = 0; i < stack->if_num && n < NET_VECTOR_SIZE; i++)
+        {
+            int max = NET_VECTOR_SIZE - n < (size_t)quota ? NET_VECTOR_SIZE - n : quota;
+            int got = driver_recv_burst(&stack->ifs[i], bufs + n, max);
+            if (got > 0)
+                n += got;
+        }
+        if (n > 0)
+            ethernet_in_vector(stack, bufs, n);
+        total += n;
+    } while (n > 0 && total < NET_POLL_BUDGET);
+#else
+    do
+    {
+        size_t last;
+        n = 0;
+        do
+        {
+            last = n;
+            for (int i = 0; i < stack->if_num && n < NET_VECTOR_SIZE; i++)
+            {
+                int max = NET_VECTOR_SIZE - n < (size_t)quota ? NET_VECTOR_SIZE - n : quota;
+                int got = driver_recv_burst(&stack->ifs[i], bufs + n, max);
+                if (got > 0)
+                    n += got;
+            }
+        } while (n > last && n < NET_VECTOR_SIZE);
+        if (n > 0)
+            ethernet_in_vector(stack, bufs, n);
+        total += n;
+    } while (n == NET_VECTOR_SIZE && total < NET_POLL_BUDGET); // 收满一批说明可能还有积压
+#endif
+    return total;
 }
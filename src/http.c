@@ -12,7 +12,7 @@ typedef struct http_fifo {
     uint8_t front, tail, count;
 } http_fifo_t;
 
-static http_fifo_t http_fifo_v;
+static _Thread_local http_fifo_t http_fifo_v;
 
 static void http_fifo_init(http_fifo_t* fifo) {
     fifo->count = 0;
@@ -60,7 +60,7 @@ static size_t get_line(tcp_connect_t* tcp, char* buf, size_t size) {
                 i++;
             }
         }
-        net_poll();
+        net_poll(tcp->stack);
     }
     buf[i] = '\0';
     return i;
@@ -71,7 +71,7 @@ static size_t http_send(tcp_connect_t* tcp, const char* buf, size_t size) {
     size_t send = 0;
     while (send < size) {
         send += tcp_connect_write(tcp, (const uint8_t*)buf + send, size - send);
-        net_poll();
+        net_poll(tcp->stack);
     }
     return send;
 }
@@ -154,8 +154,8 @@ static void http_handler(tcp_connect_t* tcp, connect_state_t state) {
 
 // 在端口上创建服务器。
 
-int http_server_open(uint16_t port) {
-    if (!tcp_open(port, http_handler)) {
+int http_server_open(net_stack_t* stack, uint16_t port) {
+    if (!tcp_open(stack, port, http_handler)) {
         return -1;
     }
     http_fifo_init(&http_fifo_v);
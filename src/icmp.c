@@ -1,38 +1,43 @@
 #include "net.h"
 #include "icmp.h"
 #include "ip.h"
+#include "stack.h"
 
 /**
  * @brief 发送icmp响应
  * 
+ * @param stack 协议栈
  * @param req_buf 收到的icmp请求包
  * @param src_ip 源ip地址
  */
-static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
+static void icmp_resp(net_stack_t *stack, buf_t *req_buf, uint8_t *src_ip)
 {
     // TO-DO
-    buf_init(&txbuf, req_buf->len);
+    buf_t *txbuf = &stack->txbuf;
+    buf_init(txbuf, req_buf->len);
+    buf_reserve(txbuf, IP_HEADROOM);
     // 填写首部
-    icmp_hdr_t *icmp_hdr = (icmp_hdr_t *)txbuf.data;
+    icmp_hdr_t *icmp_hdr = (icmp_hdr_t *)txbuf->data;
     icmp_hdr->type = ICMP_TYPE_ECHO_REPLY;
     icmp_hdr->code = 0;
     icmp_hdr->checksum16 = 0;
     icmp_hdr->id16 = ((icmp_hdr_t *)req_buf->data)->id16;
     icmp_hdr->seq16 = ((icmp_hdr_t *)req_buf->data)->seq16;
     if (req_buf->len - sizeof(icmp_hdr_t) > 0)
-        memcpy(txbuf.data +sizeof(icmp_hdr_t), req_buf->data + sizeof(icmp_hdr_t), req_buf->len - sizeof(icmp_hdr_t));
-    icmp_hdr->checksum16 = checksum16((uint16_t*)txbuf.data, txbuf.len);
+        memcpy(txbuf->data +sizeof(icmp_hdr_t), req_buf->data + sizeof(icmp_hdr_t), req_buf->len - sizeof(icmp_hdr_t));
+    icmp_hdr->checksum16 = checksum16((uint16_t*)txbuf->data, txbuf->len);
 
-    ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+    ip_out(stack, txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
 /**
  * @brief 处理一个收到的数据包
  * 
+ * @param stack 协议栈
  * @param buf 要处理的数据包
  * @param src_ip 源ip地址
  */
-void icmp_in(buf_t *buf, uint8_t *src_ip)
+void icmp_in(net_stack_t *stack, buf_t *buf, uint8_t *src_ip)
 {
     // TO-DO
     if (buf->len < sizeof(icmp_hdr_t)) return;
@@ -40,33 +45,36 @@ void icmp_in(buf_t *buf, uint8_t *src_ip)
     icmp_hdr_t *icmp_hdr = (icmp_hdr_t *)buf->data;
     if (icmp_hdr->type == ICMP_TYPE_ECHO_REQUEST) 
     {
-        icmp_resp(buf, src_ip);
+        icmp_resp(stack, buf, src_ip);
     }
 }
 
 /**
  * @brief 发送icmp不可达
  * 
+ * @param stack 协议栈
  * @param recv_buf 收到的ip数据包
  * @param src_ip 源ip地址
  * @param code icmp code，协议不可达或端口不可达
  */
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+void icmp_unreachable(net_stack_t *stack, buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
 {
     // TO-DO
-    buf_init(&txbuf, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
+    buf_t *txbuf = &stack->txbuf;
+    buf_init(txbuf, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
+    buf_reserve(txbuf, IP_HEADROOM);
     // 填写首部
-    icmp_hdr_t *icmp_hdr = (icmp_hdr_t *)txbuf.data;
+    icmp_hdr_t *icmp_hdr = (icmp_hdr_t *)txbuf->data;
     icmp_hdr->type = ICMP_TYPE_UNREACH;
     icmp_hdr->code = code;
     icmp_hdr->checksum16 = 0;
     // “差错报文”这里全设为0
     icmp_hdr->id16 = 0;
     icmp_hdr->seq16 = 0;
-    memcpy(txbuf.data + sizeof(icmp_hdr_t), recv_buf->data, sizeof(ip_hdr_t) + 8);
-    icmp_hdr->checksum16 = checksum16((uint16_t*)txbuf.data, txbuf.len);
+    memcpy(txbuf->data + sizeof(icmp_hdr_t), recv_buf->data, sizeof(ip_hdr_t) + 8);
+    icmp_hdr->checksum16 = checksum16((uint16_t*)txbuf->data, txbuf->len);
 
-    ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
+    ip_out(stack, txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
 /**
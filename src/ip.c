@@ -3,57 +3,105 @@
 #include "ethernet.h"
 #include "arp.h"
 #include "icmp.h"
-
-// 标识
-uint16_t send_id = 0;
+#include "stack.h"
 
 /**
- * @brief 处理一个收到的数据包
+ * @brief 检查一个收到的数据包并剥离ip头部
  * 
- * @param buf 要处理的数据包
- * @param src_mac 源mac地址
+ * @param stack 协议栈
+ * @param buf 要检查的数据包
+ * @return ip_hdr_t* 通过检查时返回ip头部，否则为NULL
  */
-void ip_in(buf_t *buf, uint8_t *src_mac)
+static ip_hdr_t *ip_check(net_stack_t *stack, buf_t *buf)
 {
     if (buf->len < sizeof(ip_hdr_t))
-        return;
+        return NULL;
     
     ip_hdr_t *ip_hdr = (ip_hdr_t *)buf->data;
     // 报头检测
     if (ip_hdr->version != IP_VERSION_4 || swap16(ip_hdr->total_len16) > buf->len)
-        return;
+        return NULL;
 
     uint16_t hdr_checksum16 = ip_hdr->hdr_checksum16;
     ip_hdr->hdr_checksum16 = 0;
     if (hdr_checksum16 != checksum16((uint16_t*)ip_hdr, sizeof(ip_hdr_t)))
-        return;
+        return NULL;
     
     ip_hdr->hdr_checksum16 = hdr_checksum16;
 
-    if (memcmp(ip_hdr->dst_ip, net_if_ip, NET_IP_LEN) != 0)
-        return;
+    if (memcmp(ip_hdr->dst_ip, stack->ifs[buf->if_id].ip, NET_IP_LEN) != 0)
+        return NULL;
     
     uint16_t total_len = swap16(ip_hdr->total_len16);
     if (buf->len > total_len)
         buf_remove_padding(buf, buf->len - total_len);
     
     if (!(ip_hdr->protocol == NET_PROTOCOL_ICMP || ip_hdr->protocol == NET_PROTOCOL_UDP || ip_hdr->protocol == NET_PROTOCOL_TCP))
-        icmp_unreachable(buf, ip_hdr->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+    {
+        icmp_unreachable(stack, buf, ip_hdr->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+        return NULL;
+    }
 
     if (buf_remove_header(buf, sizeof(ip_hdr_t)) < 0)
     {
         fprintf(stderr, "ip_in(): buf_remove_header");
-        return;
+        return NULL;
     }
-    
-    if (net_in(buf, ip_hdr->protocol, ip_hdr->src_ip) < 0)
-        fprintf(stderr, "ip_in(): net_in");
+    return ip_hdr;
+}
+
+/**
+ * @brief 批量处理收到的数据包，先检查整批的ip头部，再按上层协议分段交给上层
+ * 
+ * @param stack 协议栈
+ * @param bufs 要处理的数据包
+ * @param src_macs 各数据包的源mac地址
+ * @param n 数据包个数
+ */
+void ip_in_vector(net_stack_t *stack, buf_t **bufs, uint8_t **src_macs, size_t n)
+{
+    buf_t *in[NET_VECTOR_SIZE];
+    uint8_t *srcs[NET_VECTOR_SIZE];
+    uint16_t protocols[NET_VECTOR_SIZE];
+    (void)src_macs;
+    while (n > 0)
+    {
+        size_t count = n < NET_VECTOR_SIZE ? n : NET_VECTOR_SIZE;
+        size_t m = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i + 1 < count)
+                prefetch(bufs[i + 1]->data);
+            ip_hdr_t *ip_hdr = ip_check(stack, bufs[i]);
+            if (ip_hdr == NULL)
+                continue;
+            in[m] = bufs[i];
+            srcs[m] = ip_hdr->src_ip;
+            protocols[m++] = ip_hdr->protocol;
+        }
+        net_in_runs(stack, in, srcs, protocols, m);
+        bufs += count;
+        n -= count;
+    }
+}
 
+/**
+ * @brief 处理一个收到的数据包
+ * 
+ * @param stack 协议栈
+ * @param buf 要处理的数据包
+ * @param src_mac 源mac地址
+ */
+void ip_in(net_stack_t *stack, buf_t *buf, uint8_t *src_mac)
+{
+    ip_in_vector(stack, &buf, &src_mac, 1);
 }
 
 /**
  * @brief 处理一个要发送的ip分片
  * 
+ * @param stack 协议栈
+ * @param nexthop 路由的下一跳
  * @param buf 要发送的分片
  * @param ip 目标ip地址
  * @param protocol 上层协议
@@ -61,9 +109,10 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
  * @param offset 分片offset，必须被8整除
  * @param mf 分片mf标志，是否有下一个分片
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(net_stack_t *stack, net_nexthop_t *nexthop, buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
 {
     // // TO-DO
+    net_if_t *net_if = &stack->ifs[nexthop->if_id];
     buf_add_header(buf, sizeof(ip_hdr_t));
     ip_hdr_t *ip_hdr = (ip_hdr_t *)buf->data;
     
@@ -76,47 +125,75 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     uint16_t flags_fragment = (offset / IP_HDR_OFFSET_PER_BYTE);
     if(mf == 1) flags_fragment |= IP_MORE_FRAGMENT;
     ip_hdr->flags_fragment16 = swap16(flags_fragment);
-    memcpy(ip_hdr->src_ip, net_if_ip, NET_IP_LEN);
+    memcpy(ip_hdr->src_ip, net_if->ip, NET_IP_LEN);
     memcpy(ip_hdr->dst_ip, ip, NET_IP_LEN);
     ip_hdr->ttl = 64;
     ip_hdr->protocol = protocol;
     ip_hdr->hdr_checksum16 = 0;
     ip_hdr->hdr_checksum16 = checksum16((uint16_t*)ip_hdr, sizeof(ip_hdr_t));
 
-    arp_out(buf, ip);
+    arp_out(stack, net_if, buf, net_nexthop_addr(nexthop, ip));
 }
 
 /**
- * @brief 处理一个要发送的ip数据包
+ * @brief 查找发往目的地址的路由，选取出口网卡的地址作为源地址
+ *        上层计算伪头部校验和时使用，与ip_out填写的源地址一致
  * 
+ * @param stack 协议栈
+ * @param dst_ip 目的ip地址
+ * @return uint8_t* 源ip地址，没有路由时为NULL
+ */
+uint8_t *ip_src_addr(net_stack_t *stack, uint8_t *dst_ip)
+{
+    net_nexthop_t *nexthop = net_route_lookup(stack->routes, dst_ip);
+    return nexthop ? stack->ifs[nexthop->if_id].ip : NULL;
+}
+
+/**
+ * @brief 处理一个要发送的ip数据包，按最长前缀匹配的路由选取出口网卡与下一跳，按路由的MTU分片
+ * 
+ * @param stack 协议栈
  * @param buf 要处理的包
  * @param ip 目标ip地址
  * @param protocol 上层协议
  */
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+void ip_out(net_stack_t *stack, buf_t *buf, uint8_t *ip, net_protocol_t protocol)
 {
     // TO-DO
-    if (buf->len <= IP_MAX_TRANSPRT_UNIT)
+    net_nexthop_t *nexthop = net_route_lookup(stack->routes, ip);
+    if (nexthop == NULL)
+    {
+        fprintf(stderr, "Error in ip_out: no route to %s\n", iptos(ip));
+        return;
+    }
+    size_t mtu = stack->ifs[nexthop->if_id].mtu;
+    if (nexthop->mtu && nexthop->mtu < mtu)
+        mtu = nexthop->mtu;
+    size_t unit = (mtu - sizeof(ip_hdr_t)) & ~(size_t)(IP_HDR_OFFSET_PER_BYTE - 1); // 每个分片的数据长度，须被8整除
+
+    if (buf->len <= mtu - sizeof(ip_hdr_t))
     {
-        ip_fragment_out(buf, ip, protocol, send_id++, 0, 0);
+        ip_fragment_out(stack, nexthop, buf, ip, protocol, stack->ip_id++, 0, 0);
     }
     else
     {
         size_t len_left = buf->len;
         uint16_t no = 0; // 第几个分片
-        while(len_left > IP_MAX_TRANSPRT_UNIT)
+        buf_t ip_buf = {0}; // 分片只装载ip头，数据以分段的形式引用原数据包，不拷贝
+        while(len_left > unit)
         {
-            buf_t ip_buf;
-            buf_init(&ip_buf, IP_MAX_TRANSPRT_UNIT);
-            memcpy(ip_buf.data, buf->data + no * IP_MAX_TRANSPRT_UNIT, IP_MAX_TRANSPRT_UNIT);
-            ip_fragment_out(&ip_buf, ip, protocol, send_id, no * IP_MAX_TRANSPRT_UNIT, 1);
+            buf_init(&ip_buf, 0);
+            buf_reserve(&ip_buf, IP_HEADROOM);
+            buf_append_ref(&ip_buf, buf, no * unit, unit);
+            ip_fragment_out(stack, nexthop, &ip_buf, ip, protocol, stack->ip_id, no * unit, 1);
             no ++;
-            len_left -= IP_MAX_TRANSPRT_UNIT;
+            len_left -= unit;
         }
-        buf_t ip_buf;
-        buf_init(&ip_buf, len_left);
-        memcpy(ip_buf.data, buf->data + no * IP_MAX_TRANSPRT_UNIT, len_left);
-        ip_fragment_out(&ip_buf, ip, protocol, send_id++, no * IP_MAX_TRANSPRT_UNIT, 0);
+        buf_init(&ip_buf, 0);
+        buf_reserve(&ip_buf, IP_HEADROOM);
+        buf_append_ref(&ip_buf, buf, no * unit, len_left);
+        ip_fragment_out(stack, nexthop, &ip_buf, ip, protocol, stack->ip_id++, no * unit, 0);
+        buf_release(&ip_buf);
     }
 }
 
@@ -127,4 +204,5 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
 void ip_init()
 {
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
+    net_add_protocol_vector(NET_PROTOCOL_IP, ip_in_vector);
 }
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include "net.h"
+#include "stack.h"
 #include "udp.h"
 #include "tcp.h"
 #include "http.h"
 #include "driver.h"
-#include "time.h"
+#include "busypoll.h"
+#include "pipeline.h"
+#include "shard.h"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat="
@@ -11,13 +14,13 @@
 
 
 #ifdef UDP
-void udp_handler(uint8_t* data, size_t len, uint8_t* src_ip, uint16_t src_port) 
+void udp_handler(net_stack_t* stack, uint8_t* data, size_t len, uint8_t* src_ip, uint16_t src_port) 
 {
     printf("recv udp packet from %s:%u len=%zu\n", iptos(src_ip), src_port, len);
     for (int i = 0; i < len; i++)
         putchar(data[i]);
     putchar('\n');
-    udp_send(data, len, 60000, src_ip, src_port); //发送udp包
+    udp_send(stack, data, len, 60000, src_ip, src_port); //发送udp包
 }
 #endif
 
@@ -33,33 +36,51 @@ void tcp_handler(tcp_connect_t* connect, connect_state_t state) {
 }
 #endif
 
-int main(int argc, char const *argv[])
+/**
+ * @brief 每次协议栈轮询之后的应用层处理
+ * 
+ */
+void app_poll()
 {
+#ifdef HTTP
+    http_server_run();
+#endif
+}
 
+int main(int argc, char const *argv[])
+{
+    if (argc > 1 && driver_select(argv[1]) != 0) //可在命令行选择驱动后端，如 ./main pcap
+        return -1;
     if (net_init() != 0)
 	{
         printf("net init failed.");
         return -1;
     }
 #ifdef UDP
-    udp_open(60000, udp_handler); //注册端口的udp监听回调
+    udp_open(&net_default_stack, 60000, udp_handler); //注册端口的udp监听回调
 #endif
 #ifdef TCP
-    tcp_open(61000, tcp_handler); //注册端口的tcp监听回调
+    tcp_open(&net_default_stack, 61000, tcp_handler); //注册端口的tcp监听回调
 #endif
 #ifdef HTTP
-    http_server_open(62000);
+    http_server_open(&net_default_stack, 62000);
+#endif
+#ifdef NET_PIPELINE
+    net_run_pipeline(&net_default_stack, app_poll); //多线程流水线，不再返回
+#endif
+#ifdef NET_SHARD
+    net_run_sharded(&net_default_stack, app_poll); //按流哈希分片的工作线程，不再返回
+#endif
+#ifdef NET_BUSYPOLL
+    net_run_busypoll(&net_default_stack, app_poll); //忙轮询，不再返回
 #endif
     while (1) 
 	{
         //一次主循环
-        net_poll(); //一次主循环
-#ifdef HTTP
-        http_server_run();
-#endif
-        // 节约用电
-        struct timespec sleepTime = { 0, 1000000 };
-        nanosleep(&sleepTime, NULL);
+        net_poll(&net_default_stack); //一次主循环
+        app_poll();
+        // 节约用电，等到有数据包或定时器到期
+        net_wait();
     }
 
     return 0;
@@ -1,34 +1,60 @@
 #include <string.h>
 #include "map.h"
 
+#include <stdio.h>
+
+#define MAP_INDEX_MIN 8                        // 哈希索引表的最小槽数
+#define MAP_INDEX_LOAD(cap) ((cap) - (cap) / 8) // 索引表最多容纳的键数，装载率7/8
+
+/**
+ * @brief 有超时时间的map的链表，由map_sweep_poll在每次协议栈轮询时逐个清理
+ *
+ */
+static _Thread_local map_t *map_sweep_list;
+
 /**
- * @brief 初始化map
- * 
+ * @brief 初始化map，此时不分配存储空间，插入时再按需分配
+ *        map须为清零的或已初始化的，重复初始化时先释放原有的存储空间，值中持有的资源不会释放
+ *
  * @param map 要初始化的map
  * @param key_len 键的长度
  * @param value_len 值的长度
- * @param max_size 最大容量，为0则根据MAP_MAX_LEN自动设置
- * @param timeout 超时秒数，为0则永不超时
- * @param value_constuctor 形如memcpy的构造函数，用于拷贝值到容器中，为NULL则使用memcpy
+ * @param max_size 最大容量，为0则为MAP_MAX_SIZE
+ * @param timeout 超时秒数，为0则永不超时，否则map加入过期清理的链表，须为全局或静态变量
+ * @param value_constuctor 形如memcpy的构造函数，用于拷贝值到容器中，为NULL则直接拷贝
  */
 void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_size, time_t timeout, map_constuctor_t value_constuctor)
 {
-    if (max_size == 0 || max_size * (key_len + value_len + sizeof(time_t)) > MAP_MAX_LEN)
-        max_size = MAP_MAX_LEN / (key_len + value_len + sizeof(time_t));
-    if (value_constuctor == NULL)
-        value_constuctor = (map_constuctor_t)memcpy;
+    if (max_size == 0 || max_size > UINT32_MAX - 1)
+        max_size = MAP_MAX_SIZE;
 
+    int listed = 0; // 重复初始化时已在清理链表中，保留链表指针
+    for (map_t *m = map_sweep_list; m; m = m->sweep_next)
+        listed |= m == map;
+    map_t *sweep_next = listed ? map->sweep_next : NULL;
+
+    while (map->chunk_num > 0)
+        free(map->chunks[--map->chunk_num]);
+    free(map->chunks);
+    free(map->index);
+    free(map->free_heap);
     memset(map, 0, sizeof(map_t));
+    map->sweep_next = sweep_next;
     map->key_len = key_len;
     map->value_len = value_len;
     map->max_size = max_size;
     map->timeout = timeout;
     map->value_constuctor = value_constuctor;
+    if (timeout && !listed)
+    {
+        map->sweep_next = map_sweep_list;
+        map_sweep_list = map;
+    }
 }
 
 /**
  * @brief 获取map当前大小
- * 
+ *
  * @param map 要获取的map
  * @return size_t map大小
  */
@@ -38,115 +64,388 @@ size_t map_size(map_t *map)
 }
 
 /**
- * @brief 内部函数，获取第n个物理位置的键值对
- * 
+ * @brief 内部函数，获取条目数组中第n个位置的键值对
+ *
  * @param map 要获取的map
  * @param pos 位置
  * @return void* 键值对指针
  */
 void *map_entry_get(map_t *map, size_t pos)
 {
-    if (pos >= map->max_size)
+    if (pos >= map->chunk_num * MAP_CHUNK_SIZE)
         return NULL;
-    return map->data + pos * (map->key_len + map->value_len + sizeof(time_t));
+    return map->chunks[pos / MAP_CHUNK_SIZE] + pos % MAP_CHUNK_SIZE * (map->key_len + map->value_len + sizeof(time_t));
 }
 
 /**
  * @brief 内部函数，判断键值对是否有效
- * 
+ *
  * @param map 要判断的map
  * @param entry 键值对指针
  * @return int 1为合法，0为不合法
  */
 int map_entry_valid(map_t *map, const void *entry)
 {
-    time_t entry_time = *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
-    return entry_time && (!map->timeout || entry_time + map->timeout >= time(NULL));
+    return map_entry_alive(map, entry, map->key_len + map->value_len);
 }
 
 /**
- * @brief 获取map中指定键的值
- * 
- * @param map 要获取的map
- * @param key 键指针
- * @return void* 值指针，找不到为NULL 
+ * @brief 内部函数，向索引表插入一个槽，沿途劫富济贫：抢占探测距离比自己短的槽，被换出的槽继续向后插入
+ *
+ * @param map 要操作的map
+ * @param hash 键的哈希值
+ * @param pos 键值对在条目数组中的位置
  */
-void *map_get(map_t *map, const void *key)
+static void map_index_insert(map_t *map, uint32_t hash, size_t pos)
 {
-    if (key == NULL)
-        return NULL;
-    for (size_t i = 0; i < map->max_size; i++)
+    map_slot_t carry = {hash, pos + 1};
+    size_t i = hash & map->index_mask;
+    for (size_t dist = 0;; dist++, i = (i + 1) & map->index_mask)
     {
-        uint8_t *entry = map_entry_get(map, i);
-        if (map_entry_valid(map, entry) && !memcmp(key, entry, map->key_len))
-            return entry + map->key_len;
+        map_slot_t *slot = &map->index[i];
+        if (slot->pos == 0)
+        {
+            *slot = carry;
+            return;
+        }
+        size_t slot_dist = map_slot_dist(map, i);
+        if (slot_dist < dist)
+        {
+            map_slot_t tmp = *slot;
+            *slot = carry;
+            carry = tmp;
+            dist = slot_dist;
+        }
     }
-    return NULL;
 }
 
 /**
- * @brief 插入或更新map中指定键的值
- * 
+ * @brief 内部函数，删除索引表的一个槽，后面的槽依次前移一格（backward shift），不留墓碑
+ *
  * @param map 要操作的map
- * @param key 键指针
- * @param value 值指针
- * @return int 成功为0，失败为-1
-*/
-int map_set(map_t *map, const void *key, const void *value)
+ * @param i 要删除的槽位
+ */
+static void map_index_remove(map_t *map, size_t i)
 {
-    uint8_t *old_value = map_get(map, key);
-    if (old_value)
+    size_t next = (i + 1) & map->index_mask;
+    while (map->index[next].pos != 0 && map_slot_dist(map, next) > 0)
     {
-        map->value_constuctor(old_value, value, map->value_len);
-        *(time_t *)(old_value + map->value_len) = time(NULL);
-        return 0;
+        map->index[i] = map->index[next];
+        i = next;
+        next = (next + 1) & map->index_mask;
     }
-    if (map->size == map->max_size)
+    map->index[i].pos = 0;
+}
+
+/**
+ * @brief 内部函数，把索引表重建为cap个槽，用于增长与收缩
+ *
+ * @param map 要操作的map
+ * @param cap 新的槽数，须为2的幂
+ * @return int 成功为0，失败为-1
+ */
+static int map_index_resize(map_t *map, size_t cap)
+{
+    map_slot_t *index = calloc(cap, sizeof(map_slot_t));
+    if (index == NULL)
+    {
+        fprintf(stderr, "Error in map_index_resize:%zu\n", cap);
         return -1;
-    for (size_t i = 0; i < map->max_size; i++)
+    }
+    free(map->index);
+    map->index = index;
+    map->index_mask = cap - 1;
+    size_t time_offset = map->key_len + map->value_len;
+    for (size_t pos = 0; pos < map->used; pos++)
     {
-        uint8_t *entry = map_entry_get(map, i);
-        if (!map_entry_valid(map, entry))
+        uint8_t *entry = map_entry_get(map, pos);
+        if (*(time_t *)(entry + time_offset)) // 已过期的条目仍在索引中，同样要迁移
+            map_index_insert(map, map_hash(entry, map->key_len), pos);
+    }
+    return 0;
+}
+
+/**
+ * @brief 内部函数，把一个已删除的条目位置放入空闲堆
+ *
+ * @param map 要操作的map
+ * @param pos 条目位置
+ */
+static void map_free_push(map_t *map, uint32_t pos)
+{
+    if (map->free_num == map->free_cap)
+    {
+        size_t cap = map->free_cap ? 2 * map->free_cap : MAP_CHUNK_SIZE;
+        uint32_t *heap = realloc(map->free_heap, cap * sizeof(uint32_t));
+        if (heap == NULL)
         {
-            memcpy(entry, key, map->key_len);
-            map->value_constuctor(entry + map->key_len, value, map->value_len);
-            *(time_t *)(entry + map->key_len + map->value_len) = time(NULL);
-            map->size++;
-            return 0;
+            fprintf(stderr, "Error in map_free_push:%zu\n", cap);
+            return; // 只是放弃复用这个位置
         }
+        map->free_heap = heap;
+        map->free_cap = cap;
+    }
+    size_t i = map->free_num++;
+    while (i > 0 && map->free_heap[(i - 1) / 2] > pos)
+    {
+        map->free_heap[i] = map->free_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
     }
+    map->free_heap[i] = pos;
+}
+
+/**
+ * @brief 内部函数，从空闲堆中取出最靠前的条目位置
+ *
+ * @param map 要操作的map
+ * @return uint32_t 条目位置
+ */
+static uint32_t map_free_pop(map_t *map)
+{
+    uint32_t top = map->free_heap[0];
+    uint32_t last = map->free_heap[--map->free_num];
+    size_t i = 0;
+    for (size_t child = 1; child < map->free_num; i = child, child = 2 * i + 1)
+    {
+        if (child + 1 < map->free_num && map->free_heap[child + 1] < map->free_heap[child])
+            child++;
+        if (last <= map->free_heap[child])
+            break;
+        map->free_heap[i] = map->free_heap[child];
+    }
+    map->free_heap[i] = last;
+    return top;
+}
 
+/**
+ * @brief 内部函数，为新键分配一个条目位置
+ *        已满时先清理过期的条目，再依次尝试空闲堆、条目数组末尾（必要时分配新块）
+ *
+ * @param map 要操作的map
+ * @return long 条目位置，map已满或内存不足为-1
+ */
+static long map_entry_alloc(map_t *map)
+{
+    if (map->size == map->max_size && map_sweep(map, map->used) == 0) // 已满时先把过期的条目全部清理掉
+        return -1;
+    while (map->free_num > 0)
+    {
+        uint32_t pos = map_free_pop(map);
+        if (pos < map->used) // 末尾收缩后，堆中超出已使用部分的位置已经作废
+            return pos;
+    }
+    size_t entry_len = map->key_len + map->value_len + sizeof(time_t);
+    if (map->used < map->max_size)
+    {
+        if (map->used == map->chunk_num * MAP_CHUNK_SIZE)
+        {
+            uint8_t **chunks = realloc(map->chunks, (map->chunk_num + 1) * sizeof(uint8_t *));
+            uint8_t *chunk = chunks ? malloc(MAP_CHUNK_SIZE * entry_len) : NULL;
+            if (chunk == NULL)
+            {
+                fprintf(stderr, "Error in map_entry_alloc:%zu\n", map->used);
+                if (chunks)
+                    map->chunks = chunks;
+                return -1;
+            }
+            map->chunks = chunks;
+            map->chunks[map->chunk_num++] = chunk;
+        }
+        memset(map_entry_get(map, map->used), 0, entry_len);
+        return map->used++;
+    }
     return -1;
 }
 
 /**
- * @brief 删除map中指定的键
- * 
+ * @brief 内部函数，删除键后收缩存储：截掉条目数组末尾的空闲条目并释放多余的块，键数过少时缩小索引表
+ *
+ * @param map 要操作的map
+ */
+static void map_shrink(map_t *map)
+{
+    size_t time_offset = map->key_len + map->value_len;
+    while (map->used > 0 && *(time_t *)((uint8_t *)map_entry_get(map, map->used - 1) + time_offset) == 0)
+        map->used--;
+    size_t keep = (map->used + MAP_CHUNK_SIZE - 1) / MAP_CHUNK_SIZE + 1; // 多留一块，避免在块边界上反复分配释放
+    while (map->chunk_num > keep)
+        free(map->chunks[--map->chunk_num]);
+
+    size_t cap = map->index_mask + 1;
+    if (cap > MAP_INDEX_MIN && map->size < MAP_INDEX_LOAD(cap) / 4)
+        map_index_resize(map, cap / 2);
+}
+
+/**
+ * @brief 内部函数，插入一个新键：必要时扩大索引表，分配条目并写入键，值由调用者构造
+ *
  * @param map 要操作的map
  * @param key 键指针
+ * @param hash 键的哈希值
+ * @return void* 条目指针，map已满或内存不足为NULL
  */
-void map_delete(map_t *map, const void *key)
+void *map_entry_insert(map_t *map, const void *key, uint32_t hash)
+{
+    size_t cap = map->index ? map->index_mask + 1 : 0;
+    if (map->size + 1 > MAP_INDEX_LOAD(cap) && map_index_resize(map, cap ? 2 * cap : MAP_INDEX_MIN) < 0)
+        return NULL;
+    long pos = map_entry_alloc(map);
+    if (pos < 0)
+        return NULL;
+    uint8_t *entry = map_entry_get(map, pos);
+    memcpy(entry, key, map->key_len);
+    map_index_insert(map, hash, pos);
+    map->size++;
+    return entry;
+}
+
+/**
+ * @brief 内部函数，删除索引表某个槽位对应的键值对
+ *
+ * @param map 要操作的map
+ * @param slot 槽位
+ */
+void map_slot_delete(map_t *map, size_t slot)
 {
-    uint8_t *value = map_get(map, key);
-    if (value)
+    size_t pos = map->index[slot].pos - 1;
+    map_index_remove(map, slot);
+    *(time_t *)((uint8_t *)map_entry_get(map, pos) + map->key_len + map->value_len) = 0;
+    map->size--;
+    if (pos + 1 < map->used)
+        map_free_push(map, pos);
+    map_shrink(map);
+}
+
+/**
+ * @brief 内部函数，清理索引表某个槽位对应的过期键值对，先调用过期回调再删除
+ *
+ * @param map 要操作的map
+ * @param slot 槽位
+ */
+void map_slot_expire(map_t *map, size_t slot)
+{
+    if (map->expire_handler)
     {
-        *(time_t *)(value + map->value_len) = 0;
-        map->size--;
+        uint8_t *entry = map_entry_get(map, map->index[slot].pos - 1);
+        map->expire_handler(entry, entry + map->key_len, (time_t *)(entry + map->key_len + map->value_len));
     }
+    map_slot_delete(map, slot);
+}
+
+/**
+ * @brief 设置表项过期被清理前的回调，用于释放值中持有的资源，如arp_buf中缓存的数据包
+ *        表项被map_delete主动删除时不调用
+ *
+ * @param map 要设置的map
+ * @param handler 回调函数，参数为（键指针，值指针，更新时间指针），为NULL则不回调
+ */
+void map_set_expire_handler(map_t *map, map_entry_handler_t handler)
+{
+    map->expire_handler = handler;
+}
+
+/**
+ * @brief 从游标处开始检查至多budget个条目，清理其中已过期的，游标到达末尾后回到开头
+ *
+ * @param map 要清理的map
+ * @param budget 本次最多检查的条目数
+ * @return size_t 清理掉的条目数
+ */
+size_t map_sweep(map_t *map, size_t budget)
+{
+    size_t expired = 0;
+    size_t entry_len = map->key_len + map->value_len + sizeof(time_t);
+    if (map->timeout == 0)
+        return 0;
+    for (size_t i = 0; i < budget && map->used > 0; i++)
+    {
+        if (map->sweep_pos >= map->used)
+            map->sweep_pos = 0;
+        size_t pos = map->sweep_pos++;
+        uint8_t *entry = map_entry_get(map, pos);
+        if (*(time_t *)(entry + map->key_len + map->value_len) == 0 || map_entry_valid(map, entry))
+            continue;
+        map_slot_expire(map, map_find(map, entry, map_hash(entry, map->key_len), map->key_len, entry_len));
+        expired++;
+    }
+    return expired;
+}
+
+/**
+ * @brief 一次过期清理轮询，每个有超时时间的map检查MAP_SWEEP_BUDGET个条目
+ *
+ */
+void map_sweep_poll()
+{
+    for (map_t *map = map_sweep_list; map; map = map->sweep_next)
+        map_sweep(map, MAP_SWEEP_BUDGET);
+}
+
+/**
+ * @brief 获取map中指定键的值
+ *
+ * @param map 要获取的map
+ * @param key 键指针
+ * @return void* 值指针，找不到为NULL
+ */
+void *map_get(map_t *map, const void *key)
+{
+    return map_get_inline(map, key, map->key_len, map->value_len);
+}
+
+/**
+ * @brief 插入或更新map中指定键的值
+ *
+ * @param map 要操作的map
+ * @param key 键指针
+ * @param value 值指针
+ * @return int 成功为0，失败为-1
+*/
+int map_set(map_t *map, const void *key, const void *value)
+{
+    return map_set_inline(map, key, value, map->key_len, map->value_len, map->value_constuctor);
+}
+
+/**
+ * @brief 删除map中指定的键
+ *
+ * @param map 要操作的map
+ * @param key 键指针
+ */
+void map_delete(map_t *map, const void *key)
+{
+    map_delete_inline(map, key, map->key_len, map->value_len);
 }
 
 /**
  * @brief 遍历map
- * 
+ *
  * @param map 要遍历的map
- * @param handler 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针）
+ * @param handler 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针），回调中可以删除键
  */
 void map_foreach(map_t *map, map_entry_handler_t handler)
 {
-    for (size_t i = 0; i < map->max_size; i++)
+    for (size_t i = 0; i < map->used; i++)
     {
         uint8_t *entry = map_entry_get(map, i);
         if (map_entry_valid(map, entry))
             handler(entry, entry + map->key_len, (time_t *)(entry + map->key_len + map->value_len));
     }
 }
+
+/**
+ * @brief 遍历map，并把调用者的参数传给回调
+ *
+ * @param map 要遍历的map
+ * @param handler 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针，arg），回调中可以删除键
+ * @param arg 传给回调的参数
+ */
+void map_foreach_arg(map_t *map, map_entry_arg_handler_t handler, void *arg)
+{
+    for (size_t i = 0; i < map->used; i++)
+    {
+        uint8_t *entry = map_entry_get(map, i);
+        if (map_entry_valid(map, entry))
+            handler(entry, entry + map->key_len, (time_t *)(entry + map->key_len + map->value_len), arg);
+    }
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include "mempool.h"
+
+/**
+ * @brief 缓冲区块头，位于每个缓冲区之前，整体按cache line对齐
+ *
+ */
+typedef struct mempool_blk
+{
+    struct mempool_blk *next; // 空闲链表中的下一块
+    size_t cls;               // 所属大小类
+    size_t ref;               // 引用计数，为0时位于空闲链表
+} mempool_blk_t;
+
+#define MEMPOOL_ROUND_UP(x) (((x) + MEMPOOL_ALIGN - 1) / MEMPOOL_ALIGN * MEMPOOL_ALIGN)
+#define MEMPOOL_HDR_LEN MEMPOOL_ROUND_UP(sizeof(mempool_blk_t)) // 块头占用的长度，保证负载起始地址对齐
+#define MEMPOOL_BLK(ptr) ((mempool_blk_t *)((uint8_t *)(ptr) - MEMPOOL_HDR_LEN))
+
+/**
+ * @brief 一个大小类，维护同样大小缓冲区的空闲链表
+ *
+ */
+typedef struct mempool_class
+{
+    size_t size;         // 缓冲区大小
+    size_t grow_num;     // 每次预分配的缓冲区个数
+    size_t total;        // 已分配的缓冲区总数
+    size_t free;         // 空闲的缓冲区个数
+    mempool_blk_t *head; // 空闲链表头
+} mempool_class_t;
+
+/**
+ * @brief 各个大小类，按大小升序排列
+ *
+ */
+static _Thread_local mempool_class_t mempool_classes[] = {
+    {MEMPOOL_SMALL_SIZE, MEMPOOL_SMALL_NUM},
+    {MEMPOOL_MEDIUM_SIZE, MEMPOOL_MEDIUM_NUM},
+    {MEMPOOL_LARGE_SIZE, MEMPOOL_LARGE_NUM},
+};
+
+#define MEMPOOL_CLASS_NUM (sizeof(mempool_classes) / sizeof(mempool_classes[0]))
+
+/**
+ * @brief 为一个大小类预分配一批缓冲区并挂入空闲链表
+ *
+ * @param cls 大小类序号
+ * @return int 成功为0，失败为-1
+ */
+static int mempool_grow(size_t cls)
+{
+    mempool_class_t *c = &mempool_classes[cls];
+    size_t stride = MEMPOOL_HDR_LEN + MEMPOOL_ROUND_UP(c->size);
+    uint8_t *chunk = malloc(c->grow_num * stride + MEMPOOL_ALIGN - 1); // 整块内存随进程存在，不归还
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Error in mempool_grow:%zu\n", c->size);
+        return -1;
+    }
+    chunk = (uint8_t *)MEMPOOL_ROUND_UP((uintptr_t)chunk);
+    for (size_t i = 0; i < c->grow_num; i++)
+    {
+        mempool_blk_t *blk = (mempool_blk_t *)(chunk + i * stride);
+        blk->cls = cls;
+        blk->next = c->head;
+        c->head = blk;
+    }
+    c->total += c->grow_num;
+    c->free += c->grow_num;
+    return 0;
+}
+
+/**
+ * @brief 初始化内存池，为每个大小类预分配缓冲区
+ *
+ */
+void mempool_init()
+{
+    for (size_t i = 0; i < MEMPOOL_CLASS_NUM; i++)
+        if (mempool_classes[i].total == 0)
+            mempool_grow(i);
+}
+
+/**
+ * @brief 从内存池分配一个缓冲区，选取能容纳size的最小大小类
+ *
+ * @param size 需要的大小
+ * @param cap 出口参数，实际分配的缓冲区大小
+ * @return void* 缓冲区起始地址（按MEMPOOL_ALIGN对齐），失败为NULL
+ */
+void *mempool_alloc(size_t size, size_t *cap)
+{
+    for (size_t i = 0; i < MEMPOOL_CLASS_NUM; i++)
+    {
+        mempool_class_t *c = &mempool_classes[i];
+        if (c->size < size)
+            continue;
+        if (c->head == NULL && mempool_grow(i) < 0)
+            return NULL;
+        mempool_blk_t *blk = c->head;
+        c->head = blk->next;
+        c->free--;
+        blk->ref = 1;
+        if (cap)
+            *cap = c->size;
+        return (uint8_t *)blk + MEMPOOL_HDR_LEN;
+    }
+    fprintf(stderr, "Error in mempool_alloc:%zu\n", size);
+    return NULL;
+}
+
+/**
+ * @brief 增加缓冲区的引用计数，用于多个持有者共享同一缓冲区
+ *
+ * @param ptr mempool_alloc返回的地址
+ */
+void mempool_ref(void *ptr)
+{
+    MEMPOOL_BLK(ptr)->ref++;
+}
+
+/**
+ * @brief 获取缓冲区的引用计数
+ *
+ * @param ptr mempool_alloc返回的地址
+ * @return size_t 引用计数
+ */
+size_t mempool_refcnt(const void *ptr)
+{
+    return MEMPOOL_BLK(ptr)->ref;
+}
+
+/**
+ * @brief 释放对缓冲区的一个引用，引用计数归零时归还内存池
+ *
+ * @param ptr mempool_alloc返回的地址，为NULL则忽略
+ */
+void mempool_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    mempool_blk_t *blk = MEMPOOL_BLK(ptr);
+    if (--blk->ref > 0)
+        return;
+    mempool_class_t *c = &mempool_classes[blk->cls];
+    blk->next = c->head;
+    c->head = blk;
+    c->free++;
+}
+
+/**
+ * @brief 打印内存池各大小类的使用情况
+ *
+ */
+void mempool_print()
+{
+    printf("===MEMPOOL BEGIN===\n");
+    for (size_t i = 0; i < MEMPOOL_CLASS_NUM; i++)
+        printf("%zu | %zu/%zu in use\n", mempool_classes[i].size,
+               mempool_classes[i].total - mempool_classes[i].free, mempool_classes[i].total);
+    printf("===MEMPOOL  END ===\n");
+}
@@ -1,4 +1,5 @@
 #include "net.h"
+#include "stack.h"
 #include "driver.h"
 #include "ethernet.h"
 #include "arp.h"
@@ -6,18 +7,37 @@
 #include "icmp.h"
 #include "udp.h"
 #include "tcp.h"
+#include "mempool.h"
+#include "timer.h"
+#include "clock.h"
+#include "route.h"
+
+#define NET_PROTOCOL_TABLE_LEN 512 //协议表长度，前256项为IP协议号，后256项为EtherType
+
+typedef struct net_protocol_entry //协议表的一项
+{
+    uint16_t protocol;     // 协议号，用于识别EtherType折叠后的冲突
+    net_handler_t handler; // 该协议的in处理程序，为NULL表示未注册
+    net_vector_handler_t vector_handler; // 该协议的批量in处理程序，为NULL时逐个调用handler
+} net_protocol_entry_t;
 
 /**
- * @brief 协议表 <协议号,处理程序>的容器
+ * @brief 协议表，按协议号直接索引
  * 
  */
-map_t net_table;
+static net_protocol_entry_t net_protocol_table[NET_PROTOCOL_TABLE_LEN];
 
 /**
- * @brief 网卡MAC地址
+ * @brief 计算协议号在协议表中的下标
+ *        IP协议号小于256，直接作为下标；EtherType不小于0x0600，高低字节异或折叠到后256项，常见的类型互不冲突
  * 
+ * @param protocol 协议号
+ * @return size_t 下标
  */
-uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
+static inline size_t net_protocol_index(uint16_t protocol)
+{
+    return protocol < 256 ? protocol : 256 + ((protocol ^ (protocol >> 8)) & 0xFF);
+}
 
 /**
  * @brief 广播 MAC 地址
@@ -26,16 +46,133 @@ uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
 uint8_t net_broadcast_mac[NET_MAC_LEN] = NET_BROADCAST_MAC;
 
 /**
- * @brief 网卡IP地址
+ * @brief 单线程主循环使用的协议栈，由net_init初始化
+ * 
+ */
+net_stack_t net_default_stack;
+
+/**
+ * @brief 各协议栈共享的路由表，第一次初始化协议栈时建立
+ * 
+ */
+static net_route_table_t net_default_routes;
+
+/**
+ * @brief 本线程的net_poll改为调用的轮询函数，为NULL时直接从网卡接收
+ *        流水线与分片模式下协议线程的帧来自队列，应用在该线程上调用net_poll时不能绕过队列去读网卡
+ * 
+ */
+static _Thread_local net_poll_hook_t net_poll_hook;
+
+/**
+ * @brief 在协议栈的网卡表中填写一个网卡
+ * 
+ * @param stack 协议栈
+ * @param ip 网卡ip地址
+ * @param prefix_len 网卡所在网段的前缀长度
+ * @param mac 网卡mac地址
+ * @return net_if_t* 填好的网卡，网卡表已满时为NULL
+ */
+static net_if_t *net_if_setup(net_stack_t *stack, const uint8_t *ip, uint8_t prefix_len, const uint8_t *mac)
+{
+    if (stack->if_num >= NET_IF_MAX)
+    {
+        fprintf(stderr, "Error in net_if_setup: at most %d interfaces\n", NET_IF_MAX);
+        return NULL;
+    }
+    net_if_t *net_if = &stack->ifs[stack->if_num];
+    memset(net_if, 0, sizeof(net_if_t));
+    net_if->id = stack->if_num;
+    net_if->prefix_len = prefix_len;
+    net_if->mtu = ETHERNET_MAX_TRANSPORT_UNIT;
+    memcpy(net_if->mac, mac, NET_MAC_LEN);
+    memcpy(net_if->ip, ip, NET_IP_LEN);
+    stack->if_num++;
+    return net_if;
+}
+
+/**
+ * @brief 建立共享的路由表：网卡0的直连路由，以及经NET_IF_GATEWAY（未定义时直接从网卡0发出）的默认路由
+ * 
+ * @return int 成功为0，失败为-1
+ */
+static int net_default_routes_init()
+{
+    static const uint8_t if_ip[NET_IP_LEN] = NET_IF_IP;
+    static const uint8_t any[NET_IP_LEN] = {0};
+    net_nexthop_t connected = {.if_id = 0};
+    net_nexthop_t gateway = {.if_id = 0};
+#ifdef NET_IF_GATEWAY
+    static const uint8_t gateway_ip[NET_IP_LEN] = NET_IF_GATEWAY;
+    memcpy(gateway.gateway, gateway_ip, NET_IP_LEN);
+#endif
+    if (net_route_init(&net_default_routes) < 0)
+        return -1;
+    if (net_route_add(&net_default_routes, if_ip, NET_IF_PREFIX_LEN, &connected) < 0 ||
+        net_route_add(&net_default_routes, any, 0, &gateway) < 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief 初始化一份协议栈上下文，清空其中的状态，填写网卡0并初始化各协议的表
+ *        须在使用该协议栈的线程上调用，表使用的内存池是线程局部的；
+ *        第一次调用时建立共享的路由表，须在启动工作线程之前
  * 
+ * @param stack 要初始化的协议栈
+ * @return int 成功为0，失败为-1
  */
-uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
+int net_stack_init(net_stack_t *stack)
+{
+    static const uint8_t if_mac[NET_MAC_LEN] = NET_IF_MAC;
+    static const uint8_t if_ip[NET_IP_LEN] = NET_IF_IP;
+    memset(stack, 0, sizeof(net_stack_t));
+    if (net_default_routes.tbl24 == NULL && net_default_routes_init() < 0)
+        return -1;
+    stack->routes = &net_default_routes;
+    if (net_if_setup(stack, if_ip, NET_IF_PREFIX_LEN, if_mac) == NULL)
+        return -1;
+#ifdef ARP
+    arp_stack_init(stack);
+#endif
+#ifdef TCP
+    tcp_stack_init(stack);
+#endif
+    return 0;
+}
 
 /**
- * @brief 网卡接收和发送缓冲区
+ * @brief 再打开一个网卡，添加其网段的直连路由并广播一次arp，须在启动工作线程之前调用
  * 
+ * @param stack 协议栈
+ * @param ip 网卡ip地址，据此选取pcap网卡
+ * @param prefix_len 网卡所在网段的前缀长度
+ * @param mac 网卡mac地址
+ * @return int 网卡编号，失败为-1
  */
-buf_t rxbuf, txbuf; //一个buf足够单线程使用
+int net_if_add(net_stack_t *stack, const uint8_t *ip, uint8_t prefix_len, const uint8_t *mac)
+{
+    net_if_t *net_if = net_if_setup(stack, ip, prefix_len, mac);
+    if (net_if == NULL)
+        return -1;
+    net_nexthop_t connected = {.if_id = net_if->id};
+    if (driver_open(net_if) < 0)
+    {
+        stack->if_num--;
+        return -1;
+    }
+    if (net_route_add(stack->routes, ip, prefix_len, &connected) < 0)
+    {
+        driver_close(net_if);
+        stack->if_num--;
+        return -1;
+    }
+#ifdef ARP
+    arp_req(stack, net_if, net_if->ip);
+    driver_flush();
+#endif
+    return net_if->id;
+}
 
 /**
  * @brief 初始化协议栈
@@ -43,13 +180,17 @@ buf_t rxbuf, txbuf; //一个buf足够单线程使用
  */
 int net_init()
 {
-    map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
-    if (driver_open() == -1)
+    mempool_init();
+    net_clock_init();
+    net_timer_init();
+    if (net_stack_init(&net_default_stack) < 0)
+        return -1;
+    if (driver_open(&net_default_stack.ifs[0]) == -1)
         return -1;
 #ifdef ETHERNET
     ethernet_init();
 #ifdef ARP
-    arp_init();
+    arp_init(&net_default_stack);
 #ifdef IP
     ip_init();
 #ifdef ICMP
@@ -64,6 +205,7 @@ int net_init()
 #endif
 #endif
 #endif
+    driver_flush(); // 初始化时发出的arp请求不等第一次轮询，工作线程启动后主线程可能不再轮询
     return 0;
 }
 
@@ -75,23 +217,101 @@ int net_init()
  */
 void net_add_protocol(uint16_t protocol, net_handler_t handler)
 {
-    map_set(&net_table, &protocol, &handler);
+    net_protocol_entry_t *entry = &net_protocol_table[net_protocol_index(protocol)];
+    if (entry->handler && entry->protocol != protocol)
+    {
+        fprintf(stderr, "Error in net_add_protocol: 0x%04x conflicts with 0x%04x\n", protocol, entry->protocol);
+        return;
+    }
+    entry->protocol = protocol;
+    entry->handler = handler;
+}
+
+/**
+ * @brief 为已注册的协议登记批量处理程序，一层处理完整批数据包后再交给上层
+ * 
+ * @param protocol 协议号，须先用net_add_protocol注册
+ * @param handler 该协议的批量in处理程序
+ */
+void net_add_protocol_vector(uint16_t protocol, net_vector_handler_t handler)
+{
+    net_protocol_entry_t *entry = &net_protocol_table[net_protocol_index(protocol)];
+    if (entry->handler == NULL || entry->protocol != protocol)
+    {
+        fprintf(stderr, "Error in net_add_protocol_vector: 0x%04x not registered\n", protocol);
+        return;
+    }
+    entry->vector_handler = handler;
+}
+
+/**
+ * @brief 向协议栈的上层协议传递一批同一协议的数据包
+ *        上层未登记批量处理程序时逐个调用其in处理程序
+ * 
+ * @param stack 协议栈
+ * @param bufs 要传递的数据包
+ * @param srcs 各数据包源的本层协议地址
+ * @param n 数据包个数
+ * @param protocol 上层协议号
+ * @return int 成功为0，失败为-1
+ */
+int net_in_vector(net_stack_t *stack, buf_t **bufs, uint8_t **srcs, size_t n, uint16_t protocol)
+{
+    net_protocol_entry_t *entry = &net_protocol_table[net_protocol_index(protocol)];
+    if (entry->handler == NULL || entry->protocol != protocol)
+        return -1;
+    if (entry->vector_handler)
+    {
+        entry->vector_handler(stack, bufs, srcs, n);
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i + 1 < n)
+            prefetch(bufs[i + 1]->data);
+        entry->handler(stack, bufs[i], srcs[i]);
+    }
+    return 0;
+}
+
+/**
+ * @brief 把一批数据包按上层协议号切成连续的段，逐段交给上层
+ *        只合并相邻的同协议包，各包交给上层的先后顺序不变
+ * 
+ * @param stack 协议栈
+ * @param bufs 要传递的数据包
+ * @param srcs 各数据包源的本层协议地址
+ * @param protocols 各数据包的上层协议号
+ * @param n 数据包个数
+ */
+void net_in_runs(net_stack_t *stack, buf_t **bufs, uint8_t **srcs, const uint16_t *protocols, size_t n)
+{
+    size_t start = 0;
+    for (size_t i = 1; i <= n; i++)
+    {
+        if (i < n && protocols[i] == protocols[start])
+            continue;
+        if (net_in_vector(stack, bufs + start, srcs + start, i - start, protocols[start]) < 0)
+            fprintf(stderr, "net_in_runs: net_in_vector 0x%04x\n", protocols[start]);
+        start = i;
+    }
 }
 
 /**
  * @brief 向协议栈的上层协议传递数据包
  * 
+ * @param stack 协议栈
  * @param buf 要传递的数据包
  * @param protocol 上层协议号
  * @param src 源的本层协议地址，如mac或ip地址
  * @return int 成功为0，失败为-1
  */
-int net_in(buf_t *buf, uint16_t protocol, uint8_t *src)
+int net_in(net_stack_t *stack, buf_t *buf, uint16_t protocol, uint8_t *src)
 {
-    net_handler_t *handler = map_get(&net_table, &protocol);
-    if (handler)
+    net_protocol_entry_t *entry = &net_protocol_table[net_protocol_index(protocol)];
+    if (entry->handler && entry->protocol == protocol)
     {
-        (*handler)(buf, src);
+        entry->handler(stack, buf, src);
         return 0;
     }
     return -1;
@@ -100,10 +320,46 @@ int net_in(buf_t *buf, uint16_t protocol, uint8_t *src)
 /**
  * @brief 一次协议栈轮询
  * 
+ * @param stack 协议栈
+ * @return int 本次收到的数据包个数
  */
-void net_poll()
+int net_poll(net_stack_t *stack)
 {
+    if (net_poll_hook)
+        return net_poll_hook(stack);
+    net_clock_update();
+    net_timer_poll();
+    map_sweep_poll();
 #ifdef ETHERNET
-    ethernet_poll();
+    int n = ethernet_poll(stack);
+#else
+    int n = 0;
 #endif
-}
\ No newline at end of file
+    driver_flush(); // 本轮产生的数据包整批发出
+    return n;
+}
+
+/**
+ * @brief 设置本线程的net_poll改为调用的轮询函数
+ *        流水线的协议线程与分片的工作线程在启动时设置，应用的阻塞循环（如http）在这些线程上调用net_poll时
+ *        只从队列取帧并推进定时器与发送，不与接收线程争用网卡
+ * 
+ * @param hook 轮询函数，为NULL时恢复直接从网卡接收
+ */
+void net_poll_hook_set(net_poll_hook_t hook)
+{
+    net_poll_hook = hook;
+}
+
+/**
+ * @brief 等待到网卡收到数据包或下一个定时器到期，供主循环在两次轮询之间让出CPU
+ * 
+ */
+void net_wait()
+{
+    int64_t timeout = net_timer_next();
+    if (timeout < 0 || timeout > NET_WAIT_MAX_MS)
+        timeout = NET_WAIT_MAX_MS;
+    driver_flush(); // 应用在两次轮询之间发送的数据包不能等到唤醒之后
+    driver_wait((int)timeout);
+}
@@ -0,0 +1,345 @@
+#include <pthread.h>
+#include <sched.h>
+#include "pipeline.h"
+#include "ring.h"
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "udp.h"
+#include "tcp.h"
+#include "timer.h"
+#include "clock.h"
+#include "stack.h"
+
+#define PIPELINE_FRAME_LEN (ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)) // 接收帧缓冲区按最大以太网帧准备
+#define PIPELINE_CAPTURE_LEN UINT16_MAX                                          // 接收线程私有缓冲区的大小，容纳任一抓到的帧
+
+typedef enum pipeline_send_type
+{
+    PIPELINE_SEND_UDP,
+    PIPELINE_SEND_TCP,
+} pipeline_send_type_t;
+
+typedef struct pipeline_send //应用线程交给协议线程的发送请求
+{
+    pipeline_send_type_t type;
+    uint8_t ip[NET_IP_LEN];                  // 对端ip地址
+    uint16_t local_port, remote_port;        // 本地与对端端口
+    size_t len;                              // 数据长度
+    size_t sent;                             // 已写入tcp连接的长度，写完之前请求留在协议线程上
+    struct pipeline_send *next;              // 协议线程等待链表中的下一个请求
+    uint8_t data[NET_PIPELINE_SEND_MAX_LEN]; // 要发送的数据，入队时拷贝
+} pipeline_send_t;
+
+/**
+ * @brief 接收线程与协议线程之间的队列：rx_ring送去收到的帧，rx_free_ring送回处理完的帧缓冲区
+ *        帧缓冲区只由协议线程分配和重新初始化，接收线程不调用mempool
+ *
+ */
+static ring_t rx_ring, rx_free_ring;
+static buf_t pipeline_frames[NET_PIPELINE_RING_SIZE];
+
+/**
+ * @brief 应用线程与协议线程之间的队列：send_ring送去发送请求，send_free_ring送回空闲的请求
+ *        队列是单生产者单消费者的，多个应用线程在应用一侧由send_lock串行
+ *
+ */
+static ring_t send_ring, send_free_ring;
+static pipeline_send_t pipeline_sends[NET_PIPELINE_SEND_SIZE];
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief 协议线程上尚未完成的发送请求，按入队顺序排列；tcp连接的发送缓存或窗口不足时剩余部分留在这里，
+ *        之后每次轮询重试，写完后才送回send_free_ring。只由协议线程访问
+ *
+ */
+static pipeline_send_t *send_pending, **send_pending_tail = &send_pending;
+
+/**
+ * @brief 协议线程空闲时睡在门铃上，接收线程与应用线程入队后按门铃
+ *
+ */
+static ring_doorbell_t pipeline_doorbell;
+
+static buf_t pipeline_capture; // 接收线程私有的缓冲区，在启动线程前分配
+
+/**
+ * @brief 接收线程：取一个空闲的帧缓冲区，收到帧后拷贝进去交给协议线程
+ *        没有空闲缓冲区时让出CPU，帧留在内核中；各网卡轮流接收，都暂无数据包时阻塞等待
+ *
+ * @param arg 协议线程的协议栈，只读取其网卡表
+ * @return void* 不返回
+ */
+static void *pipeline_rx_thread(void *arg)
+{
+    net_stack_t *stack = arg;
+    buf_t *frame = NULL;
+    int if_next = 0, idle = 0;
+    while (1)
+    {
+        if (frame == NULL && (frame = ring_dequeue(&rx_free_ring)) == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        int len = driver_recv(&stack->ifs[if_next], &pipeline_capture);
+        if_next = (if_next + 1) % stack->if_num;
+        if (len == 0)
+        {
+            if (++idle >= stack->if_num)
+            {
+                driver_wait(NET_WAIT_MAX_MS);
+                idle = 0;
+            }
+            continue;
+        }
+        idle = 0;
+        if (len < 0)
+            continue;
+        if (len + BUF_DEFAULT_HEADROOM >= frame->size) // 超出帧缓冲区的巨型帧无法在不分配的情况下装下，丢弃
+            continue;
+        buf_init(frame, len); // 帧缓冲区足够大且未共享，不会分配
+        memcpy(frame->data, pipeline_capture.data, len);
+        frame->if_id = pipeline_capture.if_id;
+        ring_enqueue(&rx_ring, frame); // 帧缓冲区总数等于队列容量，不会满
+        frame = NULL;
+        ring_doorbell_ring(&pipeline_doorbell);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 协议线程执行一个发送请求，tcp连接暂时写不下时只写入一部分
+ *
+ * @param stack 协议线程的协议栈
+ * @param send 发送请求
+ * @return int 请求已完成为1，连接已关闭而丢弃剩余数据时也为1，还有数据未写入为0
+ */
+static int pipeline_send_run(net_stack_t *stack, pipeline_send_t *send)
+{
+    if (send->type == PIPELINE_SEND_UDP)
+    {
+        udp_send(stack, send->data, send->len, send->local_port, send->ip, send->remote_port);
+        return 1;
+    }
+#ifdef TCP
+    tcp_connect_t *connect = tcp_connect_find(stack, send->ip, send->remote_port, send->local_port);
+    if (connect == NULL)
+    {
+        fprintf(stderr, "Error in pipeline_send_run: tcp connection to %s:%u closed, %zu bytes dropped\n",
+                iptos(send->ip), send->remote_port, send->len - send->sent);
+        return 1;
+    }
+    send->sent += tcp_connect_write(connect, send->data + send->sent, send->len - send->sent);
+    return send->sent == send->len;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief 判断等待链表中排在send之前是否还有写往同一tcp连接的请求，有则send须继续等待以保持数据顺序
+ *
+ * @param send 要判断的请求
+ * @return int 须等待为1，否则为0
+ */
+static int pipeline_send_blocked(const pipeline_send_t *send)
+{
+    if (send->type != PIPELINE_SEND_TCP)
+        return 0;
+    for (const pipeline_send_t *prev = send_pending; prev != send; prev = prev->next)
+        if (prev->type == PIPELINE_SEND_TCP && prev->local_port == send->local_port &&
+            prev->remote_port == send->remote_port && memcmp(prev->ip, send->ip, NET_IP_LEN) == 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief 按顺序执行等待链表上的发送请求，完成的送回send_free_ring
+ *
+ * @param stack 协议线程的协议栈
+ * @return size_t 有进展（完成或写入了一部分）的请求个数
+ */
+static size_t pipeline_send_flush(net_stack_t *stack)
+{
+    size_t progress = 0;
+    pipeline_send_t **pp = &send_pending;
+    while (*pp)
+    {
+        pipeline_send_t *send = *pp;
+        size_t sent = send->sent;
+        if (pipeline_send_blocked(send) || !pipeline_send_run(stack, send))
+        {
+            progress += send->sent != sent;
+            pp = &send->next;
+            continue;
+        }
+        progress++;
+        *pp = send->next;
+        ring_enqueue(&send_free_ring, send); // 请求总数等于队列容量，不会满
+    }
+    send_pending_tail = pp;
+    return progress;
+}
+
+/**
+ * @brief 协议线程的一次轮询：运行定时器，处理接收队列中的一批帧与发送队列中的一批请求，再整批发出
+ *        上次没写完的tcp请求排在新请求之前重试
+ *        也是协议线程上net_poll的替代，应用的阻塞循环借此推进协议栈而不直接读网卡
+ *
+ * @param stack 协议线程的协议栈
+ * @return int 处理的帧与发送请求的个数
+ */
+static int pipeline_poll(net_stack_t *stack)
+{
+    buf_t *frames[NET_VECTOR_SIZE];
+    pipeline_send_t *sends[NET_VECTOR_SIZE];
+    net_clock_update();
+    net_timer_poll();
+    map_sweep_poll();
+
+    size_t n = ring_dequeue_burst(&rx_ring, (void **)frames, NET_VECTOR_SIZE);
+    if (n > 0)
+    {
+        ethernet_in_vector(stack, frames, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            buf_init(frames[i], PIPELINE_FRAME_LEN); // 协议处理可能共享了负载，在此重新独占
+            ring_enqueue(&rx_free_ring, frames[i]);
+        }
+    }
+
+    size_t m = ring_dequeue_burst(&send_ring, (void **)sends, NET_VECTOR_SIZE);
+    for (size_t i = 0; i < m; i++)
+    {
+        sends[i]->next = NULL;
+        *send_pending_tail = sends[i];
+        send_pending_tail = &sends[i]->next;
+    }
+    if (send_pending)
+        m = pipeline_send_flush(stack); // 写不下的tcp数据等收到确认后再写，无进展时不计入，以免空转
+    driver_flush();
+    return n + m;
+}
+
+/**
+ * @brief 流水线主循环，当前线程成为协议线程，不再返回
+ *        接收线程收帧，协议线程逐批处理收到的帧、执行应用线程的发送请求并运行定时器，
+ *        应用线程通过net_pipeline_udp_send/net_pipeline_tcp_write发送数据；
+ *        app在协议线程上调用net_poll（如http的阻塞读写）时只处理队列，不与接收线程同时读网卡
+ *
+ * @param stack 协议线程使用的协议栈
+ * @param app 每次轮询之后在协议线程上调用的应用层处理程序，可以为NULL
+ */
+void net_run_pipeline(net_stack_t *stack, net_app_poll_t app)
+{
+    if (ring_doorbell_init(&pipeline_doorbell) < 0 ||
+        ring_init(&rx_ring, NET_PIPELINE_RING_SIZE) < 0 || ring_init(&rx_free_ring, NET_PIPELINE_RING_SIZE) < 0 ||
+        ring_init(&send_ring, NET_PIPELINE_SEND_SIZE) < 0 || ring_init(&send_free_ring, NET_PIPELINE_SEND_SIZE) < 0)
+        return;
+    for (int i = 0; i < NET_PIPELINE_RING_SIZE; i++)
+    {
+        buf_init(&pipeline_frames[i], PIPELINE_FRAME_LEN);
+        ring_enqueue(&rx_free_ring, &pipeline_frames[i]);
+    }
+    for (int i = 0; i < NET_PIPELINE_SEND_SIZE; i++)
+        ring_enqueue(&send_free_ring, &pipeline_sends[i]);
+    buf_init(&pipeline_capture, PIPELINE_CAPTURE_LEN);
+
+    net_clock_set_observe(0); // 缓存的时钟只由协议线程写
+    pthread_t rx_thread;
+    if (pthread_create(&rx_thread, NULL, pipeline_rx_thread, stack) != 0)
+    {
+        fprintf(stderr, "Error in net_run_pipeline: pthread_create\n");
+        return;
+    }
+
+    net_poll_hook_set(pipeline_poll); // 应用在协议线程上调用net_poll时只取队列，网卡只由接收线程读
+    ring_t *rings[] = {&rx_ring, &send_ring};
+    while (1)
+    {
+        int n = pipeline_poll(stack);
+        if (app)
+            app();
+        driver_flush();
+
+        if (n == 0)
+        {
+            int64_t timeout = net_timer_next();
+            if (timeout < 0 || timeout > NET_WAIT_MAX_MS)
+                timeout = NET_WAIT_MAX_MS;
+            if (timeout > 0)
+                ring_doorbell_wait(&pipeline_doorbell, rings, 2, timeout);
+        }
+    }
+}
+
+/**
+ * @brief 应用线程把一个发送请求交给协议线程，可以由多个应用线程同时调用
+ *        取空闲请求与入队各在send_lock下进行，拷贝数据时不持锁
+ * @param type 请求类型
+ * @param ip 对端ip地址
+ * @param local_port 本地端口
+ * @param remote_port 对端端口
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @return int 成功为0，数据过长或请求已用完（包括都在等待tcp写入）为-1
+ */
+static int pipeline_send_post(pipeline_send_type_t type, uint8_t *ip, uint16_t local_port, uint16_t remote_port,
+                              const uint8_t *data, size_t len)
+{
+    if (len > NET_PIPELINE_SEND_MAX_LEN)
+    {
+        fprintf(stderr, "Error in pipeline_send_post: %zu bytes too long\n", len);
+        return -1;
+    }
+    pthread_mutex_lock(&send_lock);
+    pipeline_send_t *send = ring_dequeue(&send_free_ring);
+    pthread_mutex_unlock(&send_lock);
+    if (send == NULL)
+        return -1;
+    send->type = type;
+    memcpy(send->ip, ip, NET_IP_LEN);
+    send->local_port = local_port;
+    send->remote_port = remote_port;
+    send->len = len;
+    send->sent = 0;
+    memcpy(send->data, data, len);
+    pthread_mutex_lock(&send_lock);
+    ring_enqueue(&send_ring, send); // 请求总数等于队列容量，不会满
+    pthread_mutex_unlock(&send_lock);
+    ring_doorbell_ring(&pipeline_doorbell);
+    return 0;
+}
+
+/**
+ * @brief 从应用线程发送一个udp数据包，由协议线程调用udp_send完成，可以由多个应用线程同时调用
+ *
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ * @return int 成功入队为0，否则为-1
+ */
+int net_pipeline_udp_send(const uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    return pipeline_send_post(PIPELINE_SEND_UDP, dst_ip, src_port, dst_port, data, len);
+}
+
+/**
+ * @brief 从应用线程向一个tcp连接写入数据，由协议线程查找连接并调用tcp_connect_write完成
+ *        发送缓存或窗口不足时协议线程保留未写入的部分，收到确认后按顺序继续写入，同一连接的数据不会乱序
+ *        应用线程不持有连接指针，连接在写完之前关闭时剩余数据被丢弃
+ *
+ * @param ip 对端ip地址
+ * @param remote_port 对端端口
+ * @param local_port 本地端口
+ * @param data 要写入的数据
+ * @param len 数据长度
+ * @return int 成功入队为0，否则为-1
+ */
+int net_pipeline_tcp_write(uint8_t *ip, uint16_t remote_port, uint16_t local_port, const uint8_t *data, size_t len)
+{
+    return pipeline_send_post(PIPELINE_SEND_TCP, ip, local_port, remote_port, data, len);
+}
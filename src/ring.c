@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ring.h"
+
+/**
+ * @brief 初始化队列，元素数组只在此分配一次
+ *
+ * @param ring 要初始化的队列
+ * @param size 容量，须为2的幂
+ * @return int 成功为0，失败为-1
+ */
+int ring_init(ring_t *ring, size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+    {
+        fprintf(stderr, "Error in ring_init: size %zu is not a power of 2\n", size);
+        return -1;
+    }
+    if ((ring->slots = calloc(size, sizeof(void *))) == NULL)
+    {
+        fprintf(stderr, "Error in ring_init: out of memory\n");
+        return -1;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->tail_cache = ring->head_cache = 0;
+    ring->mask = size - 1;
+    return 0;
+}
+
+/**
+ * @brief 释放队列的元素数组，不处理其中的元素
+ *
+ * @param ring 要释放的队列
+ */
+void ring_free(ring_t *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/**
+ * @brief 初始化门铃，等待使用单调时钟计时
+ *
+ * @param bell 要初始化的门铃
+ * @return int 成功为0，失败为-1
+ */
+int ring_doorbell_init(ring_doorbell_t *bell)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int ret = pthread_mutex_init(&bell->lock, NULL) || pthread_cond_init(&bell->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    atomic_init(&bell->sleeping, 0);
+    if (ret)
+    {
+        fprintf(stderr, "Error in ring_doorbell_init\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 生产者入队之后调用，唤醒睡眠中的消费者
+ *
+ * @param bell 门铃
+ */
+void ring_doorbell_ring(ring_doorbell_t *bell)
+{
+    atomic_thread_fence(memory_order_seq_cst); // 入队先于检查登记
+    if (atomic_load(&bell->sleeping))
+    {
+        pthread_mutex_lock(&bell->lock);
+        atomic_store(&bell->sleeping, 0);
+        pthread_cond_signal(&bell->cond);
+        pthread_mutex_unlock(&bell->lock);
+    }
+}
+
+/**
+ * @brief 消费者睡在门铃上，直到有生产者向任一队列入队或等待超时
+ *        先登记睡眠再检查队列，与生产者先入队再检查登记相配合，不会漏掉唤醒
+ *
+ * @param bell 门铃
+ * @param rings 消费者的各个队列
+ * @param n 队列个数
+ * @param timeout_ms 最长等待时间，毫秒
+ */
+void ring_doorbell_wait(ring_doorbell_t *bell, ring_t **rings, size_t n, int64_t timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&bell->lock);
+    atomic_store(&bell->sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst); // 登记先于检查队列
+    while (atomic_load(&bell->sleeping))
+    {
+        size_t i = 0;
+        while (i < n && ring_empty(rings[i]))
+            i++;
+        if (i < n || pthread_cond_timedwait(&bell->cond, &bell->lock, &deadline) != 0)
+            break;
+    }
+    atomic_store(&bell->sleeping, 0);
+    pthread_mutex_unlock(&bell->lock);
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include "route.h"
+
+typedef struct route_key //路由规则的键
+{
+    uint32_t prefix; // 前缀，主机字节序，前缀长度之后的位为0
+    uint32_t len;    // 前缀长度
+} route_key_t;
+
+MAP_DEFINE(route_rule_map, route_key_t, uint32_t)
+MAP_DEFINE(route_nexthop_map, net_nexthop_t, uint32_t)
+
+/**
+ * @brief 把ip地址转为主机字节序的32位整数
+ *
+ * @param ip ip地址
+ * @return uint32_t 地址
+ */
+static inline uint32_t route_addr(const uint8_t *ip)
+{
+    return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+}
+
+/**
+ * @brief 获取前缀长度对应的掩码
+ *
+ * @param len 前缀长度，0~32
+ * @return uint32_t 掩码
+ */
+static inline uint32_t route_mask(uint8_t len)
+{
+    return len ? ~0u << (32 - len) : 0;
+}
+
+/**
+ * @brief 生成一个不扩展的表项
+ *
+ * @param depth 前缀长度，为0表示无路由
+ * @param index 下一跳编号+1，为0表示无路由
+ * @return uint32_t 表项
+ */
+static inline uint32_t route_entry(uint8_t depth, uint32_t index)
+{
+    return ((uint32_t)depth << NET_ROUTE_DEPTH_SHIFT) | index;
+}
+
+/**
+ * @brief 获取不扩展的表项的前缀长度
+ *
+ * @param entry 表项
+ * @return uint8_t 前缀长度
+ */
+static inline uint8_t route_entry_depth(uint32_t entry)
+{
+    return (entry >> NET_ROUTE_DEPTH_SHIFT) & 0x3F;
+}
+
+/**
+ * @brief 初始化路由表
+ *        tbl24按需分配零页，只有被路由覆盖的部分才占用物理内存
+ *
+ * @param table 要初始化的路由表
+ * @return int 成功为0，失败为-1
+ */
+int net_route_init(net_route_table_t *table)
+{
+    memset(table, 0, sizeof(net_route_table_t));
+    table->tbl24 = calloc(NET_ROUTE_TBL24_NUM, sizeof(uint32_t));
+    table->tbl8 = calloc((size_t)NET_ROUTE_TBL8_GROUPS * NET_ROUTE_TBL8_SIZE, sizeof(uint32_t));
+    table->tbl8_free = malloc(NET_ROUTE_TBL8_GROUPS * sizeof(uint32_t));
+    if (table->tbl24 == NULL || table->tbl8 == NULL || table->tbl8_free == NULL)
+    {
+        fprintf(stderr, "Error in net_route_init: out of memory\n");
+        free(table->tbl24);
+        free(table->tbl8);
+        free(table->tbl8_free);
+        return -1;
+    }
+    for (uint32_t i = 0; i < NET_ROUTE_TBL8_GROUPS; i++)
+        table->tbl8_free[table->tbl8_free_num++] = NET_ROUTE_TBL8_GROUPS - 1 - i;
+    route_rule_map_init(&table->rules, 0, 0);
+    route_nexthop_map_init(&table->nexthop_map, 0, 0);
+    return 0;
+}
+
+/**
+ * @brief 查找或登记一个下一跳
+ *
+ * @param table 路由表
+ * @param nexthop 下一跳
+ * @return long 下一跳编号，失败为-1
+ */
+static long route_nexthop_get(net_route_table_t *table, const net_nexthop_t *nexthop)
+{
+    net_nexthop_t key;
+    memset(&key, 0, sizeof(key)); // 结构体的填充字节也是键的一部分
+    memcpy(key.gateway, nexthop->gateway, sizeof(key.gateway));
+    key.mtu = nexthop->mtu;
+    key.if_id = nexthop->if_id;
+    uint32_t *index = route_nexthop_map_get(&table->nexthop_map, &key);
+    if (index)
+        return *index;
+    if (table->nexthop_num >= NET_ROUTE_INDEX_MASK - 1)
+        return -1;
+    if (table->nexthop_num == table->nexthop_cap)
+    {
+        size_t cap = table->nexthop_cap ? table->nexthop_cap * 2 : 16;
+        net_nexthop_t *nexthops = realloc(table->nexthops, cap * sizeof(net_nexthop_t));
+        if (nexthops == NULL)
+            return -1;
+        table->nexthops = nexthops;
+        table->nexthop_cap = cap;
+    }
+    uint32_t new_index = table->nexthop_num;
+    if (route_nexthop_map_set(&table->nexthop_map, &key, &new_index) < 0)
+        return -1;
+    table->nexthops[table->nexthop_num++] = key;
+    return new_index;
+}
+
+/**
+ * @brief 更新一段连续的表项：添加时覆盖前缀长度不超过depth的表项，删除时把前缀长度等于depth的表项换成entry
+ *
+ * @param entries 表项
+ * @param num 表项个数
+ * @param depth 添加或删除的前缀长度
+ * @param entry 新表项
+ * @param del 为1时删除，为0时添加
+ */
+static void route_update_entries(uint32_t *entries, size_t num, uint8_t depth, uint32_t entry, int del)
+{
+    for (size_t i = 0; i < num; i++)
+    {
+        uint8_t old = route_entry_depth(entries[i]);
+        if (del ? old == depth : old <= depth)
+            entries[i] = entry;
+    }
+}
+
+/**
+ * @brief 获取tbl8组的表项
+ *
+ * @param table 路由表
+ * @param group 组号
+ * @return uint32_t* 组的第一个表项
+ */
+static inline uint32_t *route_tbl8_group(net_route_table_t *table, uint32_t group)
+{
+    return &table->tbl8[(size_t)group * NET_ROUTE_TBL8_SIZE];
+}
+
+/**
+ * @brief 更新一个前缀覆盖的全部表项，前缀不长于24位时遍历tbl24，更长时在其/24所在的tbl8组内更新
+ *
+ * @param table 路由表
+ * @param addr 前缀
+ * @param len 前缀长度，1~32
+ * @param entry 新表项
+ * @param del 为1时删除，为0时添加
+ * @return int 成功为0，tbl8组用尽时为-1
+ */
+static int route_update(net_route_table_t *table, uint32_t addr, uint8_t len, uint32_t entry, int del)
+{
+    if (len <= 24)
+    {
+        size_t start = addr >> 8, num = (size_t)1 << (24 - len);
+        for (size_t i = start; i < start + num; i++)
+        {
+            if (table->tbl24[i] & NET_ROUTE_EXT)
+                route_update_entries(route_tbl8_group(table, table->tbl24[i] & NET_ROUTE_INDEX_MASK), NET_ROUTE_TBL8_SIZE, len, entry, del);
+            else
+                route_update_entries(&table->tbl24[i], 1, len, entry, del);
+        }
+        return 0;
+    }
+
+    uint32_t *slot = &table->tbl24[addr >> 8];
+    if (!(*slot & NET_ROUTE_EXT))
+    {
+        if (del)
+            return 0;
+        if (table->tbl8_free_num == 0)
+        {
+            fprintf(stderr, "Error in net_route_add: out of tbl8 groups\n");
+            return -1;
+        }
+        uint32_t group = table->tbl8_free[--table->tbl8_free_num];
+        uint32_t *entries = route_tbl8_group(table, group);
+        for (size_t i = 0; i < NET_ROUTE_TBL8_SIZE; i++) // 组内先继承原来覆盖整个/24的路由，填好之后再挂到tbl24上
+            entries[i] = *slot;
+        *slot = NET_ROUTE_EXT | group;
+    }
+    uint32_t group = *slot & NET_ROUTE_INDEX_MASK;
+    uint32_t *entries = route_tbl8_group(table, group);
+    route_update_entries(entries + (addr & 0xFF), (size_t)1 << (32 - len), len, entry, del);
+    if (del)
+    {
+        for (size_t i = 0; i < NET_ROUTE_TBL8_SIZE; i++)
+            if (route_entry_depth(entries[i]) > 24)
+                return 0;
+        *slot = entries[0]; // 组内不再有长于24位的前缀，各表项相同，收回到tbl24
+        table->tbl8_free[table->tbl8_free_num++] = group;
+    }
+    return 0;
+}
+
+/**
+ * @brief 添加或替换一条路由，路由表只由一个线程修改，应在启动工作线程之前完成
+ *
+ * @param table 路由表
+ * @param prefix 前缀，前缀长度之后的位被忽略
+ * @param len 前缀长度，0为默认路由
+ * @param nexthop 下一跳
+ * @return int 成功为0，失败为-1
+ */
+int net_route_add(net_route_table_t *table, const uint8_t *prefix, uint8_t len, const net_nexthop_t *nexthop)
+{
+    if (len > 32)
+        return -1;
+    long index = route_nexthop_get(table, nexthop);
+    if (index < 0)
+    {
+        fprintf(stderr, "Error in net_route_add: too many next hops\n");
+        return -1;
+    }
+    if (len == 0)
+    {
+        table->default_index = index + 1;
+        return 0;
+    }
+    route_key_t key = {route_addr(prefix) & route_mask(len), len};
+    uint32_t value = index;
+    if (route_update(table, key.prefix, len, route_entry(len, index + 1), 0) < 0 ||
+        route_rule_map_set(&table->rules, &key, &value) < 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief 删除一条路由，被它覆盖的地址改由次长的匹配前缀覆盖
+ *
+ * @param table 路由表
+ * @param prefix 前缀，前缀长度之后的位被忽略
+ * @param len 前缀长度，0为默认路由
+ * @return int 成功为0，路由不存在为-1
+ */
+int net_route_delete(net_route_table_t *table, const uint8_t *prefix, uint8_t len)
+{
+    if (len > 32)
+        return -1;
+    if (len == 0)
+    {
+        if (table->default_index == 0)
+            return -1;
+        table->default_index = 0;
+        return 0;
+    }
+    route_key_t key = {route_addr(prefix) & route_mask(len), len};
+    if (route_rule_map_get(&table->rules, &key) == NULL)
+        return -1;
+    route_rule_map_delete(&table->rules, &key);
+
+    uint32_t cover = route_entry(0, 0);
+    for (uint8_t l = len - 1; l > 0; l--)
+    {
+        route_key_t cover_key = {key.prefix & route_mask(l), l};
+        uint32_t *index = route_rule_map_get(&table->rules, &cover_key);
+        if (index)
+        {
+            cover = route_entry(l, *index + 1);
+            break;
+        }
+    }
+    return route_update(table, key.prefix, len, cover, 1);
+}
@@ -0,0 +1,292 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "shard.h"
+#include "ring.h"
+#include "net.h"
+#include "stack.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "tcp.h"
+#include "mempool.h"
+#include "timer.h"
+#include "clock.h"
+
+#define SHARD_FRAME_LEN (ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t)) // 帧缓冲区按最大以太网帧准备，更长的帧丢弃
+#define SHARD_CAPTURE_LEN UINT16_MAX                                          // 分发线程私有缓冲区的大小，容纳任一抓到的帧
+#define SHARD_TUPLE_LEN (2 * NET_IP_LEN + 2 * sizeof(uint16_t))               // 哈希输入：源ip、目的ip、源端口、目的端口
+#define SHARD_KEY_LEN 40                                                      // Toeplitz哈希密钥长度
+
+typedef struct net_shard //一个工作线程（分片），独占一份协议栈状态
+{
+    net_stack_t stack;                 // 本分片的协议栈，由工作线程初始化
+    ring_t rx_ring;                    // 分发线程送来的帧
+    ring_t free_ring;                  // 处理完送回分发线程的帧缓冲区
+    ring_doorbell_t doorbell;          // 分片空闲时睡在门铃上
+    buf_t frames[NET_SHARD_RING_SIZE]; // 帧缓冲区，由本分片分配和重新初始化
+    pthread_t thread;
+} net_shard_t;
+
+static net_shard_t net_shards[NET_SHARD_NUM];
+static atomic_int shard_ready;      // 已经准备好帧缓冲区的分片个数
+static net_app_poll_t shard_app;    // 每个分片每次轮询之后调用的应用层处理程序
+static net_stack_t *shard_template; // 各分片从中复制端口的处理程序
+static buf_t shard_capture;         // 分发线程私有的缓冲区
+static _Thread_local net_shard_t *shard_self; // 本线程的分片，供shard_poll找到自己的队列
+
+/**
+ * @brief Toeplitz哈希密钥，使用常见网卡RSS的默认密钥
+ *
+ */
+static const uint8_t shard_key[SHARD_KEY_LEN] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+/**
+ * @brief 按输入的字节位置和取值预先算好的Toeplitz哈希，哈希时每字节查一次表
+ *
+ */
+static uint32_t shard_toeplitz[SHARD_TUPLE_LEN][256];
+
+/**
+ * @brief 取密钥从第bit位开始的32位
+ *
+ * @param bit 起始位，高位在前
+ * @return uint32_t 32位窗口
+ */
+static uint32_t shard_key_window(size_t bit)
+{
+    uint32_t window = 0;
+    for (size_t i = bit; i < bit + 32; i++)
+        window = (window << 1) | ((shard_key[i / 8] >> (7 - i % 8)) & 1);
+    return window;
+}
+
+/**
+ * @brief 初始化Toeplitz哈希表
+ *
+ */
+static void shard_toeplitz_init()
+{
+    for (size_t i = 0; i < SHARD_TUPLE_LEN; i++)
+        for (size_t v = 0; v < 256; v++)
+        {
+            uint32_t hash = 0;
+            for (size_t b = 0; b < 8; b++)
+                if (v & (0x80 >> b))
+                    hash ^= shard_key_window(i * 8 + b);
+            shard_toeplitz[i][v] = hash;
+        }
+}
+
+/**
+ * @brief 计算一个流的Toeplitz哈希，与网卡RSS对同样输入的结果一致
+ *
+ * @param tuple 按网络字节序排列的源ip、目的ip、源端口、目的端口
+ * @param len 输入长度，不超过SHARD_TUPLE_LEN
+ * @return uint32_t 哈希值
+ */
+uint32_t net_shard_hash(const uint8_t *tuple, size_t len)
+{
+    if (shard_toeplitz[0][1] == 0)
+        shard_toeplitz_init();
+    uint32_t hash = 0;
+    for (size_t i = 0; i < len && i < SHARD_TUPLE_LEN; i++)
+        hash ^= shard_toeplitz[i][tuple[i]];
+    return hash;
+}
+
+/**
+ * @brief 为一个帧选择分片：TCP按地址和端口哈希，其余IP流量（包括UDP）只按地址哈希
+ *        UDP的数据报可能分片，只有首个分片带端口，按地址哈希才能让同一个流的整包与分片都落在同一分片上重组；
+ *        TCP靠MSS避免分片，偶有分片时只按地址哈希，与网卡RSS的做法相同。ARP响应复制给所有分片，使各分片的arp表都能学到；其余流量交给NET_SHARD_CONTROL
+ *
+ * @param frame 帧数据
+ * @param len 帧长度
+ * @return int 分片序号，为-1表示复制给所有分片
+ */
+static int shard_select(const uint8_t *frame, size_t len)
+{
+    if (len < sizeof(ether_hdr_t))
+        return NET_SHARD_CONTROL;
+    const ether_hdr_t *eth = (const ether_hdr_t *)frame;
+    uint16_t protocol = swap16(eth->protocol16);
+    frame += sizeof(ether_hdr_t);
+    len -= sizeof(ether_hdr_t);
+
+    if (protocol == NET_PROTOCOL_ARP)
+    {
+        const arp_pkt_t *arp = (const arp_pkt_t *)frame;
+        if (len >= sizeof(arp_pkt_t) && swap16(arp->opcode16) == ARP_REPLY)
+            return -1;
+        return NET_SHARD_CONTROL;
+    }
+    if (protocol != NET_PROTOCOL_IP || len < sizeof(ip_hdr_t))
+        return NET_SHARD_CONTROL;
+
+    const ip_hdr_t *ip = (const ip_hdr_t *)frame;
+    uint8_t tuple[SHARD_TUPLE_LEN] = {0};
+    memcpy(tuple, ip->src_ip, NET_IP_LEN);
+    memcpy(tuple + NET_IP_LEN, ip->dst_ip, NET_IP_LEN);
+    size_t hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+    int fragment = swap16(ip->flags_fragment16) & (IP_MORE_FRAGMENT | IP_FRAGMENT_OFFSET_MASK);
+    if (!fragment && ip->protocol == NET_PROTOCOL_TCP && len >= hdr_len + 2 * sizeof(uint16_t))
+        memcpy(tuple + 2 * NET_IP_LEN, frame + hdr_len, 2 * sizeof(uint16_t)); // tcp头部以源端口、目的端口开头
+    return net_shard_hash(tuple, SHARD_TUPLE_LEN) % NET_SHARD_NUM;
+}
+
+/**
+ * @brief 把分发线程收到的帧拷贝进分片的一个帧缓冲区并交给该分片，分片的帧缓冲区用完时丢弃
+ *
+ * @param shard 目标分片
+ * @param capture 收到的帧
+ */
+static void shard_deliver(net_shard_t *shard, const buf_t *capture)
+{
+    buf_t *frame = ring_dequeue(&shard->free_ring);
+    if (frame == NULL)
+        return;
+    buf_init(frame, capture->len); // 帧缓冲区足够大且未共享，不会分配
+    memcpy(frame->data, capture->data, capture->len);
+    frame->if_id = capture->if_id;
+    ring_enqueue(&shard->rx_ring, frame); // 帧缓冲区总数等于队列容量，不会满
+    ring_doorbell_ring(&shard->doorbell);
+}
+
+/**
+ * @brief 分片的一次轮询：运行定时器，处理接收队列中的一批帧，再整批发出
+ *        也是工作线程上net_poll的替代，分片从不直接读网卡，应用的阻塞循环借此推进本分片的协议栈
+ *
+ * @param stack 调用者传入的协议栈，未使用，总是处理本分片的协议栈
+ * @return int 处理的帧个数
+ */
+static int shard_poll(net_stack_t *stack)
+{
+    net_shard_t *shard = shard_self;
+    buf_t *frames[NET_VECTOR_SIZE];
+    net_clock_update();
+    net_timer_poll();
+    map_sweep_poll();
+
+    size_t n = ring_dequeue_burst(&shard->rx_ring, (void **)frames, NET_VECTOR_SIZE);
+    if (n > 0)
+    {
+        ethernet_in_vector(&shard->stack, frames, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            buf_init(frames[i], SHARD_FRAME_LEN); // 协议处理可能共享了负载，在此重新独占
+            ring_enqueue(&shard->free_ring, frames[i]);
+        }
+    }
+    driver_flush();
+    return n;
+}
+
+/**
+ * @brief 分片的工作线程：初始化本分片的协议栈，然后逐批处理分发来的帧并运行自己的定时器
+ *        arp表、连接表与发送缓冲区在分片的协议栈中，内存池、时钟与定时器是线程局部的，快路径上没有锁
+ *
+ * @param arg 分片
+ * @return void* 不返回
+ */
+static void *shard_thread(void *arg)
+{
+    net_shard_t *shard = arg;
+    mempool_init();
+    net_clock_update();
+    net_timer_init();
+    net_stack_init(&shard->stack);
+    memcpy(shard->stack.udp_table, shard_template->udp_table, sizeof(shard->stack.udp_table));
+    memcpy(shard->stack.tcp_table, shard_template->tcp_table, sizeof(shard->stack.tcp_table));
+    memcpy(shard->stack.ifs, shard_template->ifs, sizeof(shard->stack.ifs)); // 网卡与路由表由各分片共享，分片只发送，各后端的发送是加锁的
+    shard->stack.if_num = shard_template->if_num;
+    shard->stack.routes = shard_template->routes;
+    for (int i = 0; i < NET_SHARD_RING_SIZE; i++)
+    {
+        buf_init(&shard->frames[i], SHARD_FRAME_LEN);
+        ring_enqueue(&shard->free_ring, &shard->frames[i]);
+    }
+    shard_self = shard;
+    net_poll_hook_set(shard_poll); // 网卡只由分发线程读，应用在分片上调用net_poll时只取本分片的队列
+    atomic_fetch_add(&shard_ready, 1);
+
+    ring_t *rings[] = {&shard->rx_ring};
+    while (1)
+    {
+        int n = shard_poll(&shard->stack);
+        if (shard_app)
+            shard_app();
+        driver_flush();
+
+        if (n == 0)
+        {
+            int64_t timeout = net_timer_next();
+            if (timeout < 0 || timeout > NET_WAIT_MAX_MS)
+                timeout = NET_WAIT_MAX_MS;
+            if (timeout > 0)
+                ring_doorbell_wait(&shard->doorbell, rings, 1, timeout);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 分片主循环，当前线程成为分发线程，不再返回
+ *        启动NET_SHARD_NUM个工作线程，每收到一帧按流哈希交给其中一个，同一个流总是由同一个分片处理。
+ *        端口的处理程序在启动前注册到stack，各分片启动时复制一份；
+ *        app在分片上调用net_poll（如http的阻塞读写）时只处理本分片的队列，分片从不直接读网卡
+ *
+ * @param stack 注册了端口处理程序的协议栈
+ * @param app 每个分片每次轮询之后在该分片上调用的应用层处理程序，可以为NULL
+ */
+void net_run_sharded(net_stack_t *stack, net_app_poll_t app)
+{
+    shard_app = app;
+    shard_template = stack;
+    shard_toeplitz_init();
+    for (int i = 0; i < NET_SHARD_NUM; i++)
+    {
+        net_shard_t *shard = &net_shards[i];
+        if (ring_init(&shard->rx_ring, NET_SHARD_RING_SIZE) < 0 || ring_init(&shard->free_ring, NET_SHARD_RING_SIZE) < 0 ||
+            ring_doorbell_init(&shard->doorbell) < 0)
+            return;
+        if (pthread_create(&shard->thread, NULL, shard_thread, shard) != 0)
+        {
+            fprintf(stderr, "Error in net_run_sharded: pthread_create\n");
+            return;
+        }
+    }
+    while (atomic_load(&shard_ready) < NET_SHARD_NUM)
+        sched_yield();
+    buf_init(&shard_capture, SHARD_CAPTURE_LEN);
+
+    int if_next = 0, idle = 0;
+    while (1)
+    {
+        int len = driver_recv(&stack->ifs[if_next], &shard_capture);
+        if_next = (if_next + 1) % stack->if_num;
+        if (len == 0)
+        {
+            if (++idle >= stack->if_num) // 各网卡都暂无数据包
+            {
+                driver_wait(NET_WAIT_MAX_MS);
+                idle = 0;
+            }
+            continue;
+        }
+        idle = 0;
+        if (len < 0 || len > SHARD_FRAME_LEN)
+            continue;
+        int target = shard_select(shard_capture.data, len);
+        if (target >= 0)
+            shard_deliver(&net_shards[target], &shard_capture);
+        else
+            for (int i = 0; i < NET_SHARD_NUM; i++)
+                shard_deliver(&net_shards[i], &shard_capture);
+    }
+}
@@ -3,6 +3,7 @@
 #include "tcp.h"
 #include "ip.h"
 #include "icmp.h"
+#include "stack.h"
 
 static void panic(const char* msg, int line) {
     printf("panic %s! at line %d\n", msg, line);
@@ -22,15 +23,13 @@ static void display_flags(tcp_flags_t flags) {
     );
 }
 
-// dst-port -> handler
-static map_t tcp_table; //tcp_table里面放了一个dst_port的回调函数
+MAP_DEFINE(tcp_connect_map, tcp_key_t, tcp_connect_t)
 
-// tcp_key_t[IP, src port, dst port] -> tcp_connect_t
+// 协议栈的tcp_table: dst-port -> handler，按dst_port直接索引回调函数，为NULL表示端口未打开
 
-/* Connect_table放置了一堆TCP连接，
+/* 协议栈的connect_table放置了一堆TCP连接，
     KEY为[IP，src port，dst port], 即tcp_key_t，VALUE为tcp_connect_t。
 */
-static map_t connect_table; 
 
 /**
  * @brief 生成一个用于 connect_table 的 key
@@ -48,14 +47,21 @@ static tcp_key_t new_tcp_key(uint8_t ip[NET_IP_LEN], uint16_t src_port, uint16_t
     return key;
 }
 
+/**
+ * @brief 初始化协议栈的连接表
+ *
+ * @param stack 协议栈
+ */
+void tcp_stack_init(net_stack_t* stack) {
+    tcp_connect_map_init(&stack->connect_table, 0, 0);
+}
+
 /**
  * @brief 初始化tcp在静态区的map
  *        供应用层使用
  *
  */
 void tcp_init() {
-    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL);
-    map_init(&connect_table, sizeof(tcp_key_t), sizeof(tcp_connect_t), 0, 0, NULL);
     net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
 }
 
@@ -63,13 +69,15 @@ void tcp_init() {
  * @brief 向 port 注册一个 TCP 连接以及关联的回调函数
  *        供应用层使用
  *
+ * @param stack
  * @param port
  * @param handler
  * @return int
  */
-int tcp_open(uint16_t port, tcp_handler_t handler) {
+int tcp_open(net_stack_t* stack, uint16_t port, tcp_handler_t handler) {
     printf("tcp open\n");
-    return map_set(&tcp_table, &port, &handler);
+    stack->tcp_table[port] = handler;
+    return 0;
 }
 
 /**
@@ -80,11 +88,14 @@ int tcp_open(uint16_t port, tcp_handler_t handler) {
  */
 static void init_tcp_connect_rcvd(tcp_connect_t* connect) {
     if (connect->state == TCP_LISTEN) {
-        connect->rx_buf = malloc(sizeof(buf_t));
-        connect->tx_buf = malloc(sizeof(buf_t));
+        connect->rx_buf = buf_alloc(0);
+        connect->tx_buf = buf_alloc(0);
+    } else {
+        buf_init(connect->rx_buf, 0);
+        buf_init(connect->tx_buf, 0);
     }
-    buf_init(connect->rx_buf, 0);
-    buf_init(connect->tx_buf, 0);
+    buf_reserve(connect->rx_buf, 0); // 收发缓存只在尾部追加数据，无需头部空间
+    buf_reserve(connect->tx_buf, 0);
     connect->state = TCP_SYN_RCVD;
 }
 
@@ -98,11 +109,11 @@ static void release_tcp_connect(tcp_connect_t* connect) {
     if (connect->state == TCP_LISTEN)
         return;
     if (connect->rx_buf){
-        free(connect->rx_buf);
+        buf_free(connect->rx_buf);
         connect->rx_buf = NULL;
     }
     if (connect->tx_buf){
-        free(connect->tx_buf);
+        buf_free(connect->tx_buf);
         connect->tx_buf = NULL;
     }
     connect->state = TCP_LISTEN;
@@ -110,30 +121,26 @@ static void release_tcp_connect(tcp_connect_t* connect) {
 
 static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip) {
     uint16_t len = (uint16_t)buf->len;
-    tcp_peso_hdr_t* peso_hdr = (tcp_peso_hdr_t*)(buf->data - sizeof(tcp_peso_hdr_t));
-    tcp_peso_hdr_t pre; //暂存被覆盖的IP头
-    memcpy(&pre, peso_hdr, sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN);
-    memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN);
-    peso_hdr->placeholder = 0;
-    peso_hdr->protocol = NET_PROTOCOL_TCP;
-    peso_hdr->total_len16 = swap16(len);
-    uint16_t checksum = checksum16((uint16_t*)peso_hdr, len + sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr, &pre, sizeof(tcp_peso_hdr_t));
-    return checksum;
+    tcp_peso_hdr_t peso_hdr; //伪头部单独累加，数据包可以是分段的
+    memcpy(peso_hdr.src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso_hdr.dst_ip, dst_ip, NET_IP_LEN);
+    peso_hdr.placeholder = 0;
+    peso_hdr.protocol = NET_PROTOCOL_TCP;
+    peso_hdr.total_len16 = swap16(len);
+    uint32_t sum = checksum16_partial(0, &peso_hdr, sizeof(tcp_peso_hdr_t), 0);
+    return buf_checksum16(buf, len, sum);
 }
 
-static _Thread_local uint16_t delete_port;
-
 /**
- * @brief tcp_close使用这个函数来查找可以关闭的连接，使用thread-local变量delete_port传递端口号。
+ * @brief tcp_close使用这个函数来查找可以关闭的连接，端口号由map_foreach_arg传入。
  *
  * @param key,value,timestamp
+ * @param arg 要关闭的端口号
  */
-static void close_port_fn(void* key, void* value, time_t* timestamp) {
+static void close_port_fn(void* key, void* value, time_t* timestamp, void* arg) {
     tcp_key_t* tcp_key = key;
     tcp_connect_t* connect = value;
-    if (tcp_key->dst_port == delete_port) {
+    if (tcp_key->dst_port == *(uint16_t*)arg) {
         release_tcp_connect(connect);
     }
 }
@@ -147,15 +154,18 @@ static void close_port_fn(void* key, void* value, time_t* timestamp) {
  * @return uint16_t 字节数
  */
 static uint16_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
-    uint8_t* dst = connect->rx_buf->data + connect->rx_buf->len;
-    buf_add_padding(connect->rx_buf, buf->len);
+    // rx_buf空间不足时会迁移到更大的缓冲区，因此要在扩展之后再计算写入位置
+    if (buf_add_padding(connect->rx_buf, buf->len) != 0)
+        return 0;
+    uint8_t* dst = connect->rx_buf->data + connect->rx_buf->len - buf->len;
     memcpy(dst, buf->data, buf->len);
     connect->ack += buf->len;
     return buf->len;
 }
 
 /**
- * @brief 把connect内tx_buf的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ * @brief 把connect内tx_buf的数据挂到buf上供tcp_send使用，buf原来的内容会无效。
+ *        数据以分段的形式引用tx_buf，不拷贝。
  *
  * @param connect
  * @param buf
@@ -166,8 +176,10 @@ static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
     // sent 为已经发送的数据，len - sent是还没有发送的数据
     uint16_t sent = connect->next_seq - connect->unack_seq;
     uint16_t size = min32(connect->tx_buf->len - sent, connect->remote_win);
-    buf_init(buf, size);
-    memcpy(buf->data, connect->tx_buf->data + sent, size);
+    buf_init(buf, 0);
+    buf_reserve(buf, TCP_HEADROOM);
+    if (size > 0 && buf_append_ref(buf, connect->tx_buf, sent, size) < 0)
+        return 0;
     connect->next_seq += size;
     return size;
 }
@@ -197,8 +209,16 @@ static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
     hdr->window_size16 = swap16(connect->remote_win);
     hdr->chunksum16 = 0;
     hdr->urgent_pointer16 = 0;
-    hdr->chunksum16 = tcp_checksum(buf, connect->ip, net_if_ip);
-    ip_out(buf, connect->ip, NET_PROTOCOL_TCP);
+    uint8_t *src_ip = ip_src_addr(connect->stack, connect->ip);
+    if (src_ip)
+    {
+        hdr->chunksum16 = tcp_checksum(buf, connect->ip, src_ip);
+        ip_out(connect->stack, buf, connect->ip, NET_PROTOCOL_TCP);
+    }
+    else
+        fprintf(stderr, "Error in tcp_send: no route to %s\n", iptos(connect->ip));
+    // 发送完成后释放对tx_buf的引用，避免之后写tx_buf时触发写时复制
+    buf_release(buf);
     // 如果发送的包含有syn或者fin标记位，需要加1
     if (flags.syn || flags.fin) {
         connect->next_seq += 1;
@@ -213,15 +233,16 @@ static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
  * @param connect
  */
 void tcp_connect_close(tcp_connect_t* connect) {
+    buf_t* txbuf = &connect->stack->txbuf;
     if (connect->state == TCP_ESTABLISHED) {
-        tcp_write_to_buf(connect, &txbuf);
-        tcp_send(&txbuf, connect, tcp_flags_ack_fin);
+        tcp_write_to_buf(connect, txbuf);
+        tcp_send(txbuf, connect, tcp_flags_ack_fin);
         connect->state = TCP_FIN_WAIT_1;
         return;
     }
     tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
     release_tcp_connect(connect);
-    map_delete(&connect_table, &key);
+    tcp_connect_map_delete(&connect->stack->connect_table, &key);
 }
 
 /**
@@ -251,6 +272,24 @@ size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
     return size;
 }
 
+/**
+ * @brief 按对端地址和本地端口查找一个已分配收发缓存的连接
+ *        供不能持有连接指针的使用者（如流水线模式下的应用线程）使用
+ *
+ * @param stack 协议栈
+ * @param ip 对端ip地址
+ * @param remote_port 对端端口
+ * @param local_port 本地端口
+ * @return tcp_connect_t* 找到的连接，不存在或尚未建立时为NULL
+ */
+tcp_connect_t* tcp_connect_find(net_stack_t* stack, uint8_t* ip, uint16_t remote_port, uint16_t local_port) {
+    tcp_key_t key = new_tcp_key(ip, remote_port, local_port);
+    tcp_connect_t* connect = tcp_connect_map_get(&stack->connect_table, &key);
+    if (connect == NULL || connect->tx_buf == NULL)
+        return NULL;
+    return connect;
+}
+
 /**
  * @brief 往connect的tx_buf里面写东西，返回成功的字节数，这里要判断窗口够不够，否则图片显示不全。
  *        供应用层使用
@@ -262,23 +301,27 @@ size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
 size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len) {
     printf("tcp_connect_write size: %zu\n", len);
     buf_t* tx_buf = connect->tx_buf;
-
-    uint8_t* dst = tx_buf->data + tx_buf->len;
-    size_t size = min32(&tx_buf->payload[BUF_MAX_LEN] - dst, len);
+    // tx_buf会按需迁移到更大的缓冲区，最多到BUF_MAX_LEN，写入量不超过那时尾部的空间，只写入一部分时返回实际写入的字节数
+    size_t used = tx_buf->data - tx_buf->payload + tx_buf->len;
+    size_t size = used + 1 < BUF_MAX_LEN ? min32(BUF_MAX_LEN - used - 1, len) : 0;
 
     if (connect->next_seq - connect->unack_seq + len >= connect->remote_win) {
         return 0;
     }
     // 如果尾部没有空间，就将原有数据移动到头部
-    if (buf_add_padding(tx_buf, size) != 0) {
+    if (size == 0) {
+        buf_unshare(tx_buf);
         memmove(tx_buf->payload, tx_buf->data, tx_buf->len);
         tx_buf->data = tx_buf->payload;
-        if (tcp_write_to_buf(connect, &txbuf)) {
-            tcp_send(&txbuf, connect, tcp_flags_ack);
+        if (tcp_write_to_buf(connect, &connect->stack->txbuf)) {
+            tcp_send(&connect->stack->txbuf, connect, tcp_flags_ack);
         }
         return 0;
     }
-    memcpy(dst, data, size);
+    if (buf_add_padding(tx_buf, size) != 0) {
+        return 0;
+    }
+    memcpy(tx_buf->data + tx_buf->len - size, data, size);
     return size;
 }
 
@@ -286,12 +329,12 @@ size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len
  * @brief 关闭 port 上的 TCP 连接
  *        供应用层使用
  *
+ * @param stack
  * @param port
  */
-void tcp_close(uint16_t port) {
-    delete_port = port;
-    map_foreach(&connect_table, close_port_fn);
-    map_delete(&tcp_table, &port);
+void tcp_close(net_stack_t* stack, uint16_t port) {
+    map_foreach_arg(&stack->connect_table, close_port_fn, &port);
+    stack->tcp_table[port] = NULL;
 }
 
 /**
@@ -302,7 +345,7 @@ void tcp_close(uint16_t port) {
  */
 void close_tcp(tcp_connect_t * connect, tcp_key_t *tcp_key) {
     release_tcp_connect(connect);
-    map_delete(&connect_table, tcp_key);
+    tcp_connect_map_delete(&connect->stack->connect_table, tcp_key);
 }
 
 /**
@@ -315,18 +358,21 @@ void reset_tcp(tcp_connect_t * connect, uint32_t seq_num) {
     printf("!!! reset tcp !!!\n");
     connect->next_seq = 0;
     connect->ack = seq_num + 1;
-    buf_init(&txbuf, 0);
-    tcp_send(&txbuf, connect, tcp_flags_ack_rst);
+    buf_t* txbuf = &connect->stack->txbuf;
+    buf_init(txbuf, 0);
+    buf_reserve(txbuf, TCP_HEADROOM);
+    tcp_send(txbuf, connect, tcp_flags_ack_rst);
 }
 
 
 /**
  * @brief 服务器端TCP收包
  *
+ * @param stack
  * @param buf
  * @param src_ip
  */
-void tcp_in(buf_t* buf, uint8_t* src_ip) {
+void tcp_in(net_stack_t* stack, buf_t* buf, uint8_t* src_ip) {
     printf("<<< tcp_in >>>\n");
 
     /*
@@ -345,7 +391,7 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     display_flags(tcp_hdr->flags);
     uint16_t origin_checksum = tcp_hdr->chunksum16;
     tcp_hdr->chunksum16 = 0;
-    if (origin_checksum != tcp_checksum(buf, src_ip, net_if_ip)) return;
+    if (origin_checksum != tcp_checksum(buf, src_ip, stack->ifs[buf->if_id].ip)) return;
     tcp_hdr->chunksum16 = origin_checksum;
 
     /*
@@ -362,16 +408,16 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
 
 
     /*
-    4、调用map_get函数，根据destination port查找对应的handler函数
+    4、根据destination port在tcp_table中查找对应的handler函数
     */
 
     // TODO
-    tcp_handler_t *handler = NULL;
-    if ((handler = map_get(&tcp_table, &dst_port)) == NULL)
+    tcp_handler_t *handler = &stack->tcp_table[dst_port];
+    if (*handler == NULL)
     {
             // icmp 差错报文格式：| icmp_hdr(8) | 产生差错报文的ip_hdr(20) | 部分 udp_hdr/tcp_hdr(8)  八个字节，包括 src_port 和 dst_port|
             buf_add_header(buf, sizeof(ip_hdr_t));
-            icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
+            icmp_unreachable(stack, buf, src_ip, ICMP_CODE_PORT_UNREACH);
             return;
     }
    
@@ -389,10 +435,11 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
 
     // TODO
     tcp_connect_t * connect = NULL;
-    if ((connect = map_get(&connect_table, &tcp_key)) == NULL)
+    if ((connect = tcp_connect_map_get(&stack->connect_table, &tcp_key)) == NULL)
     {   
-        map_set(&connect_table, &tcp_key, &CONNECT_LISTEN);
-        connect = map_get(&connect_table, &tcp_key);
+        tcp_connect_map_set(&stack->connect_table, &tcp_key, &CONNECT_LISTEN);
+        connect = tcp_connect_map_get(&stack->connect_table, &tcp_key);
+        connect->stack = stack;
     }
 
     /*
@@ -441,9 +488,10 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
         connect->ack = seq_num + 1;
         connect->remote_win = remote_win_size;
 
-        buf_init(&txbuf, 0);
+        buf_init(&stack->txbuf, 0);
+        buf_reserve(&stack->txbuf, TCP_HEADROOM);
         // 对SYN请求发送ack
-        tcp_send(&txbuf, connect, tcp_flags_ack_syn);
+        tcp_send(&stack->txbuf, connect, tcp_flags_ack_syn);
         return;
     }
 
@@ -558,12 +606,13 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
 
         // TODO
         int send_ack = 0;
-        buf_init(&txbuf, 0);
+        buf_init(&stack->txbuf, 0);
+        buf_reserve(&stack->txbuf, TCP_HEADROOM);
         if (flags->fin)
         {
             connect->state = TCP_LAST_ACK;
             connect->ack++;
-            tcp_send(&txbuf, connect, tcp_flags_ack_fin);
+            tcp_send(&stack->txbuf, connect, tcp_flags_ack_fin);
             return;
         }
         else 
@@ -574,8 +623,8 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
                 (*handler)(connect, TCP_CONN_DATA_RECV);
             }
         }
-        if (tcp_write_to_buf(connect, &txbuf)) send_ack = 1;
-        if (send_ack == 1) tcp_send(&txbuf, connect, tcp_flags_ack);
+        if (tcp_write_to_buf(connect, &stack->txbuf)) send_ack = 1;
+        if (send_ack == 1) tcp_send(&stack->txbuf, connect, tcp_flags_ack);
         break;
 
     case TCP_CLOSE_WAIT:
@@ -607,8 +656,9 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
         // TODO
         if (!flags->fin) return;
         connect->ack++;
-        buf_init(&txbuf, 0);
-        tcp_send(&txbuf, connect, tcp_flags_ack);
+        buf_init(&stack->txbuf, 0);
+        buf_reserve(&stack->txbuf, TCP_HEADROOM);
+        tcp_send(&stack->txbuf, connect, tcp_flags_ack);
         close_tcp(connect, &tcp_key);
         break;
 
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include "timer.h"
+#include "clock.h"
+
+#define TIMER_TV1_BITS 8                        // 第一层的位数，每槽1毫秒
+#define TIMER_TVN_BITS 6                        // 其余各层的位数，每槽为上一层一整圈
+#define TIMER_TVN_NUM 4                         // 除第一层外的层数，总共覆盖2^32毫秒（约49天）
+#define TIMER_TV1_SIZE (1 << TIMER_TV1_BITS)
+#define TIMER_TVN_SIZE (1 << TIMER_TVN_BITS)
+#define TIMER_TV1_MASK (TIMER_TV1_SIZE - 1)
+#define TIMER_TVN_MASK (TIMER_TVN_SIZE - 1)
+#define TIMER_TVN_SHIFT(n) (TIMER_TV1_BITS + (n) * TIMER_TVN_BITS) // 第n个上层的槽号在时刻中的起始位
+#define TIMER_MAX_DELAY ((1ull << TIMER_TVN_SHIFT(TIMER_TVN_NUM)) - 1)
+
+/**
+ * @brief 分层时间轮，第一层每槽1毫秒，上层的槽在第一层转完一圈时逐级向下迁移（cascade）
+ *
+ */
+static _Thread_local net_timer_t *timer_tv1[TIMER_TV1_SIZE];
+static _Thread_local net_timer_t *timer_tvn[TIMER_TVN_NUM][TIMER_TVN_SIZE];
+
+static _Thread_local uint64_t timer_jiffies; // 时间轮已经处理到的时刻，毫秒
+static _Thread_local size_t timer_pending;   // 挂在时间轮上的定时器个数
+
+/**
+ * @brief 初始化定时器子系统，时间轮从缓存时钟的当前时刻开始转动
+ *
+ */
+void net_timer_init()
+{
+    timer_jiffies = net_clock_ms();
+}
+
+/**
+ * @brief 初始化一个定时器，不添加到时间轮上
+ *
+ * @param timer 要初始化的定时器
+ * @param handler 到期回调
+ * @param arg 回调参数
+ */
+void net_timer_setup(net_timer_t *timer, net_timer_handler_t handler, void *arg)
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->handler = handler;
+    timer->arg = arg;
+}
+
+/**
+ * @brief 把定时器挂到时间轮上与其到期时刻对应的槽中
+ *
+ * @param timer 要挂上的定时器
+ */
+static void net_timer_link(net_timer_t *timer)
+{
+    uint64_t expires = timer->expires;
+    uint64_t idx = expires - timer_jiffies;
+    net_timer_t **slot;
+    if (expires < timer_jiffies) // 已经过期的放到下一个要处理的槽
+        slot = &timer_tv1[timer_jiffies & TIMER_TV1_MASK];
+    else if (idx < TIMER_TV1_SIZE)
+        slot = &timer_tv1[expires & TIMER_TV1_MASK];
+    else
+    {
+        size_t n = 0;
+        while (n < TIMER_TVN_NUM - 1 && idx >= 1ull << TIMER_TVN_SHIFT(n + 1))
+            n++;
+        slot = &timer_tvn[n][(expires >> TIMER_TVN_SHIFT(n)) & TIMER_TVN_MASK];
+    }
+    timer->next = *slot;
+    if (*slot)
+        (*slot)->pprev = &timer->next;
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+/**
+ * @brief 把定时器从所在的槽链表上摘下
+ *
+ * @param timer 要摘下的定时器
+ */
+static void net_timer_unlink(net_timer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/**
+ * @brief 添加定时器，delay_ms毫秒后到期。定时器已在等待时重新设置到期时刻
+ *
+ * @param timer 要添加的定时器，须已经net_timer_setup
+ * @param delay_ms 相对缓存时钟当前时刻的延时，毫秒
+ */
+void net_timer_add(net_timer_t *timer, uint64_t delay_ms)
+{
+    if (timer_jiffies == 0)
+        net_timer_init();
+    if (net_timer_pending(timer))
+        net_timer_unlink(timer);
+    else
+        timer_pending++;
+    if (delay_ms > TIMER_MAX_DELAY)
+        delay_ms = TIMER_MAX_DELAY;
+    timer->expires = net_clock_ms() + delay_ms;
+    net_timer_link(timer);
+}
+
+/**
+ * @brief 取消定时器，未在等待的定时器忽略
+ *
+ * @param timer 要取消的定时器
+ */
+void net_timer_cancel(net_timer_t *timer)
+{
+    if (!net_timer_pending(timer))
+        return;
+    net_timer_unlink(timer);
+    timer_pending--;
+}
+
+/**
+ * @brief 把上层的一个槽中的定时器重新挂到下层
+ *
+ * @param n 上层序号
+ * @return size_t 该层在当前时刻的槽号，为0表示该层也转完了一圈，需要继续迁移更上一层
+ */
+static size_t net_timer_cascade(size_t n)
+{
+    size_t index = (timer_jiffies >> TIMER_TVN_SHIFT(n)) & TIMER_TVN_MASK;
+    net_timer_t *timer = timer_tvn[n][index];
+    timer_tvn[n][index] = NULL;
+    while (timer)
+    {
+        net_timer_t *next = timer->next;
+        net_timer_link(timer);
+        timer = next;
+    }
+    return index;
+}
+
+/**
+ * @brief 一次定时器轮询：依次执行到缓存时钟当前时刻为止到期的定时器
+ *        没有定时器等待时时间轮直接跳到当前时刻
+ *
+ */
+void net_timer_poll()
+{
+    uint64_t now = net_clock_ms();
+    while (timer_jiffies <= now)
+    {
+        if (timer_pending == 0)
+        {
+            timer_jiffies = now + 1;
+            break;
+        }
+        size_t index = timer_jiffies & TIMER_TV1_MASK;
+        if (index == 0)
+            for (size_t n = 0; n < TIMER_TVN_NUM && net_timer_cascade(n) == 0; n++)
+                ;
+        timer_jiffies++;
+
+        net_timer_t *head = timer_tv1[index]; // 摘下整个槽，回调中添加的定时器不会进入本次处理
+        timer_tv1[index] = NULL;
+        if (head)
+            head->pprev = &head;
+        while (head)
+        {
+            net_timer_t *timer = head;
+            net_timer_unlink(timer);
+            timer_pending--;
+            timer->handler(timer, timer->arg);
+        }
+    }
+}
+
+/**
+ * @brief 计算距离下一个定时器到期还有多久，供事件循环决定最长等待时间
+ *        只扫描第一层到下一次迁移为止的槽；上层的定时器不早于下一次迁移，此时返回到迁移时刻的时长
+ *
+ * @return int64_t 毫秒，已有到期的定时器时为0，没有定时器等待时为-1
+ */
+int64_t net_timer_next()
+{
+    if (timer_pending == 0)
+        return -1;
+    uint64_t now = net_clock_ms();
+    uint64_t jiffies = timer_jiffies;
+    if (jiffies & TIMER_TV1_MASK) // 正处在迁移时刻时上层的定时器还没迁下来，等到该时刻即可
+        while (jiffies & TIMER_TV1_MASK && timer_tv1[jiffies & TIMER_TV1_MASK] == NULL)
+            jiffies++;
+    return jiffies > now ? (int64_t)(jiffies - now) : 0;
+}
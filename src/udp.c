@@ -1,12 +1,7 @@
 #include "udp.h"
 #include "ip.h"
 #include "icmp.h"
-
-/**
- * @brief udp处理程序表
- * 
- */
-map_t udp_table;
+#include "stack.h"
 
 /**
  * @brief udp伪校验和计算
@@ -20,66 +15,126 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip)
 {
     // TO-DO
     uint16_t len = ((udp_hdr_t *)buf->data)->total_len16;
-    udp_peso_hdr_t *peso_hdr = (udp_peso_hdr_t *)(buf->data - sizeof(udp_peso_hdr_t));
-    // 暂存要被覆盖的部分
-    udp_peso_hdr_t pre;
-    memcpy(&pre, peso_hdr, sizeof(udp_peso_hdr_t));
-    memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN);
-    memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN);
-    peso_hdr->placeholder = 0;
-    peso_hdr->protocol = NET_PROTOCOL_UDP;
-    peso_hdr->total_len16 = len;
-    uint16_t checksum = checksum16((uint16_t *)peso_hdr, swap16(len) + sizeof(udp_peso_hdr_t));
-    memcpy(peso_hdr, &pre, sizeof(udp_peso_hdr_t));
+    // 伪头部单独累加，不再覆盖数据包前面的内容，数据包可以是分段的
+    udp_peso_hdr_t peso_hdr;
+    memcpy(peso_hdr.src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso_hdr.dst_ip, dst_ip, NET_IP_LEN);
+    peso_hdr.placeholder = 0;
+    peso_hdr.protocol = NET_PROTOCOL_UDP;
+    peso_hdr.total_len16 = len;
+    uint32_t sum = checksum16_partial(0, &peso_hdr, sizeof(udp_peso_hdr_t), 0);
+    uint16_t checksum = buf_checksum16(buf, swap16(len), sum);
 
     // printf("udp_checksum: %lx\n", (long unsigned int)checksum);
     return checksum;
 }
 
 /**
- * @brief 处理一个收到的udp数据包
+ * @brief 检查一个收到的udp数据包的长度和校验和
  * 
- * @param buf 要处理的包
+ * @param stack 协议栈
+ * @param buf 要检查的包
  * @param src_ip 源ip地址
+ * @return int 通过为0，否则为-1
  */
-void udp_in(buf_t *buf, uint8_t *src_ip)
+static int udp_check(net_stack_t *stack, buf_t *buf, uint8_t *src_ip)
 {
-    // TO-DO
-    if (buf->len < sizeof(udp_hdr_t)) return;
+    if (buf->len < sizeof(udp_hdr_t)) return -1;
     udp_hdr_t * udp_hdr = (udp_hdr_t *)buf->data;
-    if (buf->len < swap16(udp_hdr->total_len16)) return;
+    if (buf->len < swap16(udp_hdr->total_len16)) return -1;
     uint16_t origin_checksum = udp_hdr->checksum16;
     udp_hdr->checksum16 = 0;
-    if (origin_checksum != udp_checksum(buf, src_ip, net_if_ip)) return;
+    if (origin_checksum != udp_checksum(buf, src_ip, stack->ifs[buf->if_id].ip)) return -1;
     udp_hdr->checksum16 = origin_checksum;
+    return 0;
+}
 
-    udp_handler_t *handler = NULL;
-    uint16_t dst_port = swap16(udp_hdr->dst_port16);
-    if ((handler = map_get(&udp_table, &dst_port)) != NULL)
+/**
+ * @brief 把一个通过检查的udp数据包交给端口上的处理程序，端口未打开时回复icmp端口不可达
+ * 
+ * @param stack 协议栈
+ * @param buf 要处理的包
+ * @param src_ip 源ip地址
+ */
+static void udp_deliver(net_stack_t *stack, buf_t *buf, uint8_t *src_ip)
+{
+    udp_hdr_t * udp_hdr = (udp_hdr_t *)buf->data;
+    udp_handler_t handler = stack->udp_table[swap16(udp_hdr->dst_port16)];
+    if (handler != NULL)
     {
         buf_remove_header(buf, sizeof(udp_hdr_t));
-        (*handler)(buf->data, buf->len, src_ip, swap16(udp_hdr->src_port16));
+        handler(stack, buf->data, buf->len, src_ip, swap16(udp_hdr->src_port16));
     }
     else 
     {
         // icmp 差错报文格式：| icmp_hdr(8) | 产生差错报文的ip_hdr(20) | 部分 udp_hdr/tcp_hdr(8)  八个字节，包括 src_port 和 dst_port|
         buf_add_header(buf, sizeof(ip_hdr_t));
-        icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
+        icmp_unreachable(stack, buf, src_ip, ICMP_CODE_PORT_UNREACH);
+    }
+}
+
+/**
+ * @brief 处理一个收到的udp数据包
+ * 
+ * @param stack 协议栈
+ * @param buf 要处理的包
+ * @param src_ip 源ip地址
+ */
+void udp_in(net_stack_t *stack, buf_t *buf, uint8_t *src_ip)
+{
+    // TO-DO
+    if (udp_check(stack, buf, src_ip) == 0)
+        udp_deliver(stack, buf, src_ip);
+}
+
+/**
+ * @brief 批量处理收到的udp数据包，先校验整批，再依次交给各端口的处理程序
+ * 
+ * @param stack 协议栈
+ * @param bufs 要处理的包
+ * @param src_ips 各包的源ip地址
+ * @param n 包个数
+ */
+void udp_in_vector(net_stack_t *stack, buf_t **bufs, uint8_t **src_ips, size_t n)
+{
+    uint8_t ok[NET_VECTOR_SIZE];
+    while (n > 0)
+    {
+        size_t count = n < NET_VECTOR_SIZE ? n : NET_VECTOR_SIZE;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i + 1 < count)
+                prefetch(bufs[i + 1]->data);
+            ok[i] = udp_check(stack, bufs[i], src_ips[i]) == 0;
+        }
+        for (size_t i = 0; i < count; i++)
+            if (ok[i])
+                udp_deliver(stack, bufs[i], src_ips[i]);
+        bufs += count;
+        src_ips += count;
+        n -= count;
     }
 }
 
 /**
  * @brief 处理一个要发送的数据包
  * 
+ * @param stack 协议栈
  * @param buf 要处理的包
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
  */
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+void udp_out(net_stack_t *stack, buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
 {
     // TO-DO
     printf("send udp packet to %s:%u len=%zu\n", iptos(dst_ip), src_port, buf->len);
+    uint8_t *src_ip = ip_src_addr(stack, dst_ip);
+    if (src_ip == NULL)
+    {
+        fprintf(stderr, "Error in udp_out: no route to %s\n", iptos(dst_ip));
+        return;
+    }
     buf_add_header(buf, sizeof(udp_hdr_t));
     udp_hdr_t *udp_hdr = (udp_hdr_t *)buf->data;
     // 填充首部字段
@@ -87,9 +142,9 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
     udp_hdr->dst_port16 = swap16(dst_port);
     udp_hdr->total_len16 = swap16(buf->len);
     udp_hdr->checksum16 = 0;
-    udp_hdr->checksum16 = udp_checksum(buf, net_if_ip, dst_ip);
+    udp_hdr->checksum16 = udp_checksum(buf, src_ip, dst_ip);
 
-    ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
+    ip_out(stack, buf, dst_ip, NET_PROTOCOL_UDP);
 }
 
 /**
@@ -98,45 +153,51 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
  */
 void udp_init()
 {
-    map_init(&udp_table, sizeof(uint16_t), sizeof(udp_handler_t), 0, 0, NULL);
     net_add_protocol(NET_PROTOCOL_UDP, udp_in);
+    net_add_protocol_vector(NET_PROTOCOL_UDP, udp_in_vector);
 }
 
 /**
  * @brief 打开一个udp端口并注册处理程序
  * 
+ * @param stack 协议栈
  * @param port 端口号
  * @param handler 处理程序
  * @return int 成功为0，失败为-1
  */
-int udp_open(uint16_t port, udp_handler_t handler)
+int udp_open(net_stack_t *stack, uint16_t port, udp_handler_t handler)
 {
     printf("udp open\n");
-    return map_set(&udp_table, &port, &handler);
+    stack->udp_table[port] = handler;
+    return 0;
 }
 
 /**
  * @brief 关闭一个udp端口
  * 
+ * @param stack 协议栈
  * @param port 端口号
  */
-void udp_close(uint16_t port)
+void udp_close(net_stack_t *stack, uint16_t port)
 {
-    map_delete(&udp_table, &port);
+    stack->udp_table[port] = NULL;
 }
 
 /**
  * @brief 发送一个udp包
  * 
+ * @param stack 协议栈
  * @param data 要发送的数据
  * @param len 数据长度
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
  */
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+void udp_send(net_stack_t *stack, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
 {
-    buf_init(&txbuf, len);
-    memcpy(txbuf.data, data, len);
-    udp_out(&txbuf, src_port, dst_ip, dst_port);
+    buf_t *txbuf = &stack->txbuf;
+    buf_init(txbuf, len);
+    buf_reserve(txbuf, UDP_HEADROOM);
+    memcpy(txbuf->data, data, len);
+    udp_out(stack, txbuf, src_port, dst_ip, dst_port);
 }
\ No newline at end of file
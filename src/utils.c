@@ -69,23 +69,59 @@ uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb)
 }
 
 /**
- * @brief 计算16位校验和
+ * @brief 累加一段数据的16位校验和部分和，用于分多段计算校验和
  * 
- * @param buf 要计算的数据包
- * @param len 要计算的长度
- * @return uint16_t 校验和
+ * @param sum 之前的部分和
+ * @param data 要累加的数据
+ * @param len 要累加的长度
+ * @param offset data在整个被校验数据中的偏移，为奇数时按字节错位累加
+ * @return uint32_t 新的部分和
  */
-uint16_t checksum16(uint16_t *data, size_t len)
+uint32_t checksum16_partial(uint32_t sum, const void *data, size_t len, size_t offset)
 {
-    uint32_t sum = 0;
+    const uint8_t *p = data;
+    uint32_t part = 0;
     while (len > 1)
     {
-        sum += *data++;
+        uint16_t word;
+        memcpy(&word, p, sizeof(word)); // 分段数据可能不按2字节对齐
+        part += word;
+        p += 2;
         len -= 2;
     }
     if (len == 1)
-        sum += *(uint8_t *)data;    
+        part += *p;
+    while ((part >> 16) > 0)
+        part = (part & 0xFFFF) + (part >> 16);
+    if (offset & 1)
+        part = ((part & 0xFF) << 8) | (part >> 8);
+    sum += part;
+    while ((sum >> 16) > 0)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return sum;
+}
+
+/**
+ * @brief 由部分和得到最终的16位校验和
+ * 
+ * @param sum checksum16_partial累加得到的部分和
+ * @return uint16_t 校验和
+ */
+uint16_t checksum16_fold(uint32_t sum)
+{
     while ((sum >> 16) > 0)
         sum = (sum & 0xFFFF) + (sum >> 16);
     return ~(uint16_t)sum;
 }
+
+/**
+ * @brief 计算16位校验和
+ * 
+ * @param buf 要计算的数据包
+ * @param len 要计算的长度
+ * @return uint16_t 校验和
+ */
+uint16_t checksum16(uint16_t *data, size_t len)
+{
+    return checksum16_fold(checksum16_partial(0, data, len, 0));
+}
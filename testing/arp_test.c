@@ -4,6 +4,7 @@
 #include "ethernet.h"
 #include "arp.h"
 #include "driver.h"
+#include "stack.h"
 
 extern FILE *pcap_in;
 extern FILE *pcap_out;
@@ -47,26 +48,29 @@ int main(int argc, char* argv[]){
         log_tab_buf();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(&net_default_stack.ifs[0], &buf)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
                 if(memcmp(buf.data,my_mac,6) && memcmp(buf.data,boardcast_mac,6)){
-                        buf_t buf2;
-                        buf_copy(&buf2, &buf, 0);
+                        buf_t buf2 = {0};
+                        if(buf_copy(&buf2, &buf) < 0){
+                                return -1;
+                        }
                         memset(buf2.data,0,sizeof(ether_hdr_t));
                         buf_remove_header(&buf2, sizeof(ether_hdr_t));
                         uint8_t * ip = buf.data + 30;
                         // net_protocol_t pro = buf.data[13] ? NET_PROTOCOL_ARP : NET_PROTOCOL_IP;
-                        arp_out(&buf2, ip);
+                        arp_out(&net_default_stack, &net_default_stack.ifs[0], &buf2, ip);
+                        buf_release(&buf2);
                 }else{
-                        ethernet_in(&buf);
+                        ethernet_in(&net_default_stack, &buf);
                 }
                 log_tab_buf();
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on receive,exiting\n");
         }
-        driver_close();
+        driver_close(&net_default_stack.ifs[0]);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+#include "buf.h"
+#include "mempool.h"
+
+#define BUF_TEST_LEN 200
+
+#define CHECK(cond)                                                                 \
+        do{                                                                         \
+                if(!(cond)){                                                        \
+                        printf("\e[1;31m\n%s:%d: check failed: %s\n\e[0m",          \
+                               __FILE__, __LINE__, #cond);                          \
+                        return -1;                                                  \
+                }                                                                   \
+        }while(0)
+
+static uint8_t expect[BUF_TEST_LEN];
+
+/**
+ * @brief 初始化一个装有固定内容的buffer，内容同时记在expect中
+ */
+static int fill(buf_t *buf){
+        CHECK(buf_init(buf, BUF_TEST_LEN) == 0);
+        for(int i = 0; i < BUF_TEST_LEN; i++)
+                expect[i] = buf->data[i] = (uint8_t)(i * 7 + 3);
+        return 0;
+}
+
+/**
+ * @brief 检查buffer的有效数据是否与给定内容一致，分段的buffer先拼接
+ */
+static int same(const buf_t *buf, const uint8_t *data, size_t len){
+        static uint8_t flat[BUF_MAX_LEN];
+        CHECK(buf->len == len);
+        CHECK(buf_gather(buf, flat) == len);
+        CHECK(memcmp(flat, data, len) == 0);
+        return 0;
+}
+
+/**
+ * @brief 克隆后在克隆上添加协议头，原buffer的数据和引用计数都不应变化
+ */
+static int test_clone_push_header(){
+        static uint8_t snapshot[BUF_MAX_LEN];
+        buf_t orig = {0}, clone = {0};
+        uint8_t pushed[8 + BUF_TEST_LEN];
+        CHECK(fill(&orig) == 0);
+        memcpy(snapshot, orig.payload, orig.size);
+        buf_clone(&clone, &orig, sizeof(buf_t));
+        CHECK(clone.payload == orig.payload);
+        CHECK(mempool_refcnt(orig.payload) == 2);
+        CHECK(buf_shared(&orig) && buf_shared(&clone));
+
+        CHECK(buf_add_header(&clone, 8) == 0);
+        memset(clone.data, 0xee, 8);
+        memset(pushed, 0xee, 8);
+        memcpy(pushed + 8, expect, BUF_TEST_LEN);
+        CHECK(same(&clone, pushed, sizeof(pushed)) == 0);
+        CHECK(same(&orig, expect, BUF_TEST_LEN) == 0);
+        CHECK(memcmp(snapshot, orig.payload, orig.size) == 0); // 头部预留空间也不能被克隆写入
+        CHECK(mempool_refcnt(orig.payload) == 2); // 克隆的引用转移给了分段
+
+        buf_release(&clone);
+        CHECK(mempool_refcnt(orig.payload) == 1);
+        CHECK(same(&orig, expect, BUF_TEST_LEN) == 0);
+        buf_release(&orig);
+        return 0;
+}
+
+/**
+ * @brief 克隆后改写克隆的载荷，写前buf_unshare拷贝，原buffer不受影响
+ */
+static int test_clone_write_payload(){
+        buf_t orig = {0}, clone = {0};
+        uint8_t written[BUF_TEST_LEN];
+        CHECK(fill(&orig) == 0);
+        buf_clone(&clone, &orig, sizeof(buf_t));
+        CHECK(mempool_refcnt(orig.payload) == 2);
+
+        CHECK(buf_unshare(&clone) == 0);
+        CHECK(clone.payload != orig.payload);
+        CHECK(mempool_refcnt(orig.payload) == 1);
+        CHECK(mempool_refcnt(clone.payload) == 1);
+        memcpy(written, expect, BUF_TEST_LEN);
+        for(int i = 0; i < BUF_TEST_LEN; i += 3)
+                written[i] = clone.data[i] = 0x5a;
+        CHECK(same(&clone, written, BUF_TEST_LEN) == 0);
+        CHECK(same(&orig, expect, BUF_TEST_LEN) == 0);
+
+        CHECK(buf_add_padding(&clone, 4) == 0);
+        CHECK(same(&orig, expect, BUF_TEST_LEN) == 0);
+        CHECK(orig.len == BUF_TEST_LEN);
+
+        buf_release(&clone);
+        buf_release(&orig);
+        return 0;
+}
+
+/**
+ * @brief 原持有者写入时同样先拷贝，已有的克隆保持原内容
+ */
+static int test_owner_write(){
+        buf_t orig = {0}, clone = {0};
+        CHECK(fill(&orig) == 0);
+        buf_clone(&clone, &orig, sizeof(buf_t));
+        uint8_t *shared = orig.payload;
+
+        CHECK(buf_unshare(&orig) == 0);
+        CHECK(orig.payload != shared && clone.payload == shared);
+        CHECK(mempool_refcnt(shared) == 1);
+        memset(orig.data, 0, BUF_TEST_LEN);
+        CHECK(same(&clone, expect, BUF_TEST_LEN) == 0);
+
+        buf_release(&clone);
+        buf_release(&orig);
+        return 0;
+}
+
+/**
+ * @brief 借用驱动帧的buffer无法共享，克隆退化为拷贝
+ */
+static int test_clone_borrowed(){
+        static uint8_t frame[BUF_TEST_LEN];
+        buf_t orig = {0}, clone = {0};
+        for(int i = 0; i < BUF_TEST_LEN; i++)
+                expect[i] = frame[i] = (uint8_t)(i ^ 0x3c);
+        CHECK(buf_borrow(&orig, frame, BUF_TEST_LEN) == 0);
+        buf_clone(&clone, &orig, sizeof(buf_t));
+        CHECK(clone.payload != NULL && clone.payload != frame);
+        CHECK(!clone.borrowed && mempool_refcnt(clone.payload) == 1);
+        memset(clone.data, 0, BUF_TEST_LEN);
+        CHECK(memcmp(frame, expect, BUF_TEST_LEN) == 0);
+
+        buf_release(&clone);
+        buf_release(&orig);
+        return 0;
+}
+
+int main(int argc, char* argv[]){
+        mempool_init();
+        printf("\e[0;34mTest start\n");
+        if(test_clone_push_header() < 0) return -1;
+        printf("\e[0;34mclone + header push ok\n");
+        if(test_clone_write_payload() < 0) return -1;
+        printf("\e[0;34mclone + payload write ok\n");
+        if(test_owner_write() < 0) return -1;
+        printf("\e[0;34mowner write after clone ok\n");
+        if(test_clone_borrowed() < 0) return -1;
+        printf("\e[0;34mborrowed clone ok\n\e[0m");
+        return 0;
+}
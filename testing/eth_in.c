@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "driver.h"
+#include "stack.h"
 #include "ethernet.h"
 
 extern FILE *pcap_in;
@@ -33,15 +34,15 @@ int main(int argc, char* argv[]){
         net_init();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(&net_default_stack.ifs[0], &buf)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
-                ethernet_in(&buf);
+                ethernet_in(&net_default_stack, &buf);
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(&net_default_stack.ifs[0]);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(ip_fout);
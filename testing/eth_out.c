@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "driver.h"
+#include "stack.h"
 #include "ethernet.h"
 
 extern FILE *pcap_in;
@@ -33,21 +34,24 @@ int main(int argc, char* argv[]){
         net_init();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(&net_default_stack.ifs[0], &buf)) > 0){
                 printf("\b\b%02d",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
-                buf_copy(&buf2, &buf, 0);
+                if(buf_copy(&buf2, &buf) < 0){
+                        ret = -1;
+                        break;
+                }
                 memset(buf.data,0,sizeof(ether_hdr_t));
                 buf_remove_header(&buf, sizeof(ether_hdr_t));
                 int proto = buf2.data[12];
                 proto <<= 8;
                 proto |= buf2.data[13];
-                ethernet_out(&buf,buf2.data,proto);
+                ethernet_out(&net_default_stack, &net_default_stack.ifs[0], &buf,buf2.data,proto);
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(&net_default_stack.ifs[0]);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
@@ -1,4 +1,5 @@
 #include "net.h"
+#include "stack.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -11,9 +12,6 @@ char* print_ip(uint8_t *ip);
 char* print_mac(uint8_t *mac);
 void fprint_buf(FILE* f, buf_t* buf);
 
-map_t arp_table;
-map_t arp_buf;
-
 // void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 // {
 //         fprintf(arp_fout,"arp update:\t");
@@ -22,23 +20,33 @@ map_t arp_buf;
 //         fprintf(arp_fout,"state:%d\n",state);
 // }
 
-void arp_in(buf_t *buf, uint8_t *src_mac)
+void arp_in(net_stack_t *stack, buf_t *buf, uint8_t *src_mac)
 {
         fprintf(arp_fout,"arp_in:\n");
         fprintf(arp_fout,"\tmac:%s\n", print_mac(src_mac));
         fprint_buf(arp_fout,buf);
 }
 
-void arp_out(buf_t *buf, uint8_t *ip)
+void arp_out(net_stack_t *stack, net_if_t *net_if, buf_t *buf, uint8_t *ip)
 {
         fprintf(arp_fout,"arp_out:\n");
         fprintf(arp_fout,"\tip:%s\n",print_ip(ip));
         fprint_buf(arp_fout,buf);
 }
 
-void arp_init()
+void arp_req(net_stack_t *stack, net_if_t *net_if, uint8_t *target_ip)
+{
+        fprintf(arp_fout,"arp_req:\n");
+        fprintf(arp_fout,"\tip:%s\n",print_ip(target_ip));
+}
+
+void arp_stack_init(net_stack_t *stack)
+{
+    map_init(&stack->arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
+    map_init(&stack->arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_clone);
+}
+
+void arp_init(net_stack_t *stack)
 {
-    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
-    map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <utils.h>
 #include "config.h"
 #include "buf.h"
+#include "net.h"
 
 static pcap_t *pcap;
 static pcap_dumper_t *pdump;
@@ -33,7 +34,7 @@ BOOL LoadNpcapDlls()
 }
 #endif
 
-int driver_open()
+int driver_open(net_if_t *net_if)
 {
 #ifdef _WIN32
         /* Load Npcap and its functions. */
@@ -59,7 +60,7 @@ int driver_open()
         return 0;
 }
 
-int driver_recv(buf_t *buf)
+int driver_recv(net_if_t *net_if, buf_t *buf)
 {
         struct pcap_pkthdr *pkt_hdr;
         const uint8_t *pkt_data;
@@ -68,8 +69,13 @@ int driver_recv(buf_t *buf)
                 // printf("meet end of file\n");
                 return 0;
         }else if (ret == 1){
+#ifdef NET_RX_ZERO_COPY
+                buf_borrow(buf, (uint8_t *)pkt_data, pkt_hdr->caplen);
+#else
                 buf_init(buf,pkt_hdr->len);
                 memcpy(buf->data, pkt_data, pkt_hdr->len);
+#endif
+                buf->if_id = net_if->id;
                 return pkt_hdr->len;
         }else{
                 fprintf(stderr, "Error in driver_recv: %s\n", pcap_geterr(pcap));
@@ -77,18 +83,77 @@ int driver_recv(buf_t *buf)
         }
 }
 
-int driver_send(buf_t *buf)
+typedef struct driver_burst
+{
+        net_if_t *net_if;
+        buf_t **bufs;
+        int n;
+} driver_burst_t;
+
+static void driver_burst_handler(u_char *user, const struct pcap_pkthdr *pkt_hdr, const u_char *pkt_data)
 {
+        driver_burst_t *burst = (driver_burst_t *)user;
+        buf_t *buf = burst->bufs[burst->n++];
+        buf_init(buf,pkt_hdr->caplen);
+        memcpy(buf->data, pkt_data, pkt_hdr->caplen);
+        buf->if_id = burst->net_if->id;
+}
+
+int driver_recv_burst(net_if_t *net_if, buf_t **bufs, int max)
+{
+#ifdef NET_RX_ZERO_COPY
+        int len = driver_recv(net_if, bufs[0]);
+        return len > 0 ? 1 : len;
+#endif
+        driver_burst_t burst = {net_if, bufs, 0};
+        if (pcap_dispatch(pcap, max, driver_burst_handler, (u_char *)&burst) < 0){
+                fprintf(stderr, "Error in driver_recv_burst: %s\n", pcap_geterr(pcap));
+                return -1;
+        }
+        return burst.n;
+}
+
+int driver_send(net_if_t *net_if, buf_t *buf)
+{
+        static uint8_t data[BUF_MAX_LEN];
         struct pcap_pkthdr header;
         memset(&header.ts,0,sizeof(header.ts));
         header.caplen = buf->len;
         header.len = buf->len;
-        pcap_dump((u_char *)pdump,&header,buf->data);
+        buf_gather(buf, data);
+        pcap_dump((u_char *)pdump,&header,data);
+        return 0;
+}
+
+static _Thread_local buf_t txq[NET_TX_BATCH];
+static _Thread_local int txq_n;
+
+void driver_flush()
+{
+        for (int i = 0; i < txq_n; i++)
+        {
+                driver_send(NULL, &txq[i]);
+                buf_release(&txq[i]);
+        }
+        txq_n = 0;
+}
+
+int driver_send_defer(net_if_t *net_if, buf_t *buf)
+{
+        buf_clone(&txq[txq_n], buf, sizeof(buf_t));
+        if (++txq_n == NET_TX_BATCH)
+                driver_flush();
+        return 0;
+}
+
+int driver_wait(int timeout_ms)
+{
         return 0;
 }
 
-void driver_close()
+void driver_close(net_if_t *net_if)
 {
+        driver_flush();
         fprintf(control_flow,"\ndriver closed\n");
         pcap_dump_close(pdump);
         pcap_close(pcap);
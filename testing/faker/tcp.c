@@ -1,6 +1,7 @@
 #include "tcp.h"
 
 void tcp_init() {}
-int tcp_open(uint16_t port, tcp_handler_t handler) {
+void tcp_stack_init(net_stack_t* stack) {}
+int tcp_open(net_stack_t* stack, uint16_t port, tcp_handler_t handler) {
     return 0;
 }
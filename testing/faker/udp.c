@@ -8,7 +8,7 @@ extern FILE *udp_fout;
 char* print_ip(uint8_t *ip);
 void fprint_buf(FILE* f, buf_t* buf);
 
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+void udp_out(net_stack_t *stack, buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
         fprintf(udp_fout,"udp_out:\n");
         fprintf(udp_fout,"\tsrc_port: %d\n", src_port);
@@ -23,19 +23,19 @@ void udp_init()
     net_add_protocol(NET_PROTOCOL_UDP, udp_in);
 }
 
-int udp_open(uint16_t port, udp_handler_t handler)
+int udp_open(net_stack_t *stack, uint16_t port, udp_handler_t handler)
 {
         fprintf(udp_fout,"udp_open: port:%d\n",port);
         return 0;
 }
 
-void udp_close(uint16_t port)
+void udp_close(net_stack_t *stack, uint16_t port)
 {
         fprintf(udp_fout,"udp_close: port:%d\n",port);
 }
 
 
-void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+void udp_send(net_stack_t *stack, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
         fprintf(udp_fout,"udp_send:\n\tlen:%d\n",len);
         fprintf(udp_fout,"\tsrc_port:%d\n",src_port);
@@ -52,7 +52,7 @@ void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip,
         }
 }
 
-void udp_in(buf_t *buf, uint8_t *src_ip)
+void udp_in(net_stack_t *stack, buf_t *buf, uint8_t *src_ip)
 {
         fprintf(udp_fout,"udp_in:\n\tsrc_ip:%s\n",print_ip(src_ip));
         fprint_buf(udp_fout, buf);
@@ -3,6 +3,7 @@
 
 #include "net.h"
 #include "ip.h"
+#include "stack.h"
 #include "utils.h"
 
 extern FILE *control_flow;
@@ -21,17 +22,15 @@ int main(int argc, char* argv[])
                 return -1;
         }
         arp_fout = control_flow;
-        uint8_t * p = buf.payload + 1000;
-        buf.data = p;
-        buf.len = 0;
+        buf_init(&buf, 0);
         char c;
         while(fread(&c,1,1,in)){
-                *p = c;
-                p++;
-                buf.len++;
+                buf_add_padding(&buf, 1);
+                buf.data[buf.len - 1] = c;
         }
+        net_stack_init(&net_default_stack);
         printf("\e[0;34mFeeding input.\n");
-        ip_out(&buf,net_if_ip,NET_PROTOCOL_TCP);
+        ip_out(&net_default_stack, &buf,net_default_stack.ifs[0].ip,NET_PROTOCOL_TCP);
 
         fclose(in);
         fclose(control_flow);
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "driver.h"
+#include "stack.h"
 #include "ethernet.h"
 #include "arp.h"
 #include "ip.h"
@@ -50,13 +51,15 @@ int main(int argc, char* argv[]){
         log_tab_buf();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
-        while((ret = driver_recv(&buf)) > 0){
+        while((ret = driver_recv(&net_default_stack.ifs[0], &buf)) > 0){
                 printf("\b\b%02d",i);
                 // printf("\nFeeding input %02d\n",i);
                 fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
                 if(memcmp(buf.data,my_mac,6) && memcmp(buf.data,boardcast_mac,6)){
-                        buf_t buf2;
-                        buf_copy(&buf2, &buf, 0);
+                        buf_t buf2 = {0};
+                        if(buf_copy(&buf2, &buf) < 0){
+                                return -1;
+                        }
                         memset(buf2.data,0,sizeof(ether_hdr_t));
                         buf_remove_header(&buf2, sizeof(ether_hdr_t));
                         int len = (buf2.data[0] & 0xf) << 2;
@@ -65,16 +68,17 @@ int main(int argc, char* argv[]){
                         memset(buf2.data,0,len);
                         buf_remove_header(&buf2, len);
                         // printf("ip_out: hd_len:%d\tip:%s\tpro:%d\n",len,print_ip(ip),pro);
-                        ip_out(&buf2,ip,pro);
+                        ip_out(&net_default_stack, &buf2,ip,pro);
+                        buf_release(&buf2);
                 }else{
-                        ethernet_in(&buf);
+                        ethernet_in(&net_default_stack, &buf);
                 }
                 log_tab_buf();
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
         }
-        driver_close();
+        driver_close(&net_default_stack.ifs[0]);
         printf("\e[0;34m\nSample input all processed, checking output\n");
 
         fclose(control_flow);
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "map.h"
+
+#define BENCH_LOOKUPS 1000000 // 每组测量的查找次数
+
+static map_t bench_map;
+
+MAP_DEFINE(bench_u32_map, uint32_t, uint32_t)
+
+/**
+ * @brief 获取单调时钟的纳秒数
+ *
+ * @return uint64_t 纳秒
+ */
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief 生成第i个测试键，打乱顺序以免键连续
+ *
+ * @param i 序号
+ * @return uint32_t 键
+ */
+static uint32_t bench_key(uint32_t i)
+{
+    return i * 2654435761u + 1;
+}
+
+/**
+ * @brief 查找一个键，typed为1时使用MAP_DEFINE特化的接口，否则使用通用接口
+ *
+ */
+#define BENCH_GET(typed, key) ((typed) ? bench_u32_map_get(&bench_map, key) : (uint32_t *)map_get(&bench_map, key))
+
+/**
+ * @brief 测量map中有n个键时，命中与未命中的平均查找延迟
+ *
+ * @param n 键的个数
+ * @param typed 为1时测量特化接口，为0时测量通用接口
+ * @return int 成功为0，失败为-1
+ */
+static int bench_lookup(uint32_t n, int typed)
+{
+    map_init(&bench_map, sizeof(uint32_t), sizeof(uint32_t), n, 0, NULL);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t key = bench_key(i);
+        if (map_set(&bench_map, &key, &i) < 0)
+        {
+            fprintf(stderr, "Error in map_set:%u/%u\n", i, n);
+            return -1;
+        }
+    }
+
+    volatile uint32_t sink = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        uint32_t key = bench_key(i % n);
+        uint32_t *value = BENCH_GET(typed, &key);
+        if (value == NULL || *value != i % n)
+        {
+            fprintf(stderr, "Error in map_get:%u\n", i % n);
+            return -1;
+        }
+        sink += *value;
+    }
+    uint64_t hit = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        uint32_t key = bench_key(n + i);
+        if (BENCH_GET(typed, &key) != NULL)
+        {
+            fprintf(stderr, "Error in map_get:%u\n", n + i);
+            return -1;
+        }
+    }
+    uint64_t miss = bench_now_ns() - start;
+
+    printf("%8u | %-7s | %10.1f | %10.1f\n", n, typed ? "typed" : "generic",
+           (double)hit / BENCH_LOOKUPS, (double)miss / BENCH_LOOKUPS);
+    return 0;
+}
+
+int main()
+{
+    static const uint32_t sizes[] = {10, 1000, 100000};
+    printf(" entries | map     |  hit ns/op | miss ns/op\n");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        for (int typed = 0; typed <= 1; typed++)
+            if (bench_lookup(sizes[i], typed) < 0)
+                return 1;
+    return 0;
+}
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "map.h"
+
+#define MAP_TEST_KEYS 512     // 随机测试的键空间大小
+#define MAP_TEST_OPS 200000   // 随机测试的操作次数
+#define MAP_TEST_INDEX_MIN 8  // 最小索引表的槽数，与map.c中的MAP_INDEX_MIN一致
+
+#define CHECK(cond)                                                                 \
+        do{                                                                         \
+                if(!(cond)){                                                        \
+                        printf("\e[1;31m\n%s:%d: check failed: %s\n\e[0m",          \
+                               __FILE__, __LINE__, #cond);                          \
+                        return -1;                                                  \
+                }                                                                   \
+        }while(0)
+
+MAP_DEFINE(test_u32_map, uint32_t, uint32_t)
+
+static map_t test_map;
+static uint32_t ref_value[MAP_TEST_KEYS]; // 参照表：键i的值
+static uint8_t ref_present[MAP_TEST_KEYS]; // 参照表：键i是否存在
+static size_t ref_size;
+static uint32_t rand_state = 2463534242u;
+
+/**
+ * @brief xorshift32伪随机数，固定种子使失败可复现
+ */
+static uint32_t test_rand(){
+        rand_state ^= rand_state << 13;
+        rand_state ^= rand_state >> 17;
+        rand_state ^= rand_state << 5;
+        return rand_state;
+}
+
+/**
+ * @brief 检查索引表的Robin Hood不变式：
+ *        每个槽到其理想位置之间没有空槽，相邻槽的探测距离最多增加1，非空槽数等于map大小
+ */
+static int check_index(map_t *map){
+        if(map->index == NULL){
+                CHECK(map->size == 0);
+                return 0;
+        }
+        size_t cap = map->index_mask + 1, used = 0;
+        for(size_t i = 0; i < cap; i++){
+                if(map->index[i].pos == 0)
+                        continue;
+                used++;
+                size_t dist = map_slot_dist(map, i);
+                for(size_t d = 1; d <= dist; d++)
+                        CHECK(map->index[(i - d) & map->index_mask].pos != 0);
+                size_t next = (i + 1) & map->index_mask;
+                if(map->index[next].pos != 0)
+                        CHECK(map_slot_dist(map, next) <= dist + 1);
+        }
+        CHECK(used == map->size);
+        return 0;
+}
+
+/**
+ * @brief 检查map与参照表的全部内容一致
+ */
+static int check_all(){
+        CHECK(map_size(&test_map) == ref_size);
+        for(uint32_t k = 0; k < MAP_TEST_KEYS; k++){
+                uint32_t *v = test_u32_map_get(&test_map, &k);
+                if(ref_present[k]){
+                        CHECK(v != NULL);
+                        CHECK(*v == ref_value[k]);
+                }else{
+                        CHECK(v == NULL);
+                }
+        }
+        return check_index(&test_map);
+}
+
+/**
+ * @brief 随机的插入、更新、查找、删除与删除后重新插入，每步与参照表比较
+ */
+static int test_random(){
+        map_init(&test_map, sizeof(uint32_t), sizeof(uint32_t), 0, 0, NULL);
+        for(int op = 0; op < MAP_TEST_OPS; op++){
+                uint32_t r = test_rand();
+                // 键空间随时间在整个范围与前1/8之间切换，使索引表反复增长与收缩
+                uint32_t span = (op / 20000) % 2 ? MAP_TEST_KEYS / 8 : MAP_TEST_KEYS;
+                uint32_t k = (r >> 8) % span;
+                uint32_t v = test_rand();
+                switch(r % 8){
+                case 0: case 1: case 2:
+                        CHECK(map_set(&test_map, &k, &v) == 0);
+                        ref_size += !ref_present[k];
+                        ref_present[k] = 1;
+                        ref_value[k] = v;
+                        break;
+                case 3: case 4: case 5:
+                        map_delete(&test_map, &k);
+                        ref_size -= ref_present[k];
+                        ref_present[k] = 0;
+                        break;
+                default:{
+                        uint32_t *got = map_get(&test_map, &k);
+                        CHECK(ref_present[k] ? got && *got == ref_value[k] : got == NULL);
+                        break;
+                }
+                }
+                CHECK(map_size(&test_map) == ref_size);
+                if(op % 97 == 0 && check_all() < 0)
+                        return -1;
+        }
+        CHECK(check_all() == 0);
+        for(uint32_t k = 0; k < MAP_TEST_KEYS; k++)
+                map_delete(&test_map, &k);
+        CHECK(map_size(&test_map) == 0);
+        return check_index(&test_map);
+}
+
+/**
+ * @brief 构造在最小索引表中探测链越过表尾回绕到表头的情形，删除链中各个位置的键后检查后移是否正确回绕
+ */
+static int test_wrap(){
+        uint32_t keys[7];
+        size_t n = 0, last = MAP_TEST_INDEX_MIN - 1;
+        // 前四个键的理想位置为最后一个槽，后三个为倒数第二个槽，插入后链从倒数第二个槽回绕到表头
+        for(uint32_t k = 0; n < 4; k++)
+                if((map_hash(&k, sizeof(k)) & last) == last)
+                        keys[n++] = k;
+        for(uint32_t k = 0; n < 7; k++)
+                if((map_hash(&k, sizeof(k)) & last) == last - 1)
+                        keys[n++] = k;
+
+        for(size_t victim = 0; victim < n; victim++){
+                map_init(&test_map, sizeof(uint32_t), sizeof(uint32_t), 0, 0, NULL);
+                for(size_t j = 0; j < n; j++){
+                        uint32_t v = keys[j] ^ 0xa5a5a5a5u;
+                        CHECK(test_u32_map_set(&test_map, &keys[j], &v) == 0);
+                }
+                CHECK(test_map.index_mask == last);
+                CHECK(test_map.index[0].pos != 0 && map_slot_dist(&test_map, 0) > 0); // 确实发生了回绕
+                CHECK(check_index(&test_map) == 0);
+
+                test_u32_map_delete(&test_map, &keys[victim]);
+                CHECK(check_index(&test_map) == 0);
+                for(size_t j = 0; j < n; j++){
+                        uint32_t *v = test_u32_map_get(&test_map, &keys[j]);
+                        if(j == victim){
+                                CHECK(v == NULL);
+                        }else{
+                                CHECK(v != NULL && *v == (keys[j] ^ 0xa5a5a5a5u));
+                        }
+                }
+
+                uint32_t v = 7;
+                CHECK(test_u32_map_set(&test_map, &keys[victim], &v) == 0); // 重新插入同样要回绕
+                CHECK(check_index(&test_map) == 0);
+                CHECK(*test_u32_map_get(&test_map, &keys[victim]) == 7);
+        }
+        return 0;
+}
+
+/**
+ * @brief 跨多个条目块增长后删到只剩少数键，检查块与索引表确实收缩、剩余键的内容与地址不变，再增长回去
+ */
+static int test_shrink_grow(){
+        enum { MANY = 20 * MAP_CHUNK_SIZE, FEW = 10 };
+        static uint32_t *addr[MANY];
+        map_init(&test_map, sizeof(uint32_t), sizeof(uint32_t), 0, 0, NULL);
+        for(uint32_t k = 0; k < MANY; k++){
+                uint32_t v = k * 3 + 1;
+                CHECK(test_u32_map_set(&test_map, &k, &v) == 0);
+        }
+        CHECK(test_map.chunk_num == MANY / MAP_CHUNK_SIZE);
+        size_t big_mask = test_map.index_mask;
+        for(uint32_t k = 0; k < MANY; k++)
+                CHECK((addr[k] = test_u32_map_get(&test_map, &k)) != NULL);
+
+        // 保留最前面的FEW个键，其余从后往前删，使条目数组末尾可以截掉
+        for(uint32_t k = MANY; k-- > FEW;)
+                test_u32_map_delete(&test_map, &k);
+        CHECK(map_size(&test_map) == FEW);
+        CHECK(test_map.chunk_num <= 2);
+        CHECK(test_map.index_mask < big_mask);
+        CHECK(check_index(&test_map) == 0);
+        for(uint32_t k = 0; k < MANY; k++){
+                uint32_t *v = test_u32_map_get(&test_map, &k);
+                if(k < FEW){
+                        CHECK(v == addr[k] && *v == k * 3 + 1); // 块不移动，收缩后地址不变
+                }else{
+                        CHECK(v == NULL);
+                }
+        }
+
+        // 交错删除使空闲位置留在条目数组中间，再增长回去，空闲位置应被复用
+        for(uint32_t k = 0; k < FEW; k += 2)
+                test_u32_map_delete(&test_map, &k);
+        for(uint32_t k = FEW; k < MANY; k++){
+                uint32_t v = k * 5 + 2;
+                CHECK(test_u32_map_set(&test_map, &k, &v) == 0);
+        }
+        CHECK(test_map.chunk_num == MANY / MAP_CHUNK_SIZE);
+        CHECK(check_index(&test_map) == 0);
+        for(uint32_t k = 0; k < MANY; k++){
+                uint32_t *v = test_u32_map_get(&test_map, &k);
+                if(k < FEW && k % 2 == 0){
+                        CHECK(v == NULL);
+                }else if(k < FEW){
+                        CHECK(v == addr[k] && *v == k * 3 + 1);
+                }else{
+                        CHECK(v != NULL && *v == k * 5 + 2);
+                }
+        }
+        return 0;
+}
+
+/**
+ * @brief 对已有内容的map重复初始化，原有的存储应被释放，之后可以正常使用
+ *        泄漏由ASan构建检查，这里检查存储字段被清空以及超时map不会在清理链表中重复出现
+ */
+static int test_reinit(){
+        static map_t timed_map;
+        map_t *maps[2] = {&test_map, &timed_map};
+        for(int round = 0; round < 3; round++){
+                for(int m = 0; m < 2; m++){
+                        map_init(maps[m], sizeof(uint32_t), sizeof(uint32_t), 0, m ? 60 : 0, NULL);
+                        CHECK(maps[m]->chunks == NULL && maps[m]->chunk_num == 0);
+                        CHECK(maps[m]->index == NULL && maps[m]->free_heap == NULL);
+                        CHECK(map_size(maps[m]) == 0 && maps[m]->used == 0);
+                        for(uint32_t k = 0; k < 3 * MAP_CHUNK_SIZE; k++)
+                                CHECK(test_u32_map_set(maps[m], &k, &k) == 0);
+                        for(uint32_t k = 0; k < 3 * MAP_CHUNK_SIZE; k += 2)
+                                test_u32_map_delete(maps[m], &k); // 让空闲堆也分配出来
+                        CHECK(maps[m]->free_heap != NULL);
+                        uint32_t k = 1;
+                        CHECK(*test_u32_map_get(maps[m], &k) == 1);
+                }
+        }
+        map_sweep_poll(); // 超时map重复初始化后在清理链表中只出现一次，链表不能成环
+        map_init(&test_map, sizeof(uint32_t), sizeof(uint32_t), 0, 0, NULL);
+        map_init(&timed_map, sizeof(uint32_t), sizeof(uint32_t), 0, 60, NULL);
+        return 0;
+}
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest start\n");
+        if(test_wrap() < 0) return -1;
+        printf("\e[0;34mwrap-around delete ok\n");
+        if(test_random() < 0) return -1;
+        printf("\e[0;34mrandom set/get/delete ok\n");
+        if(test_shrink_grow() < 0) return -1;
+        printf("\e[0;34mshrink and grow ok\n");
+        if(test_reinit() < 0) return -1;
+        printf("\e[0;34mre-init ok\n\e[0m");
+        return 0;
+}
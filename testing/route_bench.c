@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "route.h"
+
+#define BENCH_ROUTES 100000   // 插入的路由条数
+#define BENCH_LONG_BLOCKS 2000 // 长于24位的前缀集中在这么多个/24内，与真实路由表相似
+#define BENCH_NEXTHOPS 64     // 不同下一跳的个数
+#define BENCH_LOOKUPS 10000000 // 测量的查找次数
+#define BENCH_CHECKS 1000000  // 与参考实现比对的地址个数
+
+typedef struct bench_key //参考实现的键
+{
+    uint32_t prefix;
+    uint32_t len;
+} bench_key_t;
+
+MAP_DEFINE(bench_rule_map, bench_key_t, net_nexthop_t)
+
+static net_route_table_t bench_table;
+static map_t bench_rules; // 参考实现：按前缀长度逐级精确查找
+static uint32_t bench_seed = 2463534242u;
+
+/**
+ * @brief 获取单调时钟的纳秒数
+ *
+ * @return uint64_t 纳秒
+ */
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief xorshift伪随机数
+ *
+ * @return uint32_t 随机数
+ */
+static uint32_t bench_rand()
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+}
+
+/**
+ * @brief 把32位整数转为ip地址
+ *
+ * @param addr 地址，主机字节序
+ * @param ip 出口参数，ip地址
+ */
+static void bench_ip(uint32_t addr, uint8_t *ip)
+{
+    ip[0] = addr >> 24, ip[1] = addr >> 16, ip[2] = addr >> 8, ip[3] = addr;
+}
+
+/**
+ * @brief 生成第i个下一跳
+ *
+ * @param i 序号
+ * @param nexthop 出口参数，下一跳
+ */
+static void bench_nexthop(uint32_t i, net_nexthop_t *nexthop)
+{
+    memset(nexthop, 0, sizeof(net_nexthop_t));
+    bench_ip(0x0A000001u + i, nexthop->gateway);
+    nexthop->if_id = i % NET_IF_MAX;
+    nexthop->mtu = i % 2 ? 1400 : 0;
+}
+
+/**
+ * @brief 生成一条随机路由：多数为/16~/24，少数更短，约一成长于24位
+ *
+ * @param key 出口参数，前缀与前缀长度
+ */
+static void bench_prefix(bench_key_t *key)
+{
+    uint32_t r = bench_rand() % 100;
+    if (r < 10)
+    {
+        key->len = 25 + bench_rand() % 8;
+        key->prefix = ((0x64000000u >> 8) + bench_rand() % BENCH_LONG_BLOCKS) << 8 | (bench_rand() & 0xFF);
+    }
+    else
+    {
+        key->len = r < 15 ? 8 + bench_rand() % 8 : 16 + bench_rand() % 9;
+        key->prefix = bench_rand();
+    }
+    key->prefix &= ~0u << (32 - key->len);
+}
+
+/**
+ * @brief 用参考实现查找最长前缀匹配的路由
+ *
+ * @param addr 目的地址
+ * @return net_nexthop_t* 下一跳，没有匹配的路由时为NULL
+ */
+static net_nexthop_t *bench_reference(uint32_t addr)
+{
+    for (int len = 32; len > 0; len--)
+    {
+        bench_key_t key = {addr & (~0u << (32 - len)), len};
+        net_nexthop_t *nexthop = bench_rule_map_get(&bench_rules, &key);
+        if (nexthop)
+            return nexthop;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 比对路由表与参考实现的查找结果，地址一半取自路由前缀附近，一半完全随机
+ *
+ * @param stage 阶段名
+ * @return int 一致为0，不一致为-1
+ */
+static int bench_check(const char *stage)
+{
+    for (uint32_t i = 0; i < BENCH_CHECKS; i++)
+    {
+        uint32_t addr = bench_rand();
+        if (i % 2)
+            addr = ((0x64000000u >> 8) + addr % BENCH_LONG_BLOCKS) << 8 | (addr >> 24);
+        uint8_t ip[4];
+        bench_ip(addr, ip);
+        net_nexthop_t *got = net_route_lookup(&bench_table, ip);
+        net_nexthop_t *want = bench_reference(addr);
+        if ((got == NULL) != (want == NULL) || (got && memcmp(got, want, sizeof(net_nexthop_t)) != 0))
+        {
+            fprintf(stderr, "Error in %s: lookup mismatch for %u.%u.%u.%u\n", stage, ip[0], ip[1], ip[2], ip[3]);
+            return -1;
+        }
+    }
+    printf("%-8s | %8zu routes | %5zu tbl8 groups used | ok\n", stage, map_size(&bench_rules),
+           (size_t)NET_ROUTE_TBL8_GROUPS - bench_table.tbl8_free_num);
+    return 0;
+}
+
+/**
+ * @brief 测量平均查找延迟
+ *
+ * @param hit 为1时只查找被路由覆盖的地址，为0时查找随机地址
+ */
+static void bench_lookup(int hit)
+{
+    static uint8_t ips[1 << 16][4];
+    for (size_t i = 0; i < sizeof(ips) / sizeof(ips[0]); i++)
+    {
+        uint32_t addr = bench_rand();
+        if (hit)
+            addr = ((0x64000000u >> 8) + addr % BENCH_LONG_BLOCKS) << 8 | (addr >> 24);
+        bench_ip(addr, ips[i]);
+    }
+    volatile uintptr_t sink = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+        sink += (uintptr_t)net_route_lookup(&bench_table, ips[i & 0xFFFF]);
+    uint64_t cost = bench_now_ns() - start;
+    printf("lookup   | %-15s | %10.1f ns/op\n", hit ? "long prefixes" : "random", (double)cost / BENCH_LOOKUPS);
+}
+
+/**
+ * @brief 插入与删除随机路由并与参考实现比对，再测量查找延迟
+ *        带参数check时只做比对，不测量，作为ctest运行
+ *
+ */
+int main(int argc, char *argv[])
+{
+    int check_only = argc > 1 && strcmp(argv[1], "check") == 0;
+    if (net_route_init(&bench_table) < 0)
+        return 1;
+    bench_rule_map_init(&bench_rules, 0, 0);
+
+    static bench_key_t keys[BENCH_ROUTES];
+    for (uint32_t i = 0; i < BENCH_ROUTES; i++)
+    {
+        net_nexthop_t nexthop;
+        bench_prefix(&keys[i]);
+        bench_nexthop(bench_rand() % BENCH_NEXTHOPS, &nexthop);
+        uint8_t prefix[4];
+        bench_ip(keys[i].prefix, prefix);
+        if (net_route_add(&bench_table, prefix, keys[i].len, &nexthop) < 0)
+        {
+            fprintf(stderr, "Error in net_route_add:%u\n", i);
+            return 1;
+        }
+        bench_rule_map_set(&bench_rules, &keys[i], &nexthop);
+    }
+    if (bench_check("add") < 0)
+        return 1;
+
+    for (uint32_t i = 0; i < BENCH_ROUTES; i += 2)
+    {
+        uint8_t prefix[4];
+        bench_ip(keys[i].prefix, prefix);
+        if (bench_rule_map_get(&bench_rules, &keys[i]) == NULL)
+            continue; // 重复的前缀已删除过
+        if (net_route_delete(&bench_table, prefix, keys[i].len) < 0)
+        {
+            fprintf(stderr, "Error in net_route_delete:%u\n", i);
+            return 1;
+        }
+        bench_rule_map_delete(&bench_rules, &keys[i]);
+    }
+    if (bench_check("delete") < 0)
+        return 1;
+    if (check_only)
+        return 0;
+
+    bench_lookup(0);
+    bench_lookup(1);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "shard.h"
+
+/**
+ * @brief 微软RSS文档“Verifying the RSS Hash Calculation”中使用默认密钥的验证向量
+ *        输入按源ip、目的ip、源端口、目的端口排列；IPv4只哈希地址，IPv4+TCP/UDP哈希地址和端口
+ *
+ */
+typedef struct rss_vector
+{
+        uint8_t dst_ip[4];
+        uint16_t dst_port;
+        uint8_t src_ip[4];
+        uint16_t src_port;
+        uint32_t ipv4;    // 只哈希地址的结果
+        uint32_t ipv4_l4; // 哈希地址和端口的结果
+} rss_vector_t;
+
+static const rss_vector_t vectors[] = {
+        {{161, 142, 100, 80}, 1766, {66, 9, 149, 187}, 2794, 0x323e8fc2, 0x51ccc178},
+        {{65, 69, 140, 83}, 4739, {199, 92, 111, 2}, 14230, 0xd718262a, 0xc626b0ea},
+        {{12, 22, 207, 184}, 38024, {24, 19, 198, 95}, 12898, 0xd2d0a5de, 0x5c2b394a},
+        {{209, 142, 163, 6}, 2217, {38, 27, 205, 30}, 48228, 0x82989176, 0xafc7327f},
+        {{202, 188, 127, 2}, 1303, {153, 39, 163, 191}, 44251, 0x5d1809c5, 0x10e828a2},
+};
+
+int main(int argc, char* argv[]){
+        int failed = 0;
+        printf("\e[0;34mTest start\n");
+        for(size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++){
+                const rss_vector_t *v = &vectors[i];
+                uint8_t tuple[12];
+                memcpy(tuple, v->src_ip, 4);
+                memcpy(tuple + 4, v->dst_ip, 4);
+                tuple[8] = v->src_port >> 8;
+                tuple[9] = v->src_port & 0xff;
+                tuple[10] = v->dst_port >> 8;
+                tuple[11] = v->dst_port & 0xff;
+
+                uint32_t ipv4 = net_shard_hash(tuple, 8);
+                uint32_t ipv4_l4 = net_shard_hash(tuple, 12);
+                memset(tuple + 8, 0, 4); // 端口清零时与只哈希地址相同，分片的包就是这样哈希的
+                uint32_t zero_ports = net_shard_hash(tuple, 12);
+                if(ipv4 != v->ipv4 || ipv4_l4 != v->ipv4_l4 || zero_ports != v->ipv4){
+                        printf("\e[1;31mvector %zu: ipv4 %08x (expect %08x), ipv4+l4 %08x (expect %08x), zero ports %08x\n",
+                               i, ipv4, v->ipv4, ipv4_l4, v->ipv4_l4, zero_ports);
+                        failed = 1;
+                }
+        }
+        if(failed){
+                printf("\e[0m");
+                return -1;
+        }
+        printf("\e[0;34mall RSS verification vectors match\n\e[0m");
+        return 0;
+}
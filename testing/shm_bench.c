@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "net.h"
+#include "stack.h"
+#include "driver.h"
+#include "udp.h"
+
+#define BENCH_PORT 60000      // 回显端口
+#define BENCH_LEN 64          // 每个udp数据包的负载长度
+#define BENCH_PINGS 100000    // 测量往返延迟的次数，每次只有一个数据包在途
+#define BENCH_PACKETS 2000000 // 测量吞吐量时回显的数据包数
+#define BENCH_WINDOW 256      // 测量吞吐量时最多同时在途的数据包数
+
+static uint64_t bench_replies; // 收到的回显数
+
+/**
+ * @brief 获取单调时钟的纳秒数
+ *
+ * @return uint64_t 纳秒
+ */
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief 回显进程的udp处理程序，原样发回
+ */
+static void bench_echo(net_stack_t *stack, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+    udp_send(stack, data, len, BENCH_PORT, src_ip, src_port);
+}
+
+/**
+ * @brief 测量进程的udp处理程序，只计数
+ */
+static void bench_reply(net_stack_t *stack, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+    bench_replies++;
+}
+
+/**
+ * @brief 比较两个往返时间，供qsort使用
+ */
+static int bench_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 回显进程：换一个ip与mac后一直回显
+ */
+static void bench_echo_process()
+{
+    net_if_t *net_if = &net_default_stack.ifs[0];
+    if (net_init() != 0)
+        _exit(1);
+    net_if->ip[3]++;
+    net_if->mac[5] ^= 1;
+    udp_open(&net_default_stack, BENCH_PORT, bench_echo);
+    while (1)
+        if (net_poll(&net_default_stack) == 0)
+            net_wait();
+}
+
+int main()
+{
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w"); // 协议栈逐包打印日志，只保留测量结果
+    freopen("/dev/null", "w", stdout);
+    char name[64];
+    snprintf(name, sizeof(name), "shm_bench.%d", (int)getpid()); // 两个进程用同一条链路，不与其他实例冲突
+    setenv("NET_SHM_NAME", name, 1);
+    if (driver_select("shm") < 0)
+        return 1;
+    pid_t echo = fork();
+    if (echo == 0)
+        bench_echo_process();
+    if (echo < 0 || net_init() != 0)
+        return 1;
+    net_stack_t *stack = &net_default_stack;
+    udp_open(stack, BENCH_PORT + 1, bench_reply);
+    uint8_t peer[NET_IP_LEN];
+    memcpy(peer, stack->ifs[0].ip, NET_IP_LEN);
+    peer[3]++;
+    uint8_t data[BENCH_LEN] = {0};
+
+    // 首个数据包要等arp解析，超时重发
+    while (bench_replies == 0)
+    {
+        udp_send(stack, data, BENCH_LEN, BENCH_PORT + 1, peer, BENCH_PORT);
+        for (uint64_t start = bench_now_ns(); bench_replies == 0 && bench_now_ns() - start < 100000000ull;)
+            if (net_poll(stack) == 0)
+                net_wait();
+    }
+
+    static uint64_t rtts[BENCH_PINGS];
+    for (int i = 0; i < BENCH_PINGS; i++)
+    {
+        uint64_t replies = bench_replies, start = bench_now_ns();
+        udp_send(stack, data, BENCH_LEN, BENCH_PORT + 1, peer, BENCH_PORT);
+        while (bench_replies == replies)
+            if (net_poll(stack) == 0)
+                net_wait();
+        rtts[i] = bench_now_ns() - start;
+    }
+    qsort(rtts, BENCH_PINGS, sizeof(uint64_t), bench_cmp);
+    fprintf(out, "rtt        | p50 %8.1f us | p99 %8.1f us | p99.9 %8.1f us\n", rtts[BENCH_PINGS / 2] / 1e3,
+           rtts[BENCH_PINGS * 99 / 100] / 1e3, rtts[BENCH_PINGS * 999 / 1000] / 1e3);
+
+    uint64_t sent = 0, base = bench_replies, start = bench_now_ns(), progress = start;
+    while (bench_replies - base < BENCH_PACKETS)
+    {
+        while (sent - (bench_replies - base) < BENCH_WINDOW && sent < BENCH_PACKETS)
+        {
+            udp_send(stack, data, BENCH_LEN, BENCH_PORT + 1, peer, BENCH_PORT);
+            sent++;
+        }
+        if (net_poll(stack) > 0)
+            progress = bench_now_ns();
+        else if (bench_now_ns() - progress > 100000000ull) // 在途的数据包丢了，重新开窗
+        {
+            sent = bench_replies - base;
+            progress = bench_now_ns();
+        }
+    }
+    double sec = (bench_now_ns() - start) / 1e9;
+    fprintf(out, "throughput | %8.2f Mpps echoed | window %d | %d bytes\n", BENCH_PACKETS / sec / 1e6, BENCH_WINDOW, BENCH_LEN);
+
+    kill(echo, SIGKILL);
+    waitpid(echo, NULL, 0);
+    return 0;
+}
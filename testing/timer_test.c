@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "timer.h"
+#include "clock.h"
+
+#define TIMER_TEST_RANDOM 4000        // 随机测试的定时器个数
+#define TIMER_TEST_MAX_DELAY (1 << 22) // 随机测试的最大延时，毫秒，跨越前三层
+
+#define CHECK(cond)                                                                 \
+        do{                                                                         \
+                if(!(cond)){                                                        \
+                        printf("\e[1;31m\n%s:%d: check failed: %s\n\e[0m",          \
+                               __FILE__, __LINE__, #cond);                          \
+                        return -1;                                                  \
+                }                                                                   \
+        }while(0)
+
+typedef struct test_timer //测试用的定时器，记录期望与实际的到期时刻
+{
+        net_timer_t timer;
+        uint64_t expect;   // 期望的到期时刻，毫秒
+        uint64_t fired_at; // 实际的到期时刻，毫秒，未到期为0
+        int fired;         // 到期次数
+        uint64_t period;   // 不为0时为周期定时器，回调中以该周期重新添加
+} test_timer_t;
+
+static test_timer_t timers[TIMER_TEST_RANDOM];
+static uint32_t rand_state = 88675123u;
+static uint64_t last_fired; // 上一个到期的定时器的期望时刻，用于检查到期顺序
+
+/**
+ * @brief xorshift32伪随机数，固定种子使失败可复现
+ */
+static uint32_t test_rand(){
+        rand_state ^= rand_state << 13;
+        rand_state ^= rand_state >> 17;
+        rand_state ^= rand_state << 5;
+        return rand_state;
+}
+
+static void test_handler(net_timer_t *timer, void *arg){
+        test_timer_t *t = arg;
+        t->fired++;
+        t->fired_at = net_clock_ms();
+        if(t->expect < last_fired)
+                t->fired = -1000; // 乱序，由检查报告
+        last_fired = t->expect;
+        if(t->period){
+                t->expect += t->period;
+                net_timer_add(timer, t->period);
+        }
+}
+
+static void add(test_timer_t *t, uint64_t delay){
+        net_timer_setup(&t->timer, test_handler, t);
+        t->expect = net_clock_ms() + delay;
+        t->fired = 0;
+        t->fired_at = 0;
+        t->period = 0;
+        net_timer_add(&t->timer, delay);
+}
+
+/**
+ * @brief 按net_timer_next给出的时长推进虚拟时钟并轮询，直到until时刻
+ *        每次只推进到下一个可能到期的时刻，定时器应恰好在期望的毫秒到期
+ */
+static void run_until(uint64_t until){
+        while(net_clock_ms() < until){
+                int64_t next = net_timer_next();
+                uint64_t step = next <= 0 ? 1 : (uint64_t)next;
+                if(net_clock_ms() + step > until)
+                        step = until - net_clock_ms();
+                net_clock_advance(step * 1000000);
+                net_timer_poll();
+        }
+}
+
+/**
+ * @brief 各层边界两侧的延时，逐个检查到期的毫秒
+ */
+static int test_boundaries(){
+        static const uint64_t delays[] = {
+                0, 1, 2, 254, 255, 256, 257, 511, 512, 1000,
+                (1 << 14) - 1, 1 << 14, (1 << 14) + 1, 100000,
+                (1 << 20) - 1, 1 << 20, (1 << 20) + 1, 3000000,
+        };
+        size_t n = sizeof(delays) / sizeof(delays[0]);
+        uint64_t start = net_clock_ms();
+        last_fired = 0;
+        for(size_t i = 0; i < n; i++)
+                add(&timers[i], delays[i]);
+        net_timer_poll(); // 延时为0的在本次轮询到期
+        CHECK(timers[0].fired == 1 && timers[0].fired_at == start);
+        run_until(start + delays[n - 1] + 10);
+        for(size_t i = 0; i < n; i++){
+                CHECK(timers[i].fired == 1);
+                CHECK(timers[i].fired_at == timers[i].expect);
+                CHECK(!net_timer_pending(&timers[i].timer));
+        }
+        CHECK(net_timer_next() == -1);
+        return 0;
+}
+
+/**
+ * @brief 取消还在上层的、已经迁移到第一层的定时器，以及重新设置到期时刻的定时器
+ */
+static int test_cancel(){
+        uint64_t start = net_clock_ms();
+        last_fired = 0;
+        add(&timers[0], 300);          // 第二层，迁移前取消
+        // 第三层，迁移到第一层后取消；凑整使到期时刻的低8位为128，到期前1毫秒时一定已在第一层
+        add(&timers[1], 20000 + (128 - (start + 20000)) % 256);
+        add(&timers[2], 5000);         // 保留，作为对照
+        add(&timers[3], 70000);        // 重新设置为更早的时刻
+        add(&timers[4], 40);           // 重新设置为更晚的时刻，跨层
+        net_timer_cancel(&timers[0].timer);
+        CHECK(!net_timer_pending(&timers[0].timer));
+        net_timer_cancel(&timers[0].timer); // 重复取消应被忽略
+
+        run_until(start + 10);
+        net_timer_add(&timers[3].timer, 90);
+        timers[3].expect = start + 10 + 90;
+        net_timer_add(&timers[4].timer, 9000);
+        timers[4].expect = start + 10 + 9000;
+
+        run_until(timers[1].expect - 1); // 第一层转到到期时刻所在的一圈时已迁移下来
+        CHECK(net_timer_pending(&timers[1].timer));
+        net_timer_cancel(&timers[1].timer);
+
+        run_until(start + 100000);
+        CHECK(timers[0].fired == 0 && timers[1].fired == 0);
+        for(int i = 2; i <= 4; i++){
+                CHECK(timers[i].fired == 1);
+                CHECK(timers[i].fired_at == timers[i].expect);
+        }
+        CHECK(net_timer_next() == -1);
+        return 0;
+}
+
+/**
+ * @brief 回调中重新添加的周期定时器，每个周期恰好到期一次
+ */
+static int test_periodic(){
+        uint64_t start = net_clock_ms();
+        last_fired = 0;
+        add(&timers[0], 300);
+        timers[0].period = 300;
+        run_until(start + 300 * 100);
+        CHECK(timers[0].fired == 100);
+        CHECK(timers[0].fired_at == start + 300 * 100);
+        net_timer_cancel(&timers[0].timer);
+        CHECK(net_timer_next() == -1);
+        return 0;
+}
+
+/**
+ * @brief 大量随机延时的定时器，随机取消一部分，其余都恰好在期望的毫秒到期一次
+ *        最后一次性推进一大段时间，检查跳过多圈时的迁移
+ */
+static int test_random(){
+        uint64_t start = net_clock_ms();
+        last_fired = 0;
+        for(int i = 0; i < TIMER_TEST_RANDOM; i++)
+                add(&timers[i], test_rand() % TIMER_TEST_MAX_DELAY);
+        for(int i = 0; i < TIMER_TEST_RANDOM; i += 7)
+                net_timer_cancel(&timers[i].timer);
+        run_until(start + TIMER_TEST_MAX_DELAY);
+        for(int i = 0; i < TIMER_TEST_RANDOM; i++){
+                if(i % 7 == 0){
+                        CHECK(timers[i].fired == 0);
+                }else{
+                        CHECK(timers[i].fired == 1);
+                        CHECK(timers[i].fired_at == timers[i].expect);
+                }
+        }
+
+        start = net_clock_ms();
+        last_fired = 0;
+        for(int i = 0; i < TIMER_TEST_RANDOM; i++)
+                add(&timers[i], test_rand() % TIMER_TEST_MAX_DELAY);
+        net_clock_advance((uint64_t)TIMER_TEST_MAX_DELAY * 1000000);
+        net_timer_poll();
+        for(int i = 0; i < TIMER_TEST_RANDOM; i++){
+                CHECK(timers[i].fired == 1); // 一次轮询中按期望时刻的顺序全部到期
+                CHECK(timers[i].fired_at == start + TIMER_TEST_MAX_DELAY);
+        }
+        CHECK(net_timer_next() == -1);
+        return 0;
+}
+
+int main(int argc, char* argv[]){
+        net_clock_set_virtual(1);
+        net_timer_init();
+        printf("\e[0;34mTest start\n");
+        if(test_boundaries() < 0) return -1;
+        printf("\e[0;34mlevel boundaries ok\n");
+        if(test_cancel() < 0) return -1;
+        printf("\e[0;34mcancel and re-add ok\n");
+        if(test_periodic() < 0) return -1;
+        printf("\e[0;34mperiodic ok\n");
+        if(test_random() < 0) return -1;
+        printf("\e[0;34mrandom ok\n\e[0m");
+        return 0;
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "stack.h"
+#include "driver.h"
+#include "driver_vlink.h"
+#include "clock.h"
+#include "udp.h"
+
+#define BENCH_PORT 60000      // 回显端口
+#define BENCH_LEN 1000        // 每个请求的负载长度
+#define BENCH_REQUESTS 200000 // 每个场景发出的请求数
+#define BENCH_WINDOW 64       // 最多同时在途的请求数
+#define BENCH_TIMEOUT_NS 10000000 // 请求发出后这么久没有回显即视为丢失
+#define BENCH_IDLE_NS 1000000     // 链路上没有在途帧时虚拟时钟一次推进的时间，让超时与arp等表项按时到期
+
+typedef struct bench_scenario //一个测量场景，两个方向使用相同的损伤参数
+{
+    const char *name;
+    driver_vlink_conf_t conf;
+} bench_scenario_t;
+
+static const bench_scenario_t bench_scenarios[] = {
+    {"clean", {.delay_us = 50, .rate_bps = 1000000000}},
+    {"loss 1%", {.delay_us = 50, .rate_bps = 1000000000, .loss = 0.01}},
+    {"burst loss", {.delay_us = 50, .rate_bps = 1000000000, .burst_enter = 0.005, .burst_exit = 0.3, .burst_loss = 0.5}},
+    {"jitter", {.delay_us = 200, .jitter_us = 100, .rate_bps = 1000000000}},
+    {"reorder+dup", {.delay_us = 200, .reorder = 0.05, .duplicate = 0.01, .rate_bps = 1000000000}},
+    {"100Mbit 1ms", {.delay_us = 1000, .rate_bps = 100000000, .limit = 32}},
+};
+
+static net_stack_t bench_peer;          // 回显端的协议栈，与net_default_stack经虚拟链路相连
+static uint64_t bench_sent_at[BENCH_REQUESTS]; // 各请求的发送时刻
+static uint8_t bench_got[BENCH_REQUESTS];      // 各请求的状态，为1表示已收到回显，为2表示已超时
+static uint64_t bench_rtts[BENCH_REQUESTS];    // 收到的回显的往返时间
+static uint64_t bench_replies;                 // 收到的不重复的回显数
+static uint64_t bench_dups;                    // 重复的回显数
+static uint64_t bench_reordered;               // 序号小于此前最大序号的回显数
+static uint32_t bench_max_seq;                 // 已收到的最大序号
+
+/**
+ * @brief 获取单调时钟的纳秒数，用于统计模拟本身花费的真实时间
+ *
+ * @return uint64_t 纳秒
+ */
+static uint64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief 回显端的udp处理程序，原样发回
+ */
+static void bench_echo(net_stack_t *stack, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+    udp_send(stack, data, len, BENCH_PORT, src_ip, src_port);
+}
+
+/**
+ * @brief 请求端的udp处理程序，按序号记录往返时间、重复与乱序
+ */
+static void bench_reply(net_stack_t *stack, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+    uint32_t seq;
+    memcpy(&seq, data, sizeof(seq));
+    if (len != BENCH_LEN || seq >= BENCH_REQUESTS)
+        return;
+    if (bench_got[seq])
+    {
+        bench_dups += bench_got[seq] == 1;
+        return;
+    }
+    bench_got[seq] = 1;
+    bench_rtts[bench_replies++] = net_clock_ns() - bench_sent_at[seq];
+    if (seq < bench_max_seq)
+        bench_reordered++;
+    else
+        bench_max_seq = seq;
+}
+
+/**
+ * @brief 比较两个往返时间，供qsort使用
+ */
+static int bench_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 轮询两个协议栈一次，都没有收到数据包时把虚拟时钟推进到下一帧送达
+ *
+ * @return int 链路上没有在途帧且两端都空闲为1，否则为0
+ */
+static int bench_step()
+{
+    if (net_poll(&net_default_stack) + net_poll(&bench_peer) > 0)
+        return 0;
+    int64_t next = driver_vlink_next();
+    net_clock_advance(next < 0 ? BENCH_IDLE_NS : next > 0 ? next : 1);
+    return next < 0;
+}
+
+/**
+ * @brief 在一个场景下发出BENCH_REQUESTS个请求，窗口内的请求全部在途，统计送达率、吞吐量与往返时间
+ *        协议栈的tcp只能被动打开且没有重传定时器，丢包下无法完成传输，因此用udp请求-回显测量
+ *
+ * @param scenario 场景
+ * @param peer_ip 回显端ip
+ * @return int 送达率为100%为1，否则为0
+ */
+static int bench_run(const bench_scenario_t *scenario, uint8_t *peer_ip)
+{
+    driver_vlink_conf_t conf = scenario->conf;
+    conf.seed = 1;
+    driver_vlink_config(&net_default_stack.ifs[0], &conf);
+    conf.seed = 2;
+    driver_vlink_config(&bench_peer.ifs[0], &conf);
+    memset(bench_got, 0, sizeof(bench_got));
+    bench_replies = bench_dups = bench_reordered = bench_max_seq = 0;
+
+    uint8_t data[BENCH_LEN] = {0};
+    uint64_t sent = 0, oldest = 0, lost = 0, start = net_clock_ns(), wall = bench_now_ns();
+    while (oldest < BENCH_REQUESTS)
+    {
+        while (sent < BENCH_REQUESTS && sent - bench_replies - lost < BENCH_WINDOW)
+        {
+            uint32_t seq = sent++;
+            memcpy(data, &seq, sizeof(seq));
+            bench_sent_at[seq] = net_clock_ns();
+            udp_send(&net_default_stack, data, BENCH_LEN, BENCH_PORT + 1, peer_ip, BENCH_PORT);
+        }
+        bench_step();
+        for (; oldest < sent && (bench_got[oldest] || net_clock_ns() - bench_sent_at[oldest] > BENCH_TIMEOUT_NS); oldest++)
+            if (!bench_got[oldest])
+            {
+                bench_got[oldest] = 2;
+                lost++;
+            }
+    }
+    double sec = (net_clock_ns() - start) / 1e9;
+    qsort(bench_rtts, bench_replies, sizeof(uint64_t), bench_cmp);
+    fprintf(stderr, "%-12s | %6.2f%% echoed | %8.1f Mbps | rtt p50 %8.1f p99 %8.1f p99.9 %8.1f us | %5lu reordered %4lu dup | %5.2fs wall\n",
+            scenario->name, 100.0 * bench_replies / BENCH_REQUESTS, bench_replies * BENCH_LEN * 8 / sec / 1e6,
+            bench_rtts[bench_replies / 2] / 1e3, bench_rtts[bench_replies * 99 / 100] / 1e3,
+            bench_rtts[bench_replies * 999 / 1000] / 1e3, (unsigned long)bench_reordered, (unsigned long)bench_dups,
+            (bench_now_ns() - wall) / 1e9);
+    return bench_replies == BENCH_REQUESTS;
+}
+
+int main()
+{
+#ifdef _WIN32
+    freopen("NUL", "w", stdout); // 协议栈逐包打印日志，测量结果打印到stderr
+#else
+    freopen("/dev/null", "w", stdout);
+#endif
+    if (driver_select("vlink") < 0 || net_init() != 0)
+        return 1;
+    if (net_stack_init(&bench_peer) < 0)
+        return 1;
+    net_if_t *peer_if = &bench_peer.ifs[0];
+    peer_if->ip[3]++;
+    peer_if->mac[5] ^= 1;
+    if (driver_open(peer_if) < 0)
+        return 1;
+    udp_open(&bench_peer, BENCH_PORT, bench_echo);
+    udp_open(&net_default_stack, BENCH_PORT + 1, bench_reply);
+    net_clock_set_virtual(1);
+
+    uint8_t data[BENCH_LEN] = {0}; // 先等arp解析完成
+    udp_send(&net_default_stack, data, BENCH_LEN, BENCH_PORT + 1, peer_if->ip, BENCH_PORT);
+    while (!bench_step())
+        ;
+
+    for (size_t i = 0; i < sizeof(bench_scenarios) / sizeof(bench_scenarios[0]); i++)
+        if (!bench_run(&bench_scenarios[i], peer_if->ip) && i == 0)
+        {
+            fprintf(stderr, "Error in vlink_bench: requests lost on a clean link\n");
+            return 1;
+        }
+    return 0;
+}